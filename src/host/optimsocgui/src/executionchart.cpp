@@ -90,6 +90,10 @@ ExecutionChart::ExecutionChart(QWidget *parent) :
             SIGNAL(softwareTraceEvent(struct SoftwareTraceEvent)),
             this,
             SLOT(addTraceEvent(struct SoftwareTraceEvent)));
+    connect(m_sysif->softwareTraceEventDistributor(),
+            SIGNAL(softwareTraceReset(unsigned int)),
+            this,
+            SLOT(resetPlots(unsigned int)));
 }
 
 ExecutionChart::~ExecutionChart()
@@ -102,9 +106,28 @@ void ExecutionChart::systemChanged(OptimsocSystem* oldSystem,
 {
     Q_UNUSED(oldSystem);
 
-    QList<OptimsocSystemElement*> tiles = newSystem->tiles();
+    resetPlots(newSystem->tiles().size());
+}
+
+/**
+ * Drop all trace data and create new plots for @p coreCount cores
+ */
+void ExecutionChart::resetPlots(unsigned int coreCount)
+{
+    m_ui->widget_plot->clearPlottables();
+    m_ui->widget_plot->plotLayout()->clear();
+    m_plotCores.clear();
+    m_plotLoads.clear();
+    m_currentMaximum = 0;
+    m_autoscroll = true;
+
+    createPlots(coreCount);
+}
+
+void ExecutionChart::createPlots(unsigned int coreCount)
+{
     unsigned int row = 0;
-    for (int i=0; i<tiles.size(); ++i) {
+    for (unsigned int i=0; i<coreCount; ++i) {
         QCPAxisRect *coreaxis = new QCPAxisRect(m_ui->widget_plot);
         ExecutionChartPlotCore *plot = new ExecutionChartPlotCore(coreaxis->axis(QCPAxis::atBottom), coreaxis->axis(QCPAxis::atLeft), QString("Core %1").arg(i));
         m_ui->widget_plot->plotLayout()->addElement(row++, 0, coreaxis);
@@ -60,8 +60,11 @@ private slots:
 
     void systemChanged(OptimsocSystem* oldSystem, OptimsocSystem* newSystem);
     void addTraceEvent(struct SoftwareTraceEvent);
+    void resetPlots(unsigned int coreCount);
 
 private:
+    void createPlots(unsigned int coreCount);
+
     Ui::ExecutionChart *m_ui;
     QVector<ExecutionChartPlotCore*> m_plotCores;
     QVector<ExecutionChartPlotLoad*> m_plotLoads;
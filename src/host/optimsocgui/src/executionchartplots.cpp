@@ -26,6 +26,7 @@
 
 #include "executionchart.h"
 #include "executionchartcreators.h"
+#include "executionchartregistry.h"
 
 #include <QMessageBox>
 #include <cmath>
@@ -35,13 +36,6 @@
 #include <QGraphicsItem>
 #include <QGraphicsSimpleTextItem>
 
-#include <QFile>
-#include <QDir>
-#include <QTextStream>
-#include <QProcessEnvironment>
-
-#include <QSettings>
-
 ExecutionChartPlot::ExecutionChartPlot(QCPAxis *keyaxis, QCPAxis *valueaxis)
     : QCPAbstractPlottable(keyaxis, valueaxis)
 {
@@ -51,23 +45,47 @@ ExecutionChartPlot::ExecutionChartPlot(QCPAxis *keyaxis, QCPAxis *valueaxis)
 ExecutionChartPlotCore::ExecutionChartPlotCore(QCPAxis *keyaxis, QCPAxis *valueaxis, QString corename)
     : ExecutionChartPlot(keyaxis, valueaxis), m_currentExtend(0)
 {
+    ExecutionChartEventRegistry *registry = ExecutionChartEventRegistry::instance();
+    m_traceCreators.resize(registry->slotCount());
+
     ExecutionChartSectionCreator *section =
             new ExecutionChartSectionCreator(this);
-    m_traceCreators[0x1].push_back(section);
-    m_traceCreators[0x10].push_back(section);
-    m_traceCreators[0x20].push_back(section);
-    m_traceCreators[0x21].push_back(section);
-    m_traceCreators[0x22].push_back(section);
-    m_traceCreators[0x23].push_back(section);
-    m_traceCreators[0x24].push_back(section);
-    m_traceCreators[0x25].push_back(section);
+    uint16_t id;
+    foreach (id, registry->sectionEventIds()) {
+        m_traceCreators[registry->slot(id)].push_back(section);
+    }
     m_creators.append(section);
     m_creatorLayers.insert(LayerSections, section);
 
-    QString path = QProcessEnvironment::systemEnvironment().value("OPTIMSOC");
-    path = path + "/src/sw/host/optimsocgui/events.d";
+    ExecutionChartEventDefinition def;
+    foreach (def, registry->definitions()) {
+        ExecutionChartEventCreator *event =
+                new ExecutionChartEventCreator(this, def.width, def.text, def.color);
 
-    readEventsFromPath(path);
+        if (def.format.length() == 0) {
+            event->appendEmpty();
+        }
+
+        for (int i = 0; i < def.format.length(); ++i) {
+            if (def.format[i] == 'u') {
+                event->appendDec(i == 0);
+            } else if (def.format[i] == 'd') {
+                event->appendDecSigned(i == 0);
+            } else if (def.format[i] == 'x') {
+                event->appendHex(i == 0);
+            } else if (def.format[i] == 'f') {
+                event->appendFloat(i == 0);
+            } else if (def.format[i] == 'c') {
+                event->appendChar(i == 0);
+            } else if (def.format[i] == 's') {
+                event->appendString(i == 0);
+            }
+        }
+
+        m_traceCreators[registry->slot(def.id)].push_back(event);
+        m_creators.append(event);
+        m_creatorLayers.insert(LayerEvents, event);
+    }
 
     QVector<double> ticks; QVector<QString> ticklabels;
     ticks.append(0.5); ticklabels.append("Exec");
@@ -92,91 +110,15 @@ void ExecutionChartPlotCore::pixelsToCoords(const QPointF &pixelPos, double &key
     QCPAbstractPlottable::pixelsToCoords(pixelPos, key, value);
 }
 
-void ExecutionChartPlotCore::readEventsFromPath(QString path)
-{
-    QDir dir(path);
-    QStringList flist = dir.entryList();
-
-    for (QStringList::iterator it = flist.begin(); it != flist.end(); ++it ) {
-        if ((*it != ".") && (*it != "..") && (it->right(4) == ".ini" ))
-            readEventsFromFile(path+"/"+*it);
-    }
-}
-
-void ExecutionChartPlotCore::readEventsFromFile(QString filename)
-{
-    QSettings settings(filename, QSettings::IniFormat);
-
-    QStringList ids = settings.childGroups();
-    QString id;
-
-    foreach (id, ids) {
-        settings.beginGroup(id);
-        bool ok;
-
-        unsigned int event_id = id.toUInt(&ok, 0); // C convention
-        if (!ok) {
-            settings.endGroup();
-            continue;
-        }
-
-        QVariant width = settings.value("width", 3);
-        unsigned int event_width = width.toString().toUInt(&ok, 0);
-        if (!ok) {
-            event_width = 3;
-        }
-
-        QVariant color = settings.value("color", 0);
-        unsigned int event_color = color.toString().toUInt(&ok, 0);
-        if (!ok) {
-            event_color = 0;
-        }
-
-        QVariant text = settings.value("text", "");
-        QString event_text = text.toString();
-
-        QString format = settings.value("format", "").toString();
-
-        ExecutionChartEventCreator *event =
-                new ExecutionChartEventCreator(this, event_width, event_text, event_color);
-
-        if (format.length() == 0) {
-            event->appendEmpty();
-        }
-
-        for (int i = 0; i < format.length(); ++i) {
-            if (format[i] == 'u') {
-                event->appendDec(i == 0);
-            } else if (format[i] == 'd') {
-                event->appendDecSigned(i == 0);
-            } else if (format[i] == 'x') {
-                event->appendHex(i == 0);
-            } else if (format[i] == 'f') {
-                event->appendFloat(i == 0);
-            } else if (format[i] == 'c') {
-                event->appendChar(i == 0);
-            } else if (format[i] == 's') {
-                event->appendString(i == 0);
-            }
-        }
-
-        m_traceCreators[event_id].push_back(event);
-        m_creators.append(event);
-        m_creatorLayers.insert(LayerEvents, event);
-
-        settings.endGroup();
-    }
-
-}
-
 unsigned int ExecutionChartPlotCore::addSoftwareTrace(SoftwareTraceEvent *event)
 {
     unsigned int update_extend = 0;
     unsigned int tmp_extend;
-    uint16_t id = event->id;
-    if (m_traceCreators.find(id) != m_traceCreators.end()) {
+    int slot = ExecutionChartEventRegistry::instance()->slot(event->id);
+    if (slot >= 0) {
+        const QVector<ExecutionChartElementCreator*> &creators = m_traceCreators[slot];
         QVector<ExecutionChartElementCreator*>::const_iterator it;
-        for (it = m_traceCreators[id].begin(); it != m_traceCreators[id].end(); ++it) {
+        for (it = creators.begin(); it != creators.end(); ++it) {
             tmp_extend = (*it)->addTrace(event);
             if (tmp_extend > update_extend) {
                 update_extend = tmp_extend;
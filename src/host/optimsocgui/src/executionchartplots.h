@@ -58,8 +58,6 @@ class ExecutionChartPlotCore : public ExecutionChartPlot
 
 public:
     ExecutionChartPlotCore(QCPAxis *keyaxis, QCPAxis *valueaxis, QString corename);
-    void readEventsFromFile(QString filename);
-    void readEventsFromPath(QString path);
 
     virtual double selectTest(const QPointF &pos, bool onlySelectable, QVariant *details) const;
     virtual void draw(QCPPainter *painter);
@@ -85,7 +83,8 @@ private:
     QString m_corename;
     QList<ExecutionChartElementCreator*> m_creators;
     QMultiMap<enum LayerPosition, ExecutionChartElementCreator*> m_creatorLayers;
-    QMap<unsigned int,QVector<ExecutionChartElementCreator*> > m_traceCreators;
+    /** Creators per event, indexed by the registry slot of the event id */
+    QVector<QVector<ExecutionChartElementCreator*> > m_traceCreators;
 
     unsigned int m_currentExtend;
     ExecutionChartElementCreator *m_currentSelection;
@@ -0,0 +1,244 @@
+/* Copyright (c) 2026 by the author(s)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "executionchartregistry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QDateTime>
+#include <QTime>
+#include <QDesktopServices>
+#include <QProcessEnvironment>
+#include <QtDebug>
+
+/**
+ * Magic number and version of the binary event definition cache
+ */
+static const quint32 CACHE_MAGIC = 0x4f455644; // "OEVD"
+static const quint32 CACHE_VERSION = 1;
+
+ExecutionChartEventRegistry* ExecutionChartEventRegistry::s_instance = NULL;
+
+QDataStream &operator<<(QDataStream &out, const ExecutionChartEventDefinition &def)
+{
+    out << (quint16) def.id << (quint32) def.width << (quint32) def.color
+        << def.text << def.format;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, ExecutionChartEventDefinition &def)
+{
+    quint16 id;
+    quint32 width, color;
+    in >> id >> width >> color >> def.text >> def.format;
+    def.id = id;
+    def.width = width;
+    def.color = color;
+    return in;
+}
+
+ExecutionChartEventRegistry::ExecutionChartEventRegistry()
+    : m_slots(0x10000, -1), m_slotCount(0)
+{
+    // Events handled by ExecutionChartSectionCreator
+    m_sectionEventIds << 0x1 << 0x10 << 0x20 << 0x21 << 0x22 << 0x23
+                      << 0x24 << 0x25;
+
+    uint16_t id;
+    foreach (id, m_sectionEventIds) {
+        assignSlot(id);
+    }
+
+    QString path = QProcessEnvironment::systemEnvironment().value("OPTIMSOC");
+    path = path + "/src/sw/host/optimsocgui/events.d";
+
+    load(path);
+}
+
+/**
+ * Get the only instance of this class
+ *
+ * The event descriptions are read when the instance is first requested.
+ */
+ExecutionChartEventRegistry* ExecutionChartEventRegistry::instance()
+{
+    if (!s_instance) {
+        s_instance = new ExecutionChartEventRegistry();
+    }
+    return s_instance;
+}
+
+const QVector<uint16_t> &ExecutionChartEventRegistry::sectionEventIds() const
+{
+    return m_sectionEventIds;
+}
+
+const QVector<ExecutionChartEventDefinition> &ExecutionChartEventRegistry::definitions() const
+{
+    return m_definitions;
+}
+
+int ExecutionChartEventRegistry::assignSlot(uint16_t id)
+{
+    if (m_slots[id] < 0) {
+        m_slots[id] = m_slotCount++;
+    }
+    return m_slots[id];
+}
+
+/**
+ * Load all event descriptions in @p path
+ *
+ * The binary cache is used if it was created from the same set of files.
+ * Otherwise the .ini files are parsed and the cache is rewritten.
+ */
+void ExecutionChartEventRegistry::load(const QString &path)
+{
+    QTime timer;
+    timer.start();
+
+    QDir dir(path);
+    QFileInfoList files = dir.entryInfoList(QStringList("*.ini"), QDir::Files,
+                                            QDir::Name);
+
+    // The cache is valid as long as no description file was added, removed
+    // or modified.
+    QStringList fingerprint;
+    QFileInfo file;
+    foreach (file, files) {
+        fingerprint << QString("%1:%2:%3").arg(file.absoluteFilePath())
+                                          .arg(file.size())
+                                          .arg(file.lastModified().toTime_t());
+    }
+
+    QString cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    QString cacheFile = cacheDir + "/events.cache";
+
+    bool cached = readCache(cacheFile, fingerprint);
+    if (!cached) {
+        foreach (file, files) {
+            readEventsFromFile(file.absoluteFilePath());
+        }
+        if (!cacheDir.isEmpty() && QDir().mkpath(cacheDir)) {
+            writeCache(cacheFile, fingerprint);
+        }
+    }
+
+    ExecutionChartEventDefinition def;
+    foreach (def, m_definitions) {
+        assignSlot(def.id);
+    }
+
+    qDebug() << "Loaded" << m_definitions.size() << "event definitions"
+             << (cached ? QString("from cache") : "from " + path)
+             << "in" << timer.elapsed() << "ms";
+}
+
+bool ExecutionChartEventRegistry::readCache(const QString &cacheFile,
+                                            const QStringList &fingerprint)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_8);
+
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+
+    QStringList cachedFingerprint;
+    in >> cachedFingerprint;
+    if (cachedFingerprint != fingerprint) {
+        return false;
+    }
+
+    QVector<ExecutionChartEventDefinition> definitions;
+    in >> definitions;
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    m_definitions = definitions;
+    return true;
+}
+
+void ExecutionChartEventRegistry::writeCache(const QString &cacheFile,
+                                             const QStringList &fingerprint)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Unable to write event definition cache %s",
+                 cacheFile.toLatin1().data());
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << CACHE_MAGIC << CACHE_VERSION << fingerprint << m_definitions;
+}
+
+void ExecutionChartEventRegistry::readEventsFromFile(const QString &filename)
+{
+    QSettings settings(filename, QSettings::IniFormat);
+
+    QStringList ids = settings.childGroups();
+    QString id;
+
+    foreach (id, ids) {
+        settings.beginGroup(id);
+        bool ok;
+
+        ExecutionChartEventDefinition def;
+
+        unsigned int event_id = id.toUInt(&ok, 0); // C convention
+        if (!ok || event_id > 0xffff) {
+            settings.endGroup();
+            continue;
+        }
+        def.id = event_id;
+
+        QVariant width = settings.value("width", 3);
+        def.width = width.toString().toUInt(&ok, 0);
+        if (!ok) {
+            def.width = 3;
+        }
+
+        QVariant color = settings.value("color", 0);
+        def.color = color.toString().toUInt(&ok, 0);
+        if (!ok) {
+            def.color = 0;
+        }
+
+        def.text = settings.value("text", "").toString();
+        def.format = settings.value("format", "").toString();
+
+        m_definitions.append(def);
+
+        settings.endGroup();
+    }
+}
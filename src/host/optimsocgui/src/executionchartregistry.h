@@ -0,0 +1,89 @@
+/* Copyright (c) 2026 by the author(s)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EXECUTIONCHARTREGISTRY_H
+#define EXECUTIONCHARTREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QDataStream>
+
+#include <inttypes.h>
+
+/**
+ * Definition of a software trace event as read from an events.d file
+ */
+struct ExecutionChartEventDefinition {
+    uint16_t     id;
+    unsigned int width;
+    unsigned int color;
+    QString      text;
+    QString      format;
+};
+
+QDataStream &operator<<(QDataStream &out, const ExecutionChartEventDefinition &def);
+QDataStream &operator>>(QDataStream &in, ExecutionChartEventDefinition &def);
+
+/**
+ * Registry of all known software trace events
+ *
+ * The event description files in events.d are parsed only once for all
+ * execution chart plots. The parsed definitions are stored in a binary cache
+ * file, which is used as long as the description files are unchanged.
+ *
+ * Each event id which is handled by the execution chart is mapped to a dense
+ * slot number, which the plots use to index their creator tables.
+ */
+class ExecutionChartEventRegistry
+{
+public:
+    static ExecutionChartEventRegistry* instance();
+
+    /**
+     * Get the dense slot of an event id
+     *
+     * @return the slot number, or -1 if the event is not handled
+     */
+    inline int slot(uint16_t id) const { return m_slots[id]; }
+    inline int slotCount() const { return m_slotCount; }
+
+    const QVector<uint16_t> &sectionEventIds() const;
+    const QVector<ExecutionChartEventDefinition> &definitions() const;
+
+private:
+    ExecutionChartEventRegistry();
+
+    void load(const QString &path);
+    bool readCache(const QString &cacheFile, const QStringList &fingerprint);
+    void writeCache(const QString &cacheFile, const QStringList &fingerprint);
+    void readEventsFromFile(const QString &filename);
+    int assignSlot(uint16_t id);
+
+    static ExecutionChartEventRegistry* s_instance;
+
+    QVector<uint16_t> m_sectionEventIds;
+    QVector<ExecutionChartEventDefinition> m_definitions;
+    QVector<int> m_slots;
+    int m_slotCount;
+};
+
+#endif // EXECUTIONCHARTREGISTRY_H
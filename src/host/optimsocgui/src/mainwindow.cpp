@@ -26,13 +26,17 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <QComboBox>
 #include <QDebug>
+#include <QFileDialog>
 #include <QLabel>
 #include <QSettings>
+#include <QSlider>
 #include <QStandardItemModel>
 
 #include "aboutdialog.h"
 #include "optimsocsystemfactory.h"
+#include "tracereplay.h"
 
 #include "plotspectrogram.h"
 
@@ -41,7 +45,8 @@ MainWindow::MainWindow(QWidget *parent) :
     m_ui(new Ui::MainWindow),
     m_statusBarConnectionStat(new QLabel),
     m_statusBarSystemStat(new QLabel),
-    m_sysif(SystemInterface::instance())
+    m_sysif(SystemInterface::instance()),
+    m_traceReplay(new TraceReplay(this))
 {
     // init UI
     m_ui->setupUi(this);
@@ -70,6 +75,34 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(m_ui->actionResetSystem, SIGNAL(triggered()),
             m_sysif, SLOT(resetSystem()));
 
+    // offline trace replay
+    m_replayPosition = new QSlider(Qt::Horizontal, this);
+    m_replayPosition->setRange(0, 1000);
+    m_replayPosition->setMinimumWidth(200);
+    m_ui->replayToolBar->addWidget(m_replayPosition);
+
+    m_replaySpeed = new QComboBox(this);
+    m_replaySpeed->addItem("1x", 1.0);
+    m_replaySpeed->addItem("10x", 10.0);
+    m_replaySpeed->addItem("100x", 100.0);
+    m_replaySpeed->addItem("1000x", 1000.0);
+    m_ui->replayToolBar->addWidget(m_replaySpeed);
+
+    connect(m_ui->actionOpenTrace, SIGNAL(triggered()),
+            this, SLOT(openTrace()));
+    connect(m_ui->actionReplayPlay, SIGNAL(triggered()),
+            this, SLOT(playTrace()));
+    connect(m_ui->actionReplayPause, SIGNAL(triggered()),
+            this, SLOT(pauseTrace()));
+    connect(m_replayPosition, SIGNAL(sliderReleased()),
+            this, SLOT(seekTrace()));
+    connect(m_replaySpeed, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(setTraceReplaySpeed(int)));
+    connect(m_traceReplay, SIGNAL(positionChanged(timestamp_t)),
+            this, SLOT(showTraceReplayPosition(timestamp_t)));
+    connect(m_traceReplay, SIGNAL(finished()),
+            this, SLOT(pauseTrace()));
+
     connect(m_ui->btnToggleLogViewer, SIGNAL(toggled(bool)),
             this, SLOT(toggleLogViewer(bool)));
     connect(m_ui->logViewer, SIGNAL(unseenLogMsgs(uint,uint)),
@@ -81,6 +114,9 @@ MainWindow::MainWindow(QWidget *parent) :
 
     readSettings();
 
+    // the replay controls are only shown after a trace has been opened
+    m_ui->replayToolBar->hide();
+
     // ensure initial state
     updateUnseenLogMsgsInButton(0, 0);
 }
@@ -303,3 +339,69 @@ void MainWindow::updateUnseenLogMsgsInButton(unsigned int m_unseenInfo,
     }
     m_ui->btnToggleLogViewer->setText(label);
 }
+
+/**
+ * Open a recorded software trace for offline replay
+ */
+void MainWindow::openTrace()
+{
+    QString filename = QFileDialog::getOpenFileName(this,
+                                                    tr("Open software trace"),
+                                                    QString(),
+                                                    tr("All Files (*)"));
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    if (!m_traceReplay->open(filename)) {
+        return;
+    }
+
+    m_ui->replayToolBar->setVisible(true);
+    m_ui->taskTabWidget->setTabEnabled(2, true);
+    m_ui->taskTabWidget->setCurrentIndex(2);
+    pauseTrace();
+}
+
+void MainWindow::playTrace()
+{
+    m_traceReplay->play();
+    m_ui->actionReplayPlay->setEnabled(false);
+    m_ui->actionReplayPause->setEnabled(true);
+}
+
+void MainWindow::pauseTrace()
+{
+    m_traceReplay->pause();
+    m_ui->actionReplayPlay->setEnabled(true);
+    m_ui->actionReplayPause->setEnabled(false);
+}
+
+/**
+ * Continue the replay at the position selected with the slider
+ */
+void MainWindow::seekTrace()
+{
+    timestamp_t first = m_traceReplay->firstTimestamp();
+    timestamp_t last = m_traceReplay->lastTimestamp();
+    double fraction = m_replayPosition->value() / 1000.0;
+    m_traceReplay->seek(first + (last - first) * fraction);
+}
+
+void MainWindow::setTraceReplaySpeed(int index)
+{
+    m_traceReplay->setSpeed(m_replaySpeed->itemData(index).toDouble());
+}
+
+void MainWindow::showTraceReplayPosition(timestamp_t timestamp)
+{
+    if (m_replayPosition->isSliderDown()) {
+        return;
+    }
+
+    timestamp_t first = m_traceReplay->firstTimestamp();
+    timestamp_t last = m_traceReplay->lastTimestamp();
+    if (last > first) {
+        m_replayPosition->setValue((timestamp - first) * 1000.0 / (last - first));
+    }
+}
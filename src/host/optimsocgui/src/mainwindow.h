@@ -30,7 +30,10 @@
 
 #include "systeminterface.h"
 
+class QComboBox;
 class QLabel;
+class QSlider;
+class TraceReplay;
 
 namespace Ui {
 class MainWindow;
@@ -54,6 +57,10 @@ private:
     QLabel *m_statusBarConnectionStat;
     QLabel *m_statusBarSystemStat;
 
+    TraceReplay *m_traceReplay;
+    QSlider *m_replayPosition;
+    QComboBox *m_replaySpeed;
+
     void readSettings();
     void writeSettings();
 
@@ -66,6 +73,14 @@ public slots:
     void toggleLogViewer(bool showLogViewer);
     void updateUnseenLogMsgsInButton(unsigned int m_unseenInfo,
                                      unsigned int m_unseenImportant);
+
+private slots:
+    void openTrace();
+    void playTrace();
+    void pauseTrace();
+    void seekTrace();
+    void setTraceReplaySpeed(int index);
+    void showTraceReplayPosition(timestamp_t timestamp);
 };
 
 #endif // MAINWINDOW_H
@@ -72,6 +72,16 @@ unsigned int Memory::size()
     return m_byteSize;
 }
 
+/**
+ * Get the identifier of this memory as used by liboptimsochost
+ *
+ * @return memory identifier
+ */
+unsigned int Memory::memoryId()
+{
+    return m_memoryId;
+}
+
 /**
  * Initialize this memory
  *
@@ -39,6 +39,7 @@ public:
                     OptimsocSystemElement *parent);
     virtual ~Memory();
     unsigned int size();
+    unsigned int memoryId();
     void write(QByteArray data, unsigned int baseAddress = 0);
     QMenu* contextMenu();
     void showWriteMemoryDialog();
@@ -25,10 +25,10 @@
 #include "memoryinteractionwidget.h"
 #include "ui_memoryinteractionwidget.h"
 
-#include <QByteArray>
 #include <QDebug>
 #include <QFileDialog>
 #include <QList>
+#include <QStringList>
 #include <QSettings>
 #include <QTimer>
 
@@ -56,8 +56,19 @@ MemoryInteractionWidget::MemoryInteractionWidget(QWidget *parent) :
             SLOT(populateMemoryList()));
     connect(m_ui->btnWriteMemory, SIGNAL(clicked()),
             this, SLOT(writeMemory()));
+    connect(m_ui->btnCancelWrite, SIGNAL(clicked()),
+            this, SLOT(cancelWriteMemory()));
+    connect(m_sysif,
+            SIGNAL(memoryWriteProgress(unsigned int, qint64, qint64, qint64)),
+            this,
+            SLOT(memoryWriteProgress(unsigned int, qint64, qint64, qint64)));
+    connect(m_sysif, SIGNAL(memoryWriteFinished(unsigned int, bool)),
+            this, SLOT(memoryWriteFinished(unsigned int, bool)));
+    connect(m_sysif, SIGNAL(fileWriteFinished(bool, bool, quint32)),
+            this, SLOT(fileWriteFinished(bool, bool, quint32)));
 
     m_ui->lblMessages->clear();
+    m_ui->btnCancelWrite->setEnabled(false);
 
     readSettings();
 
@@ -147,44 +158,53 @@ void MemoryInteractionWidget::populateMemoryList()
 /**
  * Write the file to all selected memory tiles
  *
- * @see writeNextMemory()
+ * The file is streamed to all memories at once by the system interface.
+ * Progress and results are reported through memoryWriteProgress(),
+ * memoryWriteFinished() and fileWriteFinished().
  */
 void MemoryInteractionWidget::writeMemory()
 {
     if (m_memmodel->selectedMemories().count() == 0) {
         return;
     }
-    disableUiForUpload(true);
-
 
-    m_writeCurrentBaseAddress = m_ui->sbStartAddress->value();
-    m_writeCurrentSelectedMemories = m_memmodel->selectedMemories();
-
-    // write data from file
-    QFile file(m_ui->editMemoryFile->text());
-    if (!file.open(QIODevice::ReadOnly)) {
+    QFileInfo fileinfo(m_ui->editMemoryFile->text());
+    if (!fileinfo.isReadable()) {
         m_ui->lblMessages->setText("<font color=red>Unable to open memory "
                                    "file!</font>");
-        disableUiForUpload(false);
         return;
     }
-    QByteArray data = file.readAll();
-    if (data.isEmpty()) {
+    if (fileinfo.size() == 0) {
         m_ui->lblMessages->setText("<font color=red>Unable to read data from "
                                    "file!</font>");
-        disableUiForUpload(false);
         return;
     }
-    m_writeCurrentData = data;
-
-    // write to first selected memory
-    Memory* mem = m_writeCurrentSelectedMemories.at(0);
-    connect(mem, SIGNAL(writeFinished(bool)),
-            this, SLOT(writeNextMemory(bool)));
-    m_writeCurrentMemoryIdx = 0;
-    QString msg = QString("Writing to %1 ...").arg(mem->name());
-    m_ui->lblMessages->setText(msg);
-    mem->write(m_writeCurrentData, m_writeCurrentBaseAddress);
+
+    disableUiForUpload(true);
+
+    m_writeMemories.clear();
+    m_writeStatus.clear();
+
+    QList<unsigned int> memoryIds;
+    Memory* mem;
+    foreach (mem, m_memmodel->selectedMemories()) {
+        memoryIds.append(mem->memoryId());
+        m_writeMemories.insert(mem->memoryId(), mem);
+        m_writeStatus.insert(mem->memoryId(), "waiting");
+    }
+    showWriteStatus();
+
+    m_sysif->writeFileToMemories(memoryIds, fileinfo.absoluteFilePath(),
+                                 m_ui->sbStartAddress->value());
+}
+
+/**
+ * Abort the currently running memory write
+ */
+void MemoryInteractionWidget::cancelWriteMemory()
+{
+    m_ui->btnCancelWrite->setEnabled(false);
+    m_sysif->cancelMemoryWrite();
 }
 
 /**
@@ -199,55 +219,92 @@ void MemoryInteractionWidget::disableUiForUpload(bool disable)
     m_ui->editMemoryFile->setEnabled(!disable);
     m_ui->sbStartAddress->setEnabled(!disable);
     m_ui->btnWriteMemory->setEnabled(!disable);
+    m_ui->btnCancelWrite->setEnabled(disable);
 }
 
 /**
- * Write to the next selected memory
- *
- * This method is called in reaction to a writeFinished() signal from the the
- * previously written memory. The result status is checked and the next memory
- * in the selected list is written (if any).
- *
- * @see writeMemory()
- *
- * @param prevSuccessful was the previous memory write successful?
+ * Show the write status of all memories in the message label
  */
-void MemoryInteractionWidget::writeNextMemory(bool prevSuccessful)
+void MemoryInteractionWidget::showWriteStatus()
 {
-    disconnect(m_writeCurrentSelectedMemories.at(m_writeCurrentMemoryIdx),
-               SIGNAL(writeFinished(bool)),
-               this,
-               SLOT(writeNextMemory(bool)));
-
-    if (!prevSuccessful) {
-        QString msg = QString("<font color=red>Unable to write to %1.</font>")
-                        .arg(m_writeCurrentSelectedMemories.at(m_writeCurrentMemoryIdx)->name());
-        m_ui->lblMessages->setText(msg);
-        disableUiForUpload(false);
+    QStringList lines;
+    QMap<unsigned int, QString>::const_iterator it;
+    for (it = m_writeStatus.constBegin(); it != m_writeStatus.constEnd(); ++it) {
+        lines << QString("%1: %2").arg(m_writeMemories.value(it.key())->name())
+                                  .arg(it.value());
+    }
+    m_ui->lblMessages->setText(lines.join("<br>"));
+}
+
+/**
+ * Update the progress and throughput display of a memory
+ */
+void MemoryInteractionWidget::memoryWriteProgress(unsigned int memoryId,
+                                                  qint64 bytesWritten,
+                                                  qint64 bytesTotal,
+                                                  qint64 elapsedMs)
+{
+    if (!m_writeStatus.contains(memoryId)) {
         return;
     }
 
-    if (m_writeCurrentMemoryIdx == m_writeCurrentSelectedMemories.count() - 1) {
-        // all memories have been written, we're done!
-        m_writeCurrentMemoryIdx = 0;
-        m_writeCurrentSelectedMemories.clear();
-        m_writeCurrentData.clear();
-        m_writeCurrentBaseAddress = 0;
+    QString throughput;
+    if (elapsedMs > 0) {
+        throughput = QString(" (%1/s)")
+                .arg(Util::formatBytesHumanReadable(bytesWritten * 1000 / elapsedMs));
+    }
+
+    m_writeStatus[memoryId] = QString::number(bytesWritten * 100 / bytesTotal)
+                              + "%" + throughput;
+    showWriteStatus();
+}
 
-        m_ui->lblMessages->setText("<font color=green>All memories have "
-                                   "successfully been written.</font>");
-        QTimer::singleShot(5000, this, SLOT(clearMessageLabel()));
-        disableUiForUpload(false);
+void MemoryInteractionWidget::memoryWriteFinished(unsigned int memoryId,
+                                                  bool success)
+{
+    if (!m_writeStatus.contains(memoryId)) {
+        return;
+    }
+
+    if (success) {
+        m_writeStatus[memoryId] = "<font color=green>done</font>";
+    } else {
+        m_writeStatus[memoryId] = "<font color=red>failed</font>";
+    }
+    showWriteStatus();
+}
+
+/**
+ * All memories have been written (or the write was aborted)
+ *
+ * @param success  all memories have been written successfully
+ * @param canceled the write was canceled by the user
+ * @param checksum CRC-32 checksum of the written data
+ */
+void MemoryInteractionWidget::fileWriteFinished(bool success, bool canceled,
+                                                quint32 checksum)
+{
+    if (m_writeMemories.isEmpty()) {
         return;
     }
 
-    // write to next selected memory
-    Memory* mem = m_writeCurrentSelectedMemories.at(++m_writeCurrentMemoryIdx);
-    connect(mem, SIGNAL(writeFinished(bool)),
-            this, SLOT(writeNextMemory(bool)));
-    QString msg = QString("Writing to %1 ...").arg(mem->name());
+    showWriteStatus();
+    QString msg = m_ui->lblMessages->text() + "<br>";
+    if (canceled) {
+        msg += "<font color=red>Memory write canceled.</font>";
+    } else if (!success) {
+        msg += "<font color=red>Unable to write to all memories.</font>";
+    } else {
+        msg += QString("<font color=green>All memories have successfully been "
+                       "written (CRC-32 0x%1).</font>")
+                .arg(checksum, 8, 16, QLatin1Char('0'));
+        QTimer::singleShot(5000, this, SLOT(clearMessageLabel()));
+    }
     m_ui->lblMessages->setText(msg);
-    mem->write(m_writeCurrentData, m_writeCurrentBaseAddress);
+
+    m_writeMemories.clear();
+    m_writeStatus.clear();
+    disableUiForUpload(false);
 }
 
 void MemoryInteractionWidget::clearMessageLabel()
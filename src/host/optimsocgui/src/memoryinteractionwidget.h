@@ -25,9 +25,9 @@
 #ifndef MEMORYINTERACTIONWIDGET_H
 #define MEMORYINTERACTIONWIDGET_H
 
+#include <QMap>
 #include <QWidget>
 
-class QByteArray;
 class Memory;
 class MemoryTableModel;
 class SystemInterface;
@@ -49,21 +49,24 @@ private:
     SystemInterface *m_sysif;
     MemoryTableModel *m_memmodel;
 
-    QList<Memory*> m_writeCurrentSelectedMemories;
-    int m_writeCurrentMemoryIdx;
-    int m_writeCurrentBaseAddress;
-    QByteArray m_writeCurrentData;
+    QMap<unsigned int, Memory*> m_writeMemories;
+    QMap<unsigned int, QString> m_writeStatus;
 
     void writeSettings();
     void readSettings();
     void disableUiForUpload(bool disable = true);
+    void showWriteStatus();
 
 private slots:
     void showFileDialog();
     void recalculateFileSize();
     void populateMemoryList();
     void writeMemory();
-    void writeNextMemory(bool prevSuccessful);
+    void cancelWriteMemory();
+    void memoryWriteProgress(unsigned int memoryId, qint64 bytesWritten,
+                             qint64 bytesTotal, qint64 elapsedMs);
+    void memoryWriteFinished(unsigned int memoryId, bool success);
+    void fileWriteFinished(bool success, bool canceled, quint32 checksum);
     void clearMessageLabel();
 
 };
@@ -54,7 +54,28 @@ OptimsocSystem::OptimsocSystem(QString xmlDescFile, QObject *parent) :
     QObject(parent),
     m_noc(0)
 {
-    parseXmlDescription(xmlDescFile);
+    QByteArray genericDescription = generateGenericDescription(xmlDescFile);
+    if (!genericDescription.isEmpty()) {
+        parseGenericDescription(genericDescription, xmlDescFile);
+    }
+}
+
+/**
+ * Constructor: Create a new instance from an already converted description
+ *
+ * @param genericDescription the generic system description, as returned by
+ *                           generateGenericDescription()
+ * @param xmlDescFile        the XML file the description was generated from
+ * @param parent
+ *
+ * @see OptimsocSystemFactory::createSystemFromIdAsync()
+ */
+OptimsocSystem::OptimsocSystem(QByteArray genericDescription,
+                               QString xmlDescFile, QObject *parent) :
+    QObject(parent),
+    m_noc(0)
+{
+    parseGenericDescription(genericDescription, xmlDescFile);
 }
 
 OptimsocSystem::~OptimsocSystem()
@@ -66,10 +87,7 @@ OptimsocSystem::~OptimsocSystem()
 }
 
 /**
- * Parse the XML system description file and initialize this object with it
- *
- * A couple things are done in order to extract the correct system description
- * out of the XML file:
+ * Validate and convert a XML system description file
  *
  * -# The input XML file @p xmlDescFile is validated against the XML Schema
  *    for the OpTiMSoC System Description XML, optimsoc-sysdesc.xsd
@@ -78,30 +96,27 @@ OptimsocSystem::~OptimsocSystem()
  *    e.g. genericnoc.
  *    At the same time the graphic showing the system is auto-generated if
  *    requested by the author (layout/\@autogen = 'true').
- * -# The SVG system overview graphic is extracted and the SystemOverviewWidget
- *    is initialized with it.
- * -# Information about the system, e.g. the tile configuration, etc. is
- *    extracted.
+ *
+ * This function does not touch any GUI object and can be run in a worker
+ * thread. It is by far the most expensive step of loading a system.
  *
  * @param xmlDescFile the file name of the input XML file
- * @return parsing successful?
+ * @return the generic system description, or an empty array on failure
  */
-bool OptimsocSystem::parseXmlDescription(QString xmlDescFile)
+QByteArray OptimsocSystem::generateGenericDescription(QString xmlDescFile)
 {
-    QDomDocument doc;
-
     // get the system description directory (it contains the XSLT and
     // XML Schema files)
     QString systemDescriptionsDir = OptimsocSystemFactory::getSysdescDir();
     if (systemDescriptionsDir.isNull()) {
         qWarning("No system description directory found. Unable to create system.");
-        return false;
+        return QByteArray();
     }
 
     // check if the XML file exists
     if (!QFile::exists(xmlDescFile)) {
         qWarning() << "The XML system description file '" << xmlDescFile << "' does not exist.";
-        return false;
+        return QByteArray();
     }
 
     // validate the system description XML against the XML Schema
@@ -113,13 +128,13 @@ bool OptimsocSystem::parseXmlDescription(QString xmlDescFile)
     schema.load(QUrl::fromLocalFile(schemaFile));
     if (!schema.isValid()) {
         qWarning() << "The XML Schema " << schemaFile << "is not valid";
-        return false;
+        return QByteArray();
     }
     QXmlSchemaValidator schemaValidator(schema);
     if (!schemaValidator.validate(QUrl::fromLocalFile(xmlDescFile))) {
         qWarning() << "The instance " << xmlDescFile << " does not validate "
                    << "against the schema " << schemaFile;
-        return false;
+        return QByteArray();
     }
 
     // convert the input XML file to a generic system description
@@ -131,13 +146,35 @@ bool OptimsocSystem::parseXmlDescription(QString xmlDescFile)
     XsltProc xsltproc(xmlDescFile, genericXslt);
     if (!xsltproc.transform()) {
         qWarning("Unable to convert input XML to generic description");
-        return false;
+        return QByteArray();
     }
 
+    // XsltProc only references its output, make a deep copy which outlives it
+    QByteArray output = xsltproc.outputDocument();
+    return QByteArray(output.constData(), output.size());
+}
+
+/**
+ * Initialize this object from a generic system description
+ *
+ * -# The SVG system overview graphic is extracted and the SystemOverviewWidget
+ *    is initialized with it.
+ * -# Information about the system, e.g. the tile configuration, etc. is
+ *    extracted.
+ *
+ * @param genericDescription the generic system description
+ * @param xmlDescFile        the input XML file, used to resolve relative paths
+ * @return parsing successful?
+ */
+bool OptimsocSystem::parseGenericDescription(QByteArray genericDescription,
+                                             QString xmlDescFile)
+{
+    QDomDocument doc;
+
     // read generic description into DOM
     QString errorMsg;
     int errorLine, errorColumn;
-    if (!doc.setContent(xsltproc.outputDocument(), true, &errorMsg, &errorLine,
+    if (!doc.setContent(genericDescription, true, &errorMsg, &errorLine,
                         &errorColumn)) {
         qWarning("Unable to put XML system description into DOM: "
                  "%s in line %d, column %d.", errorMsg.toLatin1().data(),
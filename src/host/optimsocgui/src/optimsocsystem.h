@@ -44,8 +44,12 @@ public:
     static const QString SYSDESC_NS;
 
     explicit OptimsocSystem(QString xmlDescFile, QObject *parent = 0);
+    OptimsocSystem(QByteArray genericDescription, QString xmlDescFile,
+                   QObject *parent = 0);
     virtual ~OptimsocSystem();
 
+    static QByteArray generateGenericDescription(QString xmlDescFile);
+
     QList<OptimsocSystemElement*> tiles();
     QList<Memory*> memories();
     OptimsocSystemElement* elementById(const QString id);
@@ -61,7 +65,8 @@ private:
     QByteArray m_layoutSvg;
     Noc *m_noc;
 
-    bool parseXmlDescription(QString xmlDescFile);
+    bool parseGenericDescription(QByteArray genericDescription,
+                                 QString xmlDescFile);
     void appendMemoryChildrenToList(OptimsocSystemElement *element,
                                     QList<Memory*>& list);
 
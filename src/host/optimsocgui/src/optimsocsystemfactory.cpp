@@ -24,8 +24,15 @@
 
 #include "optimsocsystemfactory.h"
 
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QProcessEnvironment>
+#include <QStringList>
+#include <QtConcurrentRun>
 #include <QtDebug>
 
 #include "computetile.h"
@@ -41,6 +48,17 @@
 OptimsocSystem* OptimsocSystemFactory::s_currentSystem = NULL;
 OptimsocSystemFactory* OptimsocSystemFactory::s_instance = NULL;
 
+/**
+ * Generic system descriptions which have already been converted
+ */
+QHash<int, OptimsocSystemFactory::CachedDescription> OptimsocSystemFactory::s_descriptionCache;
+QMutex OptimsocSystemFactory::s_descriptionCacheMutex;
+
+/**
+ * libxml2 and libxslt keep global state, only convert one description at a time
+ */
+QMutex OptimsocSystemFactory::s_conversionMutex;
+
 OptimsocSystemFactory::OptimsocSystemFactory(QObject *parent) : QObject(parent)
 {
 }
@@ -63,9 +81,11 @@ OptimsocSystemFactory* OptimsocSystemFactory::instance()
 }
 
 /**
- * Create a OptimsocSystem object for a system with the given @p systemId
+ * Get the system description XML file for the system with the ID @p systemId
+ *
+ * @return the file name, or a null string if no description is available
  */
-OptimsocSystem* OptimsocSystemFactory::createSystemFromId(int systemId)
+QString OptimsocSystemFactory::sysDescFileForId(int systemId)
 {
     QString systemDescriptionsDir = OptimsocSystemFactory::getSysdescDir();
 
@@ -77,10 +97,201 @@ OptimsocSystem* OptimsocSystemFactory::createSystemFromId(int systemId)
         qWarning("No system description available for ID 0x%04x. The XML "
                  "description file %s could not be read.", systemId,
                  sysDescFile.toLatin1().data());
+        return QString();
+    }
+
+    return sysDescFile;
+}
+
+/**
+ * Create a OptimsocSystem object for a system with the given @p systemId
+ *
+ * The system description is converted synchronously if it is not cached.
+ *
+ * @see createSystemFromIdAsync()
+ */
+OptimsocSystem* OptimsocSystemFactory::createSystemFromId(int systemId)
+{
+    QString sysDescFile = sysDescFileForId(systemId);
+    if (sysDescFile.isNull()) {
         return NULL;
     }
 
-    return new OptimsocSystem(sysDescFile);
+    QByteArray sourceHash = hashSysDesc(sysDescFile);
+    QByteArray genericDescription = cachedGenericDescription(systemId, sourceHash);
+    if (genericDescription.isEmpty()) {
+        QMutexLocker locker(&s_conversionMutex);
+        genericDescription = OptimsocSystem::generateGenericDescription(sysDescFile);
+        if (genericDescription.isEmpty()) {
+            return NULL;
+        }
+        storeGenericDescription(systemId, sourceHash, genericDescription);
+    }
+
+    return new OptimsocSystem(genericDescription, sysDescFile);
+}
+
+/**
+ * Create a OptimsocSystem object for a system without blocking the GUI
+ *
+ * Validating and converting the system description (XML Schema and XSLT) is
+ * done in a worker thread. The result is cached by the system ID and a hash of
+ * the description file, both in memory and on disk, so reconnecting to a
+ * known system does not need to convert the description again.
+ *
+ * The new system is delivered through the systemCreated() signal.
+ */
+void OptimsocSystemFactory::createSystemFromIdAsync(int systemId)
+{
+    QString sysDescFile = sysDescFileForId(systemId);
+    if (sysDescFile.isNull()) {
+        emit instance()->systemCreated(systemId, NULL);
+        return;
+    }
+
+    QtConcurrent::run(&OptimsocSystemFactory::loadGenericDescription,
+                      systemId, sysDescFile);
+}
+
+/**
+ * Get the generic description for a system (worker thread)
+ *
+ * The generic description is taken from the cache if the hash of the source
+ * still matches, otherwise it is generated and stored in the cache.
+ */
+void OptimsocSystemFactory::loadGenericDescription(int systemId,
+                                                   QString sysDescFile)
+{
+    QByteArray sourceHash = hashSysDesc(sysDescFile);
+    QByteArray genericDescription = cachedGenericDescription(systemId, sourceHash);
+    if (genericDescription.isEmpty()) {
+        QMutexLocker locker(&s_conversionMutex);
+        genericDescription = OptimsocSystem::generateGenericDescription(sysDescFile);
+        if (!genericDescription.isEmpty()) {
+            storeGenericDescription(systemId, sourceHash, genericDescription);
+        }
+    }
+
+    // continue in the GUI thread, the system objects must be created there
+    QMetaObject::invokeMethod(instance(), "genericDescriptionReady",
+                              Qt::QueuedConnection,
+                              Q_ARG(int, systemId),
+                              Q_ARG(QString, sysDescFile),
+                              Q_ARG(QByteArray, genericDescription));
+}
+
+void OptimsocSystemFactory::genericDescriptionReady(int systemId,
+                                                    QString sysDescFile,
+                                                    QByteArray genericDescription)
+{
+    OptimsocSystem *system = NULL;
+    if (!genericDescription.isEmpty()) {
+        system = new OptimsocSystem(genericDescription, sysDescFile);
+    }
+    emit systemCreated(systemId, system);
+}
+
+/**
+ * Hash the system description file together with the stylesheets
+ *
+ * A changed hash invalidates the cached generic description.
+ */
+QByteArray OptimsocSystemFactory::hashSysDesc(QString sysDescFile)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    QStringList files;
+    files << sysDescFile
+          << QString("%1/util/optimsoc-system.xsd").arg(getSysdescDir())
+          << QString("%1/util/convert-to-generic.xsl").arg(getSysdescDir())
+          << QString("%1/util/mesh-to-svg.xsl").arg(getSysdescDir());
+
+    foreach (QString fileName, files) {
+        QFile file(fileName);
+        if (file.open(QIODevice::ReadOnly)) {
+            hash.addData(file.readAll());
+        }
+    }
+
+    return hash.result();
+}
+
+QString OptimsocSystemFactory::cacheFileForId(int systemId)
+{
+    QString cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    if (cacheDir.isEmpty()) {
+        return QString();
+    }
+
+    return QString("%1/sysdesc/%2.cache").arg(cacheDir)
+                                         .arg(systemId, 4, 16, QLatin1Char('0'));
+}
+
+/**
+ * Look up a generic description in the memory and disk cache
+ *
+ * @return the generic description, or an empty array if it is not cached
+ */
+QByteArray OptimsocSystemFactory::cachedGenericDescription(int systemId,
+                                                           const QByteArray &sourceHash)
+{
+    QMutexLocker locker(&s_descriptionCacheMutex);
+
+    if (s_descriptionCache.contains(systemId)) {
+        const CachedDescription &cached = s_descriptionCache[systemId];
+        if (cached.sourceHash == sourceHash) {
+            return cached.genericDescription;
+        }
+    }
+
+    QString cacheFile = cacheFileForId(systemId);
+    if (cacheFile.isNull()) {
+        return QByteArray();
+    }
+
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_8);
+    CachedDescription cached;
+    in >> cached.sourceHash >> cached.genericDescription;
+    if (in.status() != QDataStream::Ok || cached.sourceHash != sourceHash) {
+        return QByteArray();
+    }
+
+    s_descriptionCache.insert(systemId, cached);
+    return cached.genericDescription;
+}
+
+void OptimsocSystemFactory::storeGenericDescription(int systemId,
+                                                    const QByteArray &sourceHash,
+                                                    const QByteArray &genericDescription)
+{
+    QMutexLocker locker(&s_descriptionCacheMutex);
+
+    CachedDescription cached;
+    cached.sourceHash = sourceHash;
+    cached.genericDescription = genericDescription;
+    s_descriptionCache.insert(systemId, cached);
+
+    QString cacheFile = cacheFileForId(systemId);
+    if (cacheFile.isNull() || !QDir().mkpath(QFileInfo(cacheFile).path())) {
+        return;
+    }
+
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Unable to write system description cache %s",
+                 cacheFile.toLatin1().data());
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_8);
+    out << sourceHash << genericDescription;
 }
 
 /**
@@ -26,6 +26,9 @@
 #define OPTIMSOCSYSTEMFACTORY_H
 
 #include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
 
 #include "optimsocsystem.h"
 
@@ -36,6 +39,7 @@ public:
     static OptimsocSystemFactory* instance();
 
     static OptimsocSystem* createSystemFromId(int systemId);
+    static void createSystemFromIdAsync(int systemId);
     static void setCurrentSystem(OptimsocSystem *system);
     static OptimsocSystem* currentSystem();
     static QString getSysdescDir();
@@ -52,13 +56,48 @@ signals:
      */
     void currentSystemChanged(OptimsocSystem* oldSystem, OptimsocSystem *newSystem);
 
+    /**
+     * A system requested with createSystemFromIdAsync() is ready
+     *
+     * @param systemId the requested system ID
+     * @param system   the new system, or NULL if it could not be created. The
+     *                 receiver takes ownership of the object.
+     */
+    void systemCreated(int systemId, OptimsocSystem *system);
+
 public slots:
 
+private slots:
+    void genericDescriptionReady(int systemId, QString sysDescFile,
+                                 QByteArray genericDescription);
+
 private:
     OptimsocSystemFactory(QObject *parent = 0);
     static OptimsocSystem* s_currentSystem;
     static OptimsocSystemFactory* s_instance;
 
+    /**
+     * A converted system description, identified by a hash of its source
+     */
+    struct CachedDescription {
+        QByteArray sourceHash;
+        QByteArray genericDescription;
+    };
+
+    static QString sysDescFileForId(int systemId);
+    static QString cacheFileForId(int systemId);
+    static QByteArray hashSysDesc(QString sysDescFile);
+    static QByteArray cachedGenericDescription(int systemId,
+                                               const QByteArray &sourceHash);
+    static void storeGenericDescription(int systemId,
+                                        const QByteArray &sourceHash,
+                                        const QByteArray &genericDescription);
+    static void loadGenericDescription(int systemId, QString sysDescFile);
+
+    static QHash<int, CachedDescription> s_descriptionCache;
+    static QMutex s_descriptionCacheMutex;
+    static QMutex s_conversionMutex;
+
 };
 
 #endif // OPTIMSOCSYSTEMFACTORY_H
@@ -56,6 +56,11 @@ SoftwareExecutionView::SoftwareExecutionView(QWidget *parent) :
             this,
             SLOT(addSoftwareTraceToModel(struct SoftwareTraceEvent)));
 
+    connect(m_sysif->softwareTraceEventDistributor(),
+            SIGNAL(softwareTraceReset(unsigned int)),
+            this,
+            SLOT(clearSoftwareTrace()));
+
     PlotSpectrogram *heatmap = new PlotSpectrogram(this);
     heatmap->hide();
 }
@@ -115,3 +120,13 @@ void SoftwareExecutionView::addSoftwareTraceToStdout(struct SoftwareTraceEvent e
         }
     }
 }
+
+/**
+ * Remove all collected software trace events and console output
+ */
+void SoftwareExecutionView::clearSoftwareTrace()
+{
+    m_swTraceModel->removeRows(0, m_swTraceModel->rowCount());
+    m_stdoutcollector.clear();
+    m_ui->stdoutTextEdit->clear();
+}
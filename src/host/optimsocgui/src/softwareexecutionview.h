@@ -55,6 +55,7 @@ private:
 private slots:
     void addSoftwareTraceToModel(struct SoftwareTraceEvent event);
     void addSoftwareTraceToStdout(struct SoftwareTraceEvent event);
+    void clearSoftwareTrace();
 };
 
 #endif // SOFTWAREEXECUTIONVIEW_H
@@ -35,6 +35,16 @@
 
 SystemInterface* SystemInterface::s_instance = 0;
 
+/**
+ * Weight of a new NoC router monitor sample in the decaying link utilization
+ */
+static const double NOC_LINK_UTILIZATION_WEIGHT = 0.25;
+
+/**
+ * Interval in which link utilization updates are passed on to the UI [ms]
+ */
+static const int NOC_LINK_UTILIZATION_INTERVAL = 100;
+
 /**
  * Constructor: setup object
  *
@@ -48,6 +58,7 @@ SystemInterface::SystemInterface(QObject *parent)
     qRegisterMetaType<SystemStatus>("SystemInterface::SystemStatus");
     qRegisterMetaType<SoftwareTraceEvent>("SoftwareTraceEvent");
     qRegisterMetaType<optimsoc_backend_id>("optimsoc_backend_id");
+    qRegisterMetaType<QList<unsigned int> >("QList<unsigned int>");
 
     // start worker thread
     m_worker = new SystemInterfaceWorker(&m_octx, m_octx_mutex);
@@ -110,6 +121,34 @@ void SystemInterface::softwareTraceCallback(uint32_t core_id,
     instance()->m_softwareTraceMutex.unlock();
 }
 
+/**
+ * Callback for NoC router monitor (NRM) samples
+ *
+ * This function is called from the receive thread of liboptimsochost. The
+ * samples are only accumulated into a decaying average per link here, the UI
+ * is updated in batches from nocLinkUtilizationTimer().
+ */
+void SystemInterface::nocRouterMonitorCallback(int router_id,
+                                               uint32_t timestamp,
+                                               uint8_t *link_flit_count,
+                                               int monitored_links)
+{
+    Q_UNUSED(timestamp);
+
+    SystemInterface *sysif = instance();
+    QMutexLocker locker(&sysif->m_nocLinkUtilizationMutex);
+
+    for (int link = 0; link < monitored_links; link++) {
+        QString key = QString("%1:%2").arg(router_id).arg(link);
+        double sample = link_flit_count[link] /
+                static_cast<double>(NRM_SAMPLE_INTERVAL);
+        double avg = sysif->m_nocLinkUtilization.value(key, 0.0);
+        avg += NOC_LINK_UTILIZATION_WEIGHT * (sample - avg);
+        sysif->m_nocLinkUtilization.insert(key, avg);
+        sysif->m_nocLinkUtilizationChanged.insert(key, avg);
+    }
+}
+
 void SystemInterface::logCallback(struct optimsoc_log_ctx *ctx,
                                   int priority, const char *file,
                                   int line, const char *fn,
@@ -261,6 +300,10 @@ void SystemInterface::connectToSystem()
     connect(&m_softwareTraceTimer, SIGNAL(timeout()),
             this, SLOT(softwareTraceTimer()));
     m_softwareTraceTimer.start(20);
+
+    connect(&m_nocLinkUtilizationTimer, SIGNAL(timeout()),
+            this, SLOT(nocLinkUtilizationTimer()));
+    m_nocLinkUtilizationTimer.start(NOC_LINK_UTILIZATION_INTERVAL);
 }
 
 /**
@@ -302,6 +345,48 @@ void SystemInterface::writeToMemory(unsigned int memoryId, QByteArray data,
                               Q_ARG(unsigned int, baseAddress));
 }
 
+/**
+ * Write a file to multiple memories
+ *
+ * The file is memory-mapped and streamed to all memories in @p memoryIds
+ * chunk by chunk, i.e. the file is only read once, independent of the number
+ * of memories. The progress of each memory is reported through the signal
+ * memoryWriteProgress(), the result for each memory through
+ * memoryWriteFinished(). After all memories have been written,
+ * fileWriteFinished() is emitted with the CRC-32 checksum of the written data.
+ *
+ * A running write can be aborted with cancelMemoryWrite().
+ *
+ * @param memoryIds
+ * @param filename
+ * @param baseAddress
+ */
+void SystemInterface::writeFileToMemories(QList<unsigned int> memoryIds,
+                                          QString filename,
+                                          unsigned int baseAddress)
+{
+    if (m_connectionStatus != Connected) {
+        qWarning("Not connected to system!");
+        return;
+    }
+
+    m_worker->m_memoryWriteCanceled = 0;
+    QMetaObject::invokeMethod(m_worker, "writeFileToMemories",
+                              Q_ARG(QList<unsigned int>, memoryIds),
+                              Q_ARG(QString, filename),
+                              Q_ARG(unsigned int, baseAddress));
+}
+
+/**
+ * Cancel a running writeFileToMemories() operation
+ *
+ * The write is stopped after the chunk which is currently being transferred.
+ */
+void SystemInterface::cancelMemoryWrite()
+{
+    m_worker->m_memoryWriteCanceled = 1;
+}
+
 /**
  * Reset the connected system
  */
@@ -377,6 +462,22 @@ void SystemInterface::softwareTraceTimer()
     m_softwareTraceMutex.unlock();
 }
 
+/**
+ * Pass all link utilization changes since the last call on to the UI
+ */
+void SystemInterface::nocLinkUtilizationTimer()
+{
+    QMap<QString, double> changed;
+
+    m_nocLinkUtilizationMutex.lock();
+    changed.swap(m_nocLinkUtilizationChanged);
+    m_nocLinkUtilizationMutex.unlock();
+
+    if (!changed.isEmpty()) {
+        emit nocLinkUtilizationChanged(changed);
+    }
+}
+
 void SystemInterface::emitLogMsgReceived(int priority, QString file,
                                            int line, QString fn, QString msg)
 {
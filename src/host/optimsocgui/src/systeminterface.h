@@ -31,6 +31,7 @@
 #include <QQueue>
 #include <QTimer>
 #include <QMutex>
+#include <QList>
 
 #include "traceevents.h"
 
@@ -69,12 +70,23 @@ public:
 
     static SystemInterface* instance();
 
+    /**
+     * Sample interval of the NoC router monitors [clock cycles]
+     *
+     * A link carries at most one flit per cycle and the flit counters are
+     * eight bit wide, so the counters cannot overflow in a sample.
+     */
+    static const int NRM_SAMPLE_INTERVAL = 255;
+
     // callbacks from liboptimsochost
     static void instrTraceCallback(struct optimsoc_ctx *incoming_ctx,
                                    int core_id, uint32_t timestamp,
                                    uint32_t pc, int count);
     static void softwareTraceCallback(uint32_t core_id, uint32_t timestamp,
                                       uint16_t id, uint32_t value);
+    static void nocRouterMonitorCallback(int router_id, uint32_t timestamp,
+                                         uint8_t *link_flit_count,
+                                         int monitored_links);
     static void logCallback(struct optimsoc_log_ctx *ctx,
                             int priority, const char *file,
                             int line, const char *fn,
@@ -91,11 +103,15 @@ public slots:
     void disconnectFromSystem();
     void writeToMemory(unsigned int memoryId, QByteArray data,
                        unsigned int baseAddress = 0);
+    void writeFileToMemories(QList<unsigned int> memoryIds, QString filename,
+                             unsigned int baseAddress = 0);
+    void cancelMemoryWrite();
     void resetSystem();
     void startCpus();
     void stallCpus();
 
     void softwareTraceTimer();
+    void nocLinkUtilizationTimer();
 
 signals:
     void connectionStatusChanged(SystemInterface::ConnectionStatus oldStatus,
@@ -104,12 +120,22 @@ signals:
                              SystemInterface:: SystemStatus newStatus);
     void systemDiscovered(int systemId);
     void memoryWriteFinished(unsigned int memoryId, bool success);
+    void memoryWriteProgress(unsigned int memoryId, qint64 bytesWritten,
+                             qint64 bytesTotal, qint64 elapsedMs);
+    void fileWriteFinished(bool success, bool canceled, quint32 checksum);
     void instructionTraceReceived(int core_id, unsigned int timestamp,
                                   unsigned int pc, int count);
     void softwareTraceReceived(unsigned int core_id, unsigned int timestamp,
                                unsigned int id, unsigned int value);
     void logMsgReceived(int priority, QString file, int line, QString fn,
                         QString msg);
+    /**
+     * Link utilization of all NoC links which changed since the last update
+     *
+     * The map is keyed by "<router id>:<port>", the values are the decaying
+     * average utilization of the router output link in the range [0, 1].
+     */
+    void nocLinkUtilizationChanged(QMap<QString, double> utilization);
 
 private:
     Q_DISABLE_COPY(SystemInterface)
@@ -123,6 +149,10 @@ private:
     QTimer m_softwareTraceTimer;
     QMutex m_softwareTraceMutex;
     SoftwareTraceEventDistributor m_softwareTraceDistributor;
+    QMap<QString, double> m_nocLinkUtilization;
+    QMap<QString, double> m_nocLinkUtilizationChanged;
+    QTimer m_nocLinkUtilizationTimer;
+    QMutex m_nocLinkUtilizationMutex;
     QThread m_workerThread;
     SystemInterfaceWorker *m_worker;
 
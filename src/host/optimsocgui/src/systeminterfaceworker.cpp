@@ -24,6 +24,17 @@
 
 #include "systeminterfaceworker.h"
 
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+
+#include "util.h"
+
+/**
+ * Number of bytes written to each memory in one step by writeFileToMemories()
+ */
+static const qint64 MEMORY_WRITE_CHUNK_SIZE = 64 * 1024;
+
 /**
  * Create a new SystemInterfaceWorker object
  *
@@ -37,7 +48,8 @@
  */
 SystemInterfaceWorker::SystemInterfaceWorker(struct optimsoc_ctx** octx,
                                              QMutex& octx_mutex)
-    : m_octx(octx), m_octx_mutex(octx_mutex), QObject(0)
+    : m_octx(octx), m_octx_mutex(octx_mutex), m_memoryWriteCanceled(0),
+      QObject(0)
 {
 }
 
@@ -70,6 +82,17 @@ void SystemInterfaceWorker::connectToSystem()
     // register callback function for software traces
     optimsoc_stm_register_callback(*m_octx,
                                    &SystemInterface::softwareTraceCallback);
+
+    // register callback function for NoC router monitor samples
+    optimsoc_nrm_register_callback(*m_octx,
+                                   &SystemInterface::nocRouterMonitorCallback);
+
+    // the NRMs are disabled until a sample interval is set
+    rv = optimsoc_nrm_set_sample_interval(*m_octx,
+                                          SystemInterface::NRM_SAMPLE_INTERVAL);
+    if (rv != 0) {
+        qWarning("Unable to set the NoC router monitor sample interval");
+    }
 }
 
 void SystemInterfaceWorker::disconnectFromSystem()
@@ -149,3 +172,92 @@ void SystemInterfaceWorker::writeToMemory(unsigned int memoryId,
                                 data.length());
     emit SystemInterface::instance()->memoryWriteFinished(memoryId, rv == 0);
 }
+
+/**
+ * Stream a file into multiple memories
+ *
+ * The file is mapped into memory and written in chunks of
+ * MEMORY_WRITE_CHUNK_SIZE bytes. Each chunk is written to all memories before
+ * continuing with the next one, so no copy of the file is made and all
+ * memories progress at the same pace. The library context is only locked
+ * while a chunk is transferred, and the cancel flag is checked between chunks.
+ *
+ * @see SystemInterface::writeFileToMemories()
+ */
+void SystemInterfaceWorker::writeFileToMemories(QList<unsigned int> memoryIds,
+                                                QString filename,
+                                                unsigned int baseAddress)
+{
+    SystemInterface *sysif = SystemInterface::instance();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        qWarning("Unable to open memory file %s", filename.toLatin1().data());
+        emit sysif->fileWriteFinished(false, false, 0);
+        return;
+    }
+
+    qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (!data) {
+        qWarning("Unable to map memory file %s", filename.toLatin1().data());
+        emit sysif->fileWriteFinished(false, false, 0);
+        return;
+    }
+
+    QVector<bool> failed(memoryIds.size(), false);
+    QVector<qint64> busyMs(memoryIds.size(), 0);
+    int activeCount = memoryIds.size();
+    bool canceled = false;
+    quint32 checksum = 0;
+    QElapsedTimer timer;
+
+    for (qint64 offset = 0; offset < size && activeCount > 0;
+         offset += MEMORY_WRITE_CHUNK_SIZE) {
+        if (m_memoryWriteCanceled) {
+            canceled = true;
+            break;
+        }
+
+        unsigned int len = qMin(MEMORY_WRITE_CHUNK_SIZE, size - offset);
+
+        QMutexLocker octx_mutex_locker(&m_octx_mutex);
+        for (int i = 0; i < memoryIds.size(); i++) {
+            if (failed[i]) {
+                continue;
+            }
+
+            timer.start();
+            int rv = optimsoc_mem_write(*m_octx, memoryIds[i],
+                                        baseAddress + offset, data + offset,
+                                        len);
+            busyMs[i] += timer.elapsed();
+
+            if (rv != 0) {
+                failed[i] = true;
+                activeCount--;
+                emit sysif->memoryWriteFinished(memoryIds[i], false);
+                continue;
+            }
+
+            emit sysif->memoryWriteProgress(memoryIds[i], offset + len, size,
+                                            busyMs[i]);
+        }
+        octx_mutex_locker.unlock();
+
+        checksum = Util::crc32(data + offset, len, checksum);
+    }
+
+    file.unmap(const_cast<uchar*>(data));
+
+    bool success = !canceled && activeCount == memoryIds.size();
+    if (!canceled) {
+        for (int i = 0; i < memoryIds.size(); i++) {
+            if (!failed[i]) {
+                emit sysif->memoryWriteFinished(memoryIds[i], true);
+            }
+        }
+    }
+
+    emit sysif->fileWriteFinished(success, canceled, checksum);
+}
@@ -25,6 +25,8 @@
 #ifndef SYSTEMINTERFACEWORKER_H
 #define SYSTEMINTERFACEWORKER_H
 
+#include <QAtomicInt>
+#include <QList>
 #include <QMutex>
 #include <QObject>
 
@@ -47,6 +49,7 @@ signals:
 private:
     QMutex& m_octx_mutex;
     struct optimsoc_ctx** m_octx;
+    QAtomicInt m_memoryWriteCanceled;
 
 private slots:
     void connectToSystem();
@@ -56,6 +59,8 @@ private slots:
     void stallCpus(bool doStall = true);
     void writeToMemory(unsigned int memoryId, QByteArray data,
                        unsigned int baseAddress = 0);
+    void writeFileToMemories(QList<unsigned int> memoryIds, QString filename,
+                             unsigned int baseAddress = 0);
 };
 
 #endif // SYSTEMINTERFACEWORKER_H
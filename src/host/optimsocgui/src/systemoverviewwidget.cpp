@@ -28,6 +28,7 @@
 #include "optimsocsystem.h"
 #include "systemoverviewjsapi.h"
 #include "optimsocsystemelement.h"
+#include "systeminterface.h"
 
 #include <QDebug>
 #include <QVBoxLayout>
@@ -35,6 +36,46 @@
 #include <QDomNode>
 #include <QDomElement>
 #include <QMenu>
+#include <QStringList>
+#include <QWebFrame>
+
+/**
+ * JavaScript colouring the NoC links in the system overview SVG
+ *
+ * All elements with an optimsoc-links attribute are indexed once after the
+ * document has been loaded. optimsocUpdateLinkUtilization() is then called
+ * with a batch of changed link utilizations and only re-colours the affected
+ * elements, from green (idle) to red (fully utilized). Elements representing
+ * both directions of a link show the higher utilization.
+ */
+static const char* NOC_LINK_UTILIZATION_SCRIPT =
+    "(function() {"
+    "  var links = {};"
+    "  var state = {};"
+    "  var elements = document.querySelectorAll('[optimsoc-links]');"
+    "  for (var i = 0; i < elements.length; i++) {"
+    "    var el = elements[i];"
+    "    el.optimsocLinks = el.getAttribute('optimsoc-links').split(' ');"
+    "    for (var j = 0; j < el.optimsocLinks.length; j++) {"
+    "      var key = el.optimsocLinks[j];"
+    "      (links[key] = links[key] || []).push(el);"
+    "    }"
+    "  }"
+    "  window.optimsocUpdateLinkUtilization = function(utilization) {"
+    "    var dirty = [];"
+    "    for (var key in utilization) {"
+    "      state[key] = utilization[key];"
+    "      if (links[key]) { dirty = dirty.concat(links[key]); }"
+    "    }"
+    "    for (var i = 0; i < dirty.length; i++) {"
+    "      var u = 0;"
+    "      for (var j = 0; j < dirty[i].optimsocLinks.length; j++) {"
+    "        u = Math.max(u, state[dirty[i].optimsocLinks[j]] || 0);"
+    "      }"
+    "      dirty[i].style.stroke = 'hsl(' + Math.round(120 * (1 - u)) + ',100%,40%)';"
+    "    }"
+    "  };"
+    "})();";
 
 SystemOverviewWidget::SystemOverviewWidget(QWidget *parent) :
     QWidget(parent)
@@ -61,6 +102,13 @@ void SystemOverviewWidget::setupUi()
     connect(m_jsapi, SIGNAL(itemClicked(QString)),
             this, SLOT(handleItemClicked(QString)));
 
+    // live NoC link utilization overlay
+    connect(m_webView, SIGNAL(loadFinished(bool)),
+            this, SLOT(installNocLinkUtilizationScript()));
+    connect(SystemInterface::instance(),
+            SIGNAL(nocLinkUtilizationChanged(QMap<QString, double>)),
+            this, SLOT(updateNocLinkUtilization(QMap<QString, double>)));
+
     QVBoxLayout *layout = new QVBoxLayout(this);
     layout->addWidget(m_webView);
     setLayout(layout);
@@ -142,3 +190,30 @@ void SystemOverviewWidget::handleItemClicked(QString idref)
 
     emit elementClicked(idref);
 }
+
+void SystemOverviewWidget::installNocLinkUtilizationScript()
+{
+    m_webView->page()->mainFrame()->evaluateJavaScript(NOC_LINK_UTILIZATION_SCRIPT);
+}
+
+/**
+ * Colour the NoC links according to their utilization
+ *
+ * All changes are passed to the document in a single JavaScript call.
+ *
+ * @param utilization link utilization, keyed by "<router id>:<port>"
+ * @see SystemInterface::nocLinkUtilizationChanged()
+ */
+void SystemOverviewWidget::updateNocLinkUtilization(QMap<QString, double> utilization)
+{
+    QStringList entries;
+    QMap<QString, double>::const_iterator it;
+    for (it = utilization.constBegin(); it != utilization.constEnd(); ++it) {
+        entries << QString("'%1':%2").arg(it.key()).arg(it.value(), 0, 'f', 3);
+    }
+
+    m_webView->page()->mainFrame()->evaluateJavaScript(
+        QString("if (window.optimsocUpdateLinkUtilization) {"
+                "  optimsocUpdateLinkUtilization({%1});"
+                "}").arg(entries.join(",")));
+}
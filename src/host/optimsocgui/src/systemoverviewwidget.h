@@ -25,6 +25,7 @@
 #ifndef SYSTEMOVERVIEWWIDGET_H
 #define SYSTEMOVERVIEWWIDGET_H
 
+#include <QMap>
 #include <QWidget>
 #include <QtWebKit/QWebView>
 
@@ -46,6 +47,10 @@ signals:
 
 public slots:
     void handleItemClicked(QString idref);
+    void updateNocLinkUtilization(QMap<QString, double> utilization);
+
+private slots:
+    void installNocLinkUtilizationScript();
 
 private:
     OptimsocSystem *m_optimsocSystem;
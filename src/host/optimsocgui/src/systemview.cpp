@@ -46,6 +46,9 @@ SystemView::SystemView(QWidget *parent) :
 
     connect(m_sysif, SIGNAL(systemDiscovered(int)),
             this, SLOT(systemDiscovered(int)));
+    connect(OptimsocSystemFactory::instance(),
+            SIGNAL(systemCreated(int, OptimsocSystem*)),
+            this, SLOT(systemCreated(int, OptimsocSystem*)));
 }
 
 SystemView::~SystemView()
@@ -56,13 +59,28 @@ SystemView::~SystemView()
 /**
  * The system discovery has been finished and a new system has been found
  *
+ * The system description is loaded in the background, systemCreated() is
+ * called when it is ready.
+ *
  * @param systemId unique ID of the discovered system
  */
 void SystemView::systemDiscovered(int systemId)
 {
+    OptimsocSystemFactory::createSystemFromIdAsync(systemId);
+}
+
+/**
+ * The system description of a discovered system has been loaded
+ *
+ * @param systemId unique ID of the discovered system
+ * @param system   the system object, or NULL if loading failed
+ */
+void SystemView::systemCreated(int systemId, OptimsocSystem *system)
+{
+    Q_UNUSED(systemId);
+
     // The allocated system is free'd in the destructor of the MainWindow to
     // ensure it being deleted only when the application closes.
-    OptimsocSystem *system = OptimsocSystemFactory::createSystemFromId(systemId);
     if (!system) {
         //QMetaObject::invokeMethod(m_hwif, "disconnect");
         /*QMessageBox::warning(this, "System not in database",
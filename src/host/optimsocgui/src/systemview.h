@@ -46,6 +46,7 @@ public:
 
 public slots:
     void systemDiscovered(int systemId);
+    void systemCreated(int systemId, OptimsocSystem *system);
     void treeViewSelectionChanged(const QModelIndex &selected,
                                   const QModelIndex &deselected);
     void selectElementInHierarchicalView(QString id);
@@ -40,3 +40,8 @@ void SoftwareTraceEventDistributor::emitEvents(QQueue<struct SoftwareTraceEvent*
     // Now we can also clear the container
     events.clear();
 }
+
+void SoftwareTraceEventDistributor::reset(unsigned int coreCount)
+{
+    emit softwareTraceReset(coreCount);
+}
@@ -46,9 +46,17 @@ class SoftwareTraceEventDistributor : public QObject {
 
 public:
     void emitEvents(QQueue<struct SoftwareTraceEvent*> &events);
+    void reset(unsigned int coreCount);
 
 signals:
     void softwareTraceEvent(struct SoftwareTraceEvent);
+    /**
+     * All previously distributed events are obsolete
+     *
+     * Receivers drop all collected trace data. @p coreCount is the number of
+     * cores the following events are coming from.
+     */
+    void softwareTraceReset(unsigned int coreCount);
 };
 
 #endif // TRACEEVENTS_H
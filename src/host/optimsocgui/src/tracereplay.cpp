@@ -0,0 +1,298 @@
+/* Copyright (c) 2026 by the author(s)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "tracereplay.h"
+
+#include <QQueue>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "systeminterface.h"
+
+/**
+ * Number of trace lines between two entries of the time index
+ */
+static const int INDEX_STRIDE = 1024;
+
+/**
+ * Replay timer interval [ms]
+ */
+static const int REPLAY_INTERVAL = 20;
+
+TraceReplay::TraceReplay(QObject *parent)
+    : QObject(parent), m_data(NULL), m_size(0), m_coreCount(0),
+      m_firstTimestamp(0), m_lastTimestamp(0), m_offset(0), m_position(0),
+      m_speed(1.0)
+{
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(replayTimer()));
+}
+
+TraceReplay::~TraceReplay()
+{
+    close();
+}
+
+/**
+ * Open a trace file and build the time index
+ *
+ * @return true if the file could be mapped and contains trace events
+ */
+bool TraceReplay::open(const QString &filename)
+{
+    close();
+
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open trace file %s", filename.toLatin1().data());
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : NULL;
+    if (!m_data) {
+        qWarning("Unable to map trace file %s", filename.toLatin1().data());
+        close();
+        return false;
+    }
+
+    // Build the sparse time index. Only the line headers are parsed here.
+    timestamp_t timestamp;
+    uint32_t core_id;
+    qint64 body, next;
+    int lines = 0;
+    for (qint64 offset = 0; offset < m_size; offset = next) {
+        if (!parseLineHeader(offset, &timestamp, &core_id, &body, &next)) {
+            continue;
+        }
+
+        if (lines++ % INDEX_STRIDE == 0) {
+            IndexEntry entry = { timestamp, offset };
+            m_index.append(entry);
+        }
+
+        if (lines == 1) {
+            m_firstTimestamp = timestamp;
+        }
+        m_lastTimestamp = qMax(m_lastTimestamp, timestamp);
+        m_coreCount = qMax(m_coreCount, core_id + 1);
+    }
+
+    if (lines == 0) {
+        qWarning("No trace events found in %s", filename.toLatin1().data());
+        close();
+        return false;
+    }
+
+    seek(m_firstTimestamp);
+    return true;
+}
+
+void TraceReplay::close()
+{
+    pause();
+
+    if (m_data) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = NULL;
+    }
+    m_file.close();
+
+    m_size = 0;
+    m_index.clear();
+    m_coreCount = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
+    m_offset = 0;
+    m_position = 0;
+}
+
+void TraceReplay::play()
+{
+    if (!m_data || m_timer.isActive()) {
+        return;
+    }
+    m_elapsed.start();
+    m_timer.start(REPLAY_INTERVAL);
+}
+
+void TraceReplay::pause()
+{
+    m_timer.stop();
+}
+
+/**
+ * Set the replay speed
+ *
+ * @param speed replay speed relative to the recorded time (1.0 = realtime)
+ */
+void TraceReplay::setSpeed(double speed)
+{
+    m_speed = speed;
+}
+
+/**
+ * Continue the replay at @p timestamp
+ *
+ * All views are reset and only events from @p timestamp on are replayed, so
+ * the size of the chart data depends on the viewed time span and not on the
+ * size of the trace file.
+ */
+void TraceReplay::seek(timestamp_t timestamp)
+{
+    if (!m_data) {
+        return;
+    }
+
+    SystemInterface::instance()->softwareTraceEventDistributor()->reset(m_coreCount);
+
+    // start at the last index entry before the requested time
+    int i = 0;
+    while (i + 1 < m_index.size() && m_index[i + 1].timestamp <= timestamp) {
+        i++;
+    }
+    m_offset = m_index[i].offset;
+
+    // skip all lines before the requested time
+    timestamp_t lineTimestamp;
+    uint32_t core_id;
+    qint64 body, next;
+    while (m_offset < m_size) {
+        if (parseLineHeader(m_offset, &lineTimestamp, &core_id, &body, &next) &&
+            lineTimestamp >= timestamp) {
+            break;
+        }
+        m_offset = next;
+    }
+
+    m_position = timestamp;
+    m_elapsed.restart();
+    emit positionChanged(m_position);
+}
+
+void TraceReplay::replayTimer()
+{
+    // timestamps are in ns
+    qint64 advance = m_elapsed.restart() * 1000000 * m_speed;
+    timestamp_t target = qMin<qint64>(m_position + advance, m_lastTimestamp);
+
+    readEventsUntil(target);
+
+    m_position = target;
+    emit positionChanged(m_position);
+
+    if (m_offset >= m_size) {
+        pause();
+        emit finished();
+    }
+}
+
+/**
+ * Parse the "[<timestamp>, <core>] " header of the trace line at @p offset
+ *
+ * @param body  offset of the text following the header
+ * @param next  offset of the next line
+ * @return false if the line is not a trace event
+ */
+bool TraceReplay::parseLineHeader(qint64 offset, timestamp_t *timestamp,
+                                  uint32_t *core_id, qint64 *body,
+                                  qint64 *next) const
+{
+    const char *line = reinterpret_cast<const char*>(m_data) + offset;
+    const char *eol = static_cast<const char*>(memchr(line, '\n', m_size - offset));
+    *next = eol ? (eol - reinterpret_cast<const char*>(m_data)) + 1 : m_size;
+
+    // Lines are not zero-terminated; only complete lines (ending with a
+    // newline) are parsed, so the parser always stops inside the mapping.
+    if (!eol || line[0] != '[') {
+        return false;
+    }
+
+    char *end;
+    *timestamp = strtoul(line + 1, &end, 10);
+    if (*end != ',') {
+        return false;
+    }
+    *core_id = strtoul(end + 1, &end, 10);
+    if (*end != ']') {
+        return false;
+    }
+
+    *body = (end + 2) - reinterpret_cast<const char*>(m_data);
+    return *body <= *next;
+}
+
+/**
+ * Distribute all events up to (and including) @p timestamp
+ */
+void TraceReplay::readEventsUntil(timestamp_t timestamp)
+{
+    QQueue<SoftwareTraceEvent*> events;
+    timestamp_t lineTimestamp;
+    uint32_t core_id;
+    qint64 body, next;
+
+    while (m_offset < m_size) {
+        if (!parseLineHeader(m_offset, &lineTimestamp, &core_id, &body, &next)) {
+            m_offset = next;
+            continue;
+        }
+        if (lineTimestamp > timestamp) {
+            break;
+        }
+
+        const char *text = reinterpret_cast<const char*>(m_data) + body;
+        qint64 len = qMax<qint64>(0, next - body - 1);
+        QByteArray msg = QByteArray::fromRawData(text, len);
+
+        if (msg.startsWith("Event 0x")) {
+            // regular event: "Event 0x<id>: 0x<value>"
+            char *end;
+            SoftwareTraceEvent *event = new SoftwareTraceEvent;
+            event->core_id = core_id;
+            event->timestamp = lineTimestamp;
+            event->id = strtoul(text + 6, &end, 16);
+            event->value = strtoul(end + 2, NULL, 16);
+            events.enqueue(event);
+        } else if (msg == "[Program terminated.]") {
+            SoftwareTraceEvent *event = new SoftwareTraceEvent;
+            event->core_id = core_id;
+            event->timestamp = lineTimestamp;
+            event->id = 0x1;
+            event->value = 0;
+            events.enqueue(event);
+        } else {
+            // printf() output, split into the original character events
+            for (qint64 i = 0; i <= len; i++) {
+                SoftwareTraceEvent *event = new SoftwareTraceEvent;
+                event->core_id = core_id;
+                event->timestamp = lineTimestamp;
+                event->id = 0x4;
+                event->value = (i < len) ? msg[i] : '\n';
+                events.enqueue(event);
+            }
+        }
+
+        m_offset = next;
+    }
+
+    SystemInterface::instance()->softwareTraceEventDistributor()->emitEvents(events);
+}
@@ -0,0 +1,98 @@
+/* Copyright (c) 2026 by the author(s)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+
+#include "traceevents.h"
+
+/**
+ * Replay a recorded software trace (STM) file
+ *
+ * The trace files are written by the optimsoc_cli command log_stm_trace. The
+ * file is mapped into memory and a sparse index from timestamps to file
+ * offsets is built when it is opened, so seeking does not need to parse the
+ * file up to the requested position. The events are fed through the
+ * SoftwareTraceEventDistributor of the SystemInterface, i.e. all views
+ * receive them as if they came from a connected system.
+ */
+class TraceReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TraceReplay(QObject *parent = 0);
+    ~TraceReplay();
+
+    bool open(const QString &filename);
+    void close();
+
+    timestamp_t firstTimestamp() const { return m_firstTimestamp; }
+    timestamp_t lastTimestamp() const { return m_lastTimestamp; }
+    timestamp_t position() const { return m_position; }
+    bool isPlaying() const { return m_timer.isActive(); }
+
+public slots:
+    void play();
+    void pause();
+    void seek(timestamp_t timestamp);
+    void setSpeed(double speed);
+
+signals:
+    void positionChanged(timestamp_t timestamp);
+    void finished();
+
+private slots:
+    void replayTimer();
+
+private:
+    struct IndexEntry {
+        timestamp_t timestamp;
+        qint64      offset;
+    };
+
+    bool parseLineHeader(qint64 offset, timestamp_t *timestamp,
+                         uint32_t *core_id, qint64 *body, qint64 *next) const;
+    void readEventsUntil(timestamp_t timestamp);
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    QVector<IndexEntry> m_index;
+    unsigned int m_coreCount;
+    timestamp_t m_firstTimestamp;
+    timestamp_t m_lastTimestamp;
+
+    qint64 m_offset;
+    timestamp_t m_position;
+    double m_speed;
+    QTimer m_timer;
+    QElapsedTimer m_elapsed;
+};
+
+#endif // TRACEREPLAY_H
@@ -49,3 +49,37 @@ QString Util::formatBytesHumanReadable(const qint64 byteSize)
 
     return QString("%1 %2").arg(size, 0, 'f', 2).arg(unit);
 }
+
+/**
+ * Calculate the CRC-32 (IEEE 802.3) checksum of a block of data
+ *
+ * The checksum can be calculated over multiple blocks by passing the result
+ * of the previous block as @p crc.
+ *
+ * @param data data block
+ * @param len  length of @p data in bytes
+ * @param crc  checksum of the preceding data (0 for the first block)
+ * @return the updated checksum
+ */
+quint32 Util::crc32(const uchar *data, qint64 len, quint32 crc)
+{
+    static quint32 table[256];
+    static bool tableInitialized = false;
+
+    if (!tableInitialized) {
+        for (quint32 i = 0; i < 256; i++) {
+            quint32 c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        tableInitialized = true;
+    }
+
+    crc = ~crc;
+    for (qint64 i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
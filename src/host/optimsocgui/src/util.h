@@ -33,6 +33,7 @@ class Util
 {
 public:
     static QString formatBytesHumanReadable(const qint64 byteSize);
+    static quint32 crc32(const uchar *data, qint64 len, quint32 crc = 0);
 };
 
 #endif // UTIL_H
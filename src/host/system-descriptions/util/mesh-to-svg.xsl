@@ -41,6 +41,11 @@ For usage in the GUI each relevant component in the graphic is overlayed with a
 transparent box with a optimsoc-idref attribute set to the ID of the component
 it represents. The transparent box is required to prevent the SVG viewer to show
 selectable text, etc.
+
+All NoC links carry an optimsoc-links attribute listing the monitored router
+output ports they represent as "<routerid>:<port>" pairs (port numbering:
+0 = north, 1 = east, 2 = south, 3 = west, 4 = local). The GUI uses it to show
+the link utilization reported by the NoC router monitors.
 -->
 <xsl:stylesheet version="1.0"
                 xmlns="http://www.optimsoc.org/xmlns/optimsoc-system"
@@ -166,6 +171,9 @@ selectable text, etc.
       </xsl:call-template>
     </xsl:param>
 
+    <!-- Router ID as reported by the NoC router monitors -->
+    <xsl:param name="routerid" select="$y * $xdim + $x"/>
+
     <!-- Origin (0,0) of the basic block we're drawing here -->
     <xsl:param name="bbOriginX" select="$x * ($SIZE_TILE + 2 * $SIZE_ROUTER)"/>
     <xsl:param name="bbOriginY" select="$y * ($SIZE_TILE + 2 * $SIZE_ROUTER)"/>
@@ -227,6 +235,9 @@ selectable text, etc.
 
     <!-- NoC router local link between tile and router -->
     <svg:path style="fill:none;stroke:#000000;stroke-width:1px;">
+      <xsl:attribute name="optimsoc-links">
+        <xsl:value-of select="concat($routerid, ':4')"/>
+      </xsl:attribute>
       <xsl:attribute name="d">
         <!-- starting point (absolute coordinates) -->
         <xsl:text>M</xsl:text>
@@ -242,6 +253,9 @@ selectable text, etc.
     <!-- NoC link horizontal -->
     <xsl:if test="$x != $xdim - 1">
       <svg:path style="fill:none;stroke:#000000;stroke-width:2px;">
+        <xsl:attribute name="optimsoc-links">
+          <xsl:value-of select="concat($routerid, ':1 ', $routerid + 1, ':3')"/>
+        </xsl:attribute>
         <xsl:attribute name="d">
           <!-- starting point (absolute coordinates) -->
           <xsl:text>M</xsl:text>
@@ -258,6 +272,9 @@ selectable text, etc.
     <!-- NoC link vertical -->
     <xsl:if test="$y != $ydim - 1">
       <svg:path style="fill:none;stroke:#000000;stroke-width:2px;">
+        <xsl:attribute name="optimsoc-links">
+          <xsl:value-of select="concat($routerid, ':2 ', $routerid + $xdim, ':0')"/>
+        </xsl:attribute>
         <xsl:attribute name="d">
           <!-- starting point (absolute coordinates) -->
           <xsl:text>M</xsl:text>
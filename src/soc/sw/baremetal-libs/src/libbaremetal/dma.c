@@ -31,60 +31,126 @@
 
 #include "include/optimsoc-baremetal.h"
 
+// The register interface of the lisnoc DMA addresses at most four request
+// table entries (two bit slot index), the number of entries is not exposed
+// to software.
 #define DMA_SLOTS 4
 // This must be changed to 2000 when conf part is removed from dma
 #define DMA_BASE 0xe0200000
+// Interrupt line of the DMA in the programmable interrupt controller
+#define DMA_IRQ_LINE 4
 
 #define DMA_SLOT_FREE 0
 #define DMA_SLOT_ALLOC 1
 #define DMA_SLOT_WAIT 2
+// Slot is used by the driver for a chain entry
+#define DMA_SLOT_CHAIN 3
 
+#define DMA_REG(slot, offset) REG32(DMA_BASE + 0x20 * (slot) + (offset))
 
 uint8_t _optimsoc_dma_initialized = 0;
 
 struct dma_slot {
-    unsigned int flag;
+    volatile unsigned int flag;
     unsigned int id;
+    // The hardware done bit is cleared on read, it is kept here once seen
+    volatile unsigned int complete;
+    // Chain this slot transfers an entry for
+    struct dma_chain *chain;
 };
 
-struct dma_slot *dma_slots[DMA_SLOTS];
+static struct dma_slot dma_slots[DMA_SLOTS];
 
-struct dma_slot *dma_alloc_slot() {
-    int i;
-    for (i=0;i<DMA_SLOTS;i++) {
-        if (dma_slots[i]->flag == DMA_SLOT_FREE) {
-            dma_slots[i]->flag = DMA_SLOT_ALLOC;
-            return dma_slots[i];
+// Chains waiting for slots
+static struct dma_chain *dma_chain_first;
+static struct dma_chain *dma_chain_last;
+
+// Cores of the tile share the DMA. The slots and the chain queue are
+// changed with interrupts disabled and this lock held.
+static optimsoc_mutex_t dma_lock;
+
+static void dma_irq_handler(void *arg);
+
+// Must be called with the lock held
+static struct dma_slot *dma_alloc_slot_locked(unsigned int flag) {
+    for (int i=0;i<DMA_SLOTS;i++) {
+        if (dma_slots[i].flag == DMA_SLOT_FREE) {
+            dma_slots[i].flag = flag;
+            dma_slots[i].complete = 0;
+            return &dma_slots[i];
         }
     }
+
     return 0;
 }
 
+struct dma_slot *dma_alloc_slot(unsigned int flag) {
+    struct dma_slot *slot;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&dma_lock);
+    slot = dma_alloc_slot_locked(flag);
+    optimsoc_mutex_unlock(&dma_lock);
+    or1k_critical_end(restore);
+
+    return slot;
+}
+
 void dma_free_slot(struct dma_slot *s) {
     s->flag = DMA_SLOT_FREE;
 }
 
 void dma_alloc_blocking(dma_transfer_handle_t *id) {
-    // not supported in baremetal
+    while (dma_alloc(id) == DMA_ERR_NOSLOT) {
+        // Chains free their slots from the interrupt or dma_process()
+        dma_process();
+    }
 }
 
-
 unsigned int dma_poll(dma_transfer_handle_t id) {
-    struct dma_slot *slot = dma_slots[id];
-    unsigned int p = REG32(DMA_BASE + 0x20 * slot->id + 0x14);
-    return p;
+    struct dma_slot *slot = &dma_slots[id];
+    unsigned int complete;
+
+    // The interrupt may read the clear-on-read status concurrently
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&dma_lock);
+    if (!slot->complete) {
+        slot->complete = DMA_REG(slot->id, 0x14);
+    }
+    complete = slot->complete;
+    optimsoc_mutex_unlock(&dma_lock);
+    or1k_critical_end(restore);
+
+    return complete;
+}
+
+static void dma_start(struct dma_slot *slot, void* local, uint32_t remote_tile,
+                      void* remote, size_t size, dma_direction_t dir) {
+    DMA_REG(slot->id, 0x0) = (uint32_t) local;
+    DMA_REG(slot->id, 0x4) = size;
+    DMA_REG(slot->id, 0x8) = remote_tile;
+    DMA_REG(slot->id, 0xc) = (uint32_t) remote;
+    DMA_REG(slot->id, 0x10) = dir;
+    DMA_REG(slot->id, 0x14) = 1; // go
 }
 
 void dma_init(void) {
     unsigned int s;
-    if (DMA_SLOTS>0) {
-        for (s=0;s<DMA_SLOTS;s++) {
-            dma_slots[s] = (struct dma_slot*) malloc(sizeof(struct dma_slot));
-            dma_slots[s]->id = s;
-            dma_slots[s]->flag = DMA_SLOT_FREE;
-        }
+    for (s=0;s<DMA_SLOTS;s++) {
+        dma_slots[s].id = s;
+        dma_slots[s].flag = DMA_SLOT_FREE;
+        dma_slots[s].complete = 0;
+        dma_slots[s].chain = 0;
     }
 
+    dma_chain_first = 0;
+    dma_chain_last = 0;
+
+    optimsoc_mutex_init(&dma_lock);
+
+    or1k_interrupt_handler_add(DMA_IRQ_LINE, &dma_irq_handler, 0);
+    or1k_interrupt_enable(DMA_IRQ_LINE);
+
     _optimsoc_dma_initialized = 1;
 }
 
@@ -93,7 +159,7 @@ dma_success_t dma_alloc(dma_transfer_handle_t *id) {
         return DMA_ERR_NOTINITIALIZED;
     }
 
-    struct dma_slot *slot = dma_alloc_slot();
+    struct dma_slot *slot = dma_alloc_slot(DMA_SLOT_ALLOC);
     if (!slot) {
         return DMA_ERR_NOSLOT;
     } else {
@@ -110,10 +176,10 @@ dma_success_t dma_free(dma_transfer_handle_t id) {
 
     assert(id < DMA_SLOTS);
 
-    struct dma_slot *slot = dma_slots[id];
+    struct dma_slot *slot = &dma_slots[id];
 
-    if(slot->flag == DMA_SLOT_ALLOC) {
-        slot->flag = DMA_SLOT_FREE;
+    if((slot->flag == DMA_SLOT_ALLOC) || (slot->flag == DMA_SLOT_WAIT)) {
+        dma_free_slot(slot);
         return DMA_SUCCESS;
     } else {
         return DMA_ERR_NOTALLOCATED;
@@ -127,17 +193,11 @@ dma_success_t dma_transfer(void* local, uint32_t remote_tile, void* remote,
         return DMA_ERR_NOTINITIALIZED;
     }
 
-    struct dma_slot *slot = dma_slots[id];
-    REG32(DMA_BASE + 0x20 * slot->id) = (uint32_t) local;
-    REG32(DMA_BASE + 0x20 * slot->id + 0x4) = size;
-    REG32(DMA_BASE + 0x20 * slot->id + 0x8) = remote_tile;
-    REG32(DMA_BASE + 0x20 * slot->id + 0xc) = (uint32_t) remote;
-    REG32(DMA_BASE + 0x20 * slot->id + 0x10) = dir;
-    REG32(DMA_BASE + 0x20 * slot->id + 0x14) = 1; // go
+    struct dma_slot *slot = &dma_slots[id];
+    slot->complete = 0;
+    slot->flag = DMA_SLOT_WAIT;
 
-#ifdef DMA_IRQ
-    dma_slots[id]->flag = DMA_SLOT_WAIT;
-#endif
+    dma_start(slot, local, remote_tile, remote, size, dir);
 
     return DMA_SUCCESS;
 }
@@ -149,5 +209,149 @@ dma_success_t dma_wait(dma_transfer_handle_t id) {
 
     while (dma_poll(id)==0) { __asm__ volatile("l.nop"); }
 
+    dma_slots[id].flag = DMA_SLOT_ALLOC;
+
     return DMA_SUCCESS;
 }
+
+// Start the next entries of the queued chains on free slots. Must be called
+// with interrupts disabled and the lock held.
+static void dma_chain_issue(void) {
+    while (dma_chain_first) {
+        struct dma_chain *chain = dma_chain_first;
+
+        if (chain->next == chain->num) {
+            // All entries started, the chain leaves the queue
+            dma_chain_first = chain->queue_next;
+            if (!dma_chain_first) {
+                dma_chain_last = 0;
+            }
+            continue;
+        }
+
+        struct dma_slot *slot = dma_alloc_slot_locked(DMA_SLOT_CHAIN);
+        if (!slot) {
+            return;
+        }
+
+        struct dma_sg_entry *e = &chain->entries[chain->next++];
+        slot->chain = chain;
+        chain->outstanding++;
+        dma_start(slot, e->local, e->remote_tile, e->remote, e->size, e->dir);
+    }
+}
+
+void dma_process(void) {
+    // Completed chains, linked by queue_next as they have left the queue
+    struct dma_chain *done = 0;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&dma_lock);
+
+    for (int i = 0; i < DMA_SLOTS; i++) {
+        struct dma_slot *slot = &dma_slots[i];
+
+        if ((slot->flag == DMA_SLOT_WAIT) && !slot->complete) {
+            // Reading the status acknowledges the interrupt of the slot
+            slot->complete = DMA_REG(slot->id, 0x14);
+        } else if ((slot->flag == DMA_SLOT_CHAIN) && DMA_REG(slot->id, 0x14)) {
+            struct dma_chain *chain = slot->chain;
+
+            slot->chain = 0;
+            dma_free_slot(slot);
+
+            chain->outstanding--;
+            if ((chain->outstanding == 0) && (chain->next == chain->num)) {
+                chain->queue_next = done;
+                done = chain;
+            }
+        }
+    }
+
+    dma_chain_issue();
+
+    optimsoc_mutex_unlock(&dma_lock);
+
+    // Callbacks run without the lock, they may start further chains
+    while (done) {
+        struct dma_chain *chain = done;
+        dma_callback_t callback = chain->callback;
+        void *arg = chain->arg;
+        done = chain->queue_next;
+
+        // A waiter may release the chain as soon as it is done
+        chain->done = 1;
+        if (callback) {
+            callback(arg);
+        }
+    }
+
+    or1k_critical_end(restore);
+}
+
+static void dma_irq_handler(void *arg) {
+    (void) arg;
+    dma_process();
+}
+
+dma_success_t dma_chain_start(struct dma_chain *chain,
+                              struct dma_sg_entry *entries, uint32_t num,
+                              dma_callback_t callback, void *arg) {
+    if (_optimsoc_dma_initialized==0) {
+        return DMA_ERR_NOTINITIALIZED;
+    }
+
+    chain->entries = entries;
+    chain->num = num;
+    chain->next = 0;
+    chain->outstanding = 0;
+    chain->callback = callback;
+    chain->arg = arg;
+    chain->queue_next = 0;
+    chain->done = (num == 0);
+
+    if (num == 0) {
+        if (callback) {
+            callback(arg);
+        }
+        return DMA_SUCCESS;
+    }
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&dma_lock);
+
+    if (dma_chain_last) {
+        dma_chain_last->queue_next = chain;
+    } else {
+        dma_chain_first = chain;
+    }
+    dma_chain_last = chain;
+
+    dma_chain_issue();
+
+    optimsoc_mutex_unlock(&dma_lock);
+    or1k_critical_end(restore);
+
+    return DMA_SUCCESS;
+}
+
+int dma_chain_done(struct dma_chain *chain) {
+    return chain->done;
+}
+
+dma_success_t dma_chain_wait(struct dma_chain *chain) {
+    if (_optimsoc_dma_initialized==0) {
+        return DMA_ERR_NOTINITIALIZED;
+    }
+
+    while (!chain->done) {
+        // Also makes progress if the interrupt is not generated
+        dma_process();
+    }
+
+    return DMA_SUCCESS;
+}
+
+/**
+ * @}
+ */
@@ -192,6 +192,7 @@ extern int optimsoc_get_tilerank(unsigned int tile);
  * identifier for the given rank.
  *
  * \param rank The rank to lookup
+ * \return The tile, or -1 if there is no compute tile with this rank
  */
 extern int optimsoc_get_ranktile(unsigned int rank);
 
@@ -367,7 +368,9 @@ uint32_t optimsoc_get_seed(void);
 /**
  * The mutex data type
  *
- * The mutex data type which is actually hidden on purpose.
+ * The mutex data type which is actually hidden on purpose. A mutex is a
+ * ticket lock, waiters acquire it in the order they arrived. A zero
+ * initialized mutex is unlocked.
  */
 typedef uint32_t optimsoc_mutex_t;
 
@@ -389,6 +392,16 @@ extern void optimsoc_mutex_init(optimsoc_mutex_t *mutex);
  */
 extern void optimsoc_mutex_lock(optimsoc_mutex_t *mutex);
 
+/**
+ * Try to lock mutex
+ *
+ * Lock a mutex if it is free and nobody waits for it
+ *
+ * \param mutex Mutex to lock
+ * \return 1 if the mutex was locked, 0 otherwise
+ */
+extern int optimsoc_mutex_trylock(optimsoc_mutex_t *mutex);
+
 /**
  * Unlock mutex
  *
@@ -403,6 +416,129 @@ extern void optimsoc_mutex_unlock(optimsoc_mutex_t *mutex);
  */
 
 
+/**
+ * \defgroup slab Fixed-size object pools
+ * \ingroup libbaremetal
+ *
+ * Pools of objects of one size, meant for small objects that are allocated
+ * and freed often, like list nodes or control blocks. Memory is taken from
+ * the heap in chunks of objects and never returned to it. Each core keeps
+ * a small cache of free objects, so that allocation and free do not take a
+ * lock in the common case. Objects can be freed on any core.
+ *
+ * A pool is defined statically and needs no further initialization:
+ *
+ *     static struct optimsoc_slab node_slab =
+ *             OPTIMSOC_SLAB_INIT("node", sizeof(struct node), 32);
+ *
+ * @{
+ */
+
+/**
+ * Maximum number of cores per tile with a per-core cache
+ */
+#define OPTIMSOC_SLAB_MAX_CORES 8
+
+/**
+ * Number of objects moved between a core cache and the shared free list
+ */
+#define OPTIMSOC_SLAB_BATCH 8
+
+/**
+ * Per-core cache of a pool, hidden on purpose
+ */
+struct optimsoc_slab_cache {
+    void *free;
+    uint32_t count;
+    uint32_t allocs;
+    uint32_t frees;
+};
+
+/**
+ * Object pool, hidden on purpose and initialized with OPTIMSOC_SLAB_INIT
+ */
+struct optimsoc_slab {
+    const char *name;
+    size_t size;
+    uint32_t chunk;
+    optimsoc_mutex_t lock;
+    void *free;
+    uint32_t chunks;
+    struct optimsoc_slab_cache cache[OPTIMSOC_SLAB_MAX_CORES];
+};
+
+/**
+ * Static initializer of an object pool
+ *
+ * \param name  Name of the pool used in the trace
+ * \param size  Size of the objects
+ * \param chunk Number of objects allocated from the heap at once
+ */
+#define OPTIMSOC_SLAB_INIT(name, size, chunk)                  \
+    { (name), (((size) + 3) & ~3) < sizeof(void*) ?            \
+            sizeof(void*) : (((size) + 3) & ~3), (chunk), 0,   \
+            NULL, 0, {{ NULL, 0, 0, 0 }} }
+
+/**
+ * Allocate an object from a pool
+ *
+ * The object is not initialized.
+ *
+ * \param slab Pool to allocate from
+ * \return Object, or NULL if the heap is exhausted
+ */
+extern void *optimsoc_slab_alloc(struct optimsoc_slab *slab);
+
+/**
+ * Allocate an object from a pool and set it to zero
+ *
+ * \param slab Pool to allocate from
+ * \return Object, or NULL if the heap is exhausted
+ */
+extern void *optimsoc_slab_zalloc(struct optimsoc_slab *slab);
+
+/**
+ * Return an object to its pool
+ *
+ * \param slab Pool the object was allocated from
+ * \param obj Object to free, may be NULL
+ */
+extern void optimsoc_slab_free(struct optimsoc_slab *slab, void *obj);
+
+/**
+ * Statistics of an object pool
+ */
+struct optimsoc_slab_stats {
+    uint32_t allocs; /*!< Number of allocations */
+    uint32_t frees; /*!< Number of frees */
+    uint32_t in_use; /*!< Objects currently allocated */
+    uint32_t capacity; /*!< Objects taken from the heap */
+};
+
+/**
+ * Get the statistics of an object pool
+ *
+ * \param slab Pool to query
+ * \param stats Statistics to fill
+ */
+extern void optimsoc_slab_get_stats(struct optimsoc_slab *slab,
+                                    struct optimsoc_slab_stats *stats);
+
+/**
+ * Emit the statistics of an object pool as trace events
+ *
+ * This is done automatically each time the pool takes a new chunk from the
+ * heap.
+ *
+ * \param slab Pool to trace
+ */
+extern void optimsoc_slab_trace(struct optimsoc_slab *slab);
+
+/**
+ * @}
+ */
+
+
 /**
  * \defgroup dma Direct Memory Access support
  * \ingroup libbaremetal
@@ -499,6 +635,96 @@ extern dma_success_t dma_transfer(void* local,
  */
 extern dma_success_t dma_wait(dma_transfer_handle_t id);
 
+/**
+ * Blocking allocation of a DMA transfer slot
+ *
+ * Like dma_alloc(), but waits until a slot is available.
+ *
+ * \param[out] id The handle of this slot
+ */
+extern void dma_alloc_blocking(dma_transfer_handle_t *id);
+
+/**
+ * Callback on completion of a DMA chain
+ */
+typedef void (*dma_callback_t)(void *arg);
+
+/**
+ * One entry of a scatter-gather DMA transfer
+ *
+ * The parameters are the same as for dma_transfer().
+ */
+struct dma_sg_entry {
+    void *local;
+    uint32_t remote_tile;
+    void *remote;
+    size_t size;
+    dma_direction_t dir;
+};
+
+/**
+ * A chain of DMA transfers
+ *
+ * The driver issues the entries of a chain on all free DMA slots and
+ * continues with the next entries as transfers complete. The structure is
+ * owned by the driver until the chain is done.
+ */
+struct dma_chain {
+    struct dma_sg_entry *entries;
+    uint32_t num;
+    volatile uint32_t next;
+    volatile uint32_t outstanding;
+    dma_callback_t callback;
+    void *arg;
+    volatile int done;
+    struct dma_chain *queue_next;
+};
+
+/**
+ * Start an asynchronous scatter-gather DMA transfer
+ *
+ * The entries are transferred using as many DMA slots as are free, the
+ * function returns immediately. When all entries are transferred, the
+ * callback is called from the DMA interrupt (or from dma_process()) and
+ * dma_chain_done() returns true. The entries and the chain must stay valid
+ * until then.
+ *
+ * \param chain Chain structure to use for this transfer
+ * \param entries Array of transfers
+ * \param num Number of entries
+ * \param callback Function to call on completion, or NULL
+ * \param arg Argument passed to the callback
+ * \return Success code
+ */
+extern dma_success_t dma_chain_start(struct dma_chain *chain,
+                                     struct dma_sg_entry *entries,
+                                     uint32_t num, dma_callback_t callback,
+                                     void *arg);
+
+/**
+ * Check if a DMA chain is done
+ *
+ * \param chain The chain to check
+ * \return 1 if all transfers of the chain are done, 0 otherwise
+ */
+extern int dma_chain_done(struct dma_chain *chain);
+
+/**
+ * Blocking wait for a DMA chain
+ *
+ * \param chain The chain to wait for
+ * \return Success code
+ */
+extern dma_success_t dma_chain_wait(struct dma_chain *chain);
+
+/**
+ * Collect completed DMA transfers and continue chains
+ *
+ * This is called from the DMA interrupt. It can also be called to make
+ * progress if the DMA does not generate interrupts.
+ */
+extern void dma_process(void);
+
 /**
  * @}
  */
@@ -525,6 +751,11 @@ extern dma_success_t dma_wait(dma_transfer_handle_t id);
  * invoke the handler, but you can register different handlers for different
  * message classes.
  *
+ * The interrupt handler first moves all received packets into a queue per
+ * class, and then calls the handlers. Handlers registered with
+ * optimsoc_mp_simple_addhandler_deferred() are instead called from
+ * optimsoc_mp_simple_dispatch() in the context of the application.
+ *
  * \note
  * Be careful with selecting classes, because they may be occupied by other
  * hardware. If you are not sure, use class 0.
@@ -584,6 +815,22 @@ int optimsoc_mp_simple_ctready(uint32_t rank, uint16_t endpoint);
  */
 void optimsoc_mp_simple_send(uint16_t endpoint, size_t size, uint32_t* buf);
 
+/**
+ * Send a message from a separate header and payload
+ *
+ * Sends a message of hdr_size + size flits. The payload is written to the
+ * network interface directly from buf, which avoids copying it behind the
+ * header first.
+ *
+ * \param endpoint The endpoint to send the message on
+ * \param hdr_size Size of the header in (word-sized) flits
+ * \param hdr Header buffer containing hdr_size flits
+ * \param size Size of the payload in (word-sized) flits
+ * \param buf Payload buffer containing size flits
+ */
+void optimsoc_mp_simple_send_hdr(uint16_t endpoint, size_t hdr_size,
+                                 uint32_t* hdr, size_t size, uint32_t* buf);
+
 /**
  * Add a handler for a class of incoming messages
  *
@@ -597,6 +844,48 @@ void optimsoc_mp_simple_send(uint16_t endpoint, size_t size, uint32_t* buf);
  */
 void optimsoc_mp_simple_addhandler(uint8_t cls, void (*hnd)(uint32_t*, size_t));
 
+/**
+ * Add a deferred handler for a class of incoming messages
+ *
+ * Packets of this class are only queued by the interrupt handler. The
+ * handler is called for them from optimsoc_mp_simple_dispatch(), so that a
+ * slow handler does not delay receiving further packets. If the queue of
+ * the class is full, further packets of the class are dropped.
+ *
+ * \param cls Class to register
+ * \param hnd Function pointer to handler for this class
+ */
+void optimsoc_mp_simple_addhandler_deferred(uint8_t cls,
+                                            void (*hnd)(uint32_t*, size_t));
+
+/**
+ * Call the deferred handlers for all queued packets
+ *
+ * \return Number of handled packets
+ */
+int optimsoc_mp_simple_dispatch(void);
+
+/**
+ * Receive statistics of a message class
+ */
+struct optimsoc_mp_simple_stats {
+    uint32_t received; /*!< Packets queued for the handler */
+    uint32_t dropped_nohandler; /*!< Packets dropped without handler */
+    uint32_t dropped_oversize; /*!< Packets dropped, larger than maximum */
+    uint32_t dropped_full; /*!< Packets dropped, queue was full */
+    uint32_t occupancy; /*!< Packets currently queued */
+    uint32_t occupancy_max; /*!< Maximum number of queued packets */
+};
+
+/**
+ * Get the receive statistics of a message class
+ *
+ * \param cls Class to query
+ * \param[out] stats Statistics of the class
+ */
+void optimsoc_mp_simple_get_stats(uint8_t cls,
+                                  struct optimsoc_mp_simple_stats *stats);
+
 /**
  * @}
  */
@@ -31,6 +31,7 @@
 #include "include/optimsoc-baremetal.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define BASE       (OPTIMSOC_NA_BASE + 0x100000)
 #define REG_NUMEP  BASE
@@ -82,8 +83,24 @@ static inline void trace_mp_simple_recv_finished(uint32_t src) {
 #define SET(x,v,msb,lsb) (((~0 << ((msb)+1) | ~(~0 << (lsb)))&x) | \
         (((v) & ~(~0<<((msb)-(lsb)+1))) << (lsb)))
 
-// Local buffer for the simple message passing
-static uint32_t* _buffer;
+// Number of packets that can be queued per class
+#define RING_SLOTS 8
+
+// Received packets are queued per class in a ring between the interrupt
+// handler (producer) and the class handler (consumer). Each slot holds a
+// packet of maximum size.
+struct mp_simple_ring {
+    uint32_t *data;
+    size_t size[RING_SLOTS];
+    volatile uint32_t rd;
+    volatile uint32_t wr;
+    // Handler is called from optimsoc_mp_simple_dispatch() instead of the
+    // interrupt handler
+    int deferred;
+    struct optimsoc_mp_simple_stats stats;
+};
+
+static struct mp_simple_ring _rings[OPTIMSOC_CLASS_NUM];
 
 // List of handlers for the classes
 void (*cls_handlers[OPTIMSOC_CLASS_NUM])(uint32_t*,size_t);
@@ -102,13 +119,15 @@ void optimsoc_mp_simple_init(void) {
     // Reset class handler
     for (int i=0;i<OPTIMSOC_CLASS_NUM;i++) {
         cls_handlers[i] = 0;
+        _rings[i].data = 0;
+        _rings[i].rd = 0;
+        _rings[i].wr = 0;
+        _rings[i].deferred = 0;
+        memset(&_rings[i].stats, 0, sizeof(struct optimsoc_mp_simple_stats));
     }
 
     _num_endpoints = REG32(REG_NUMEP);
     _domains_ready = calloc(optimsoc_get_numct(), sizeof(uint32_t));
-
-    // Allocate buffer
-    _buffer = malloc(optimsoc_noc_maxpacketsize()*sizeof(uint32_t));
 }
 
 uint16_t optimsoc_mp_simple_num_endpoints() {
@@ -138,19 +157,62 @@ int optimsoc_mp_simple_ctready(uint32_t rank, uint16_t endpoint) {
     return 0;
 }
 
+static void _addhandler(uint8_t class, void (*hnd)(uint32_t*,size_t),
+                        int deferred) {
+    struct mp_simple_ring *ring = &_rings[class];
+
+    if (!ring->data) {
+        ring->data = malloc(RING_SLOTS * optimsoc_noc_maxpacketsize() *
+                            sizeof(uint32_t));
+    }
+    ring->deferred = deferred;
+
+    cls_handlers[class] = hnd;
+}
+
 void optimsoc_mp_simple_addhandler(uint8_t class,
                                    void (*hnd)(uint32_t*,size_t)) {
-    cls_handlers[class] = hnd;
+    _addhandler(class, hnd, 0);
 }
 
-void _irq_handler(void* arg) {
+void optimsoc_mp_simple_addhandler_deferred(uint8_t class,
+                                            void (*hnd)(uint32_t*,size_t)) {
+    _addhandler(class, hnd, 1);
+}
 
-    (void) arg;
+void optimsoc_mp_simple_get_stats(uint8_t class,
+                                  struct optimsoc_mp_simple_stats *stats) {
+    uint32_t restore = or1k_critical_begin();
+    *stats = _rings[class].stats;
+    stats->occupancy = _rings[class].wr - _rings[class].rd;
+    or1k_critical_end(restore);
+}
+
+static inline uint32_t *_ring_slot(struct mp_simple_ring *ring, uint32_t idx) {
+    return &ring->data[(idx % RING_SLOTS) * optimsoc_noc_maxpacketsize()];
+}
+
+// Call the handler for the oldest packet in the ring and free its slot
+static void _ring_dispatch_one(uint8_t class) {
+    struct mp_simple_ring *ring = &_rings[class];
+    uint32_t *buffer = _ring_slot(ring, ring->rd);
+    size_t size = ring->size[ring->rd % RING_SLOTS];
 
+    uint32_t src = (buffer[0]>>OPTIMSOC_SRC_LSB) & 0x1f;
+    trace_mp_simple_recv(src, class, size);
+
+    cls_handlers[class](buffer, size);
+
+    trace_mp_simple_recv_finished(src);
+
+    ring->rd++;
+}
+
+// Read all packets from the hardware into the class rings
+static void _drain(void) {
     while (1) {
         uint16_t empty = 0;
         for (uint16_t ep = 0; ep < _num_endpoints; ep++) {
-            // Store message in buffer
             // Get size
             size_t size = RECV(ep);
 
@@ -158,21 +220,12 @@ void _irq_handler(void* arg) {
                 // There are no further messages in the buffer
                 empty++;
                 continue;
-            } else if (optimsoc_noc_maxpacketsize()<size) {
-                // Abort and drop if message cannot be stored
-                //            printf("FATAL: not sufficent buffer space. Drop packet\n");
-                for (int i=0;i<size;i++) {
-                    RECV(ep);
-                }
-            } else {
-                for (int i=0;i<size;i++) {
-                    _buffer[i] = RECV(ep);
-                }
             }
 
-            uint32_t header = _buffer[0];
+            uint32_t header = RECV(ep);
             // Extract class
             uint8_t class = EXTRACT(header, OPTIMSOC_CLASS_MSB, OPTIMSOC_CLASS_LSB);
+            struct mp_simple_ring *ring = &_rings[class];
 
             if (class == OPTIMSOC_CLASS_NUM-1) {
                 uint32_t ready = (header & 0x2) >> 1;
@@ -186,25 +239,100 @@ void _irq_handler(void* arg) {
                 }
             }
 
-            // Call respective class handler
             if (cls_handlers[class] == 0) {
-                // No handler registered, packet gets lost
-                //printf("Packet of unknown class (%d) received. Drop.\n",class);
+                // No handler registered, packet gets lost (the ready
+                // messages are already handled above)
+                if (class != OPTIMSOC_CLASS_NUM-1) {
+                    ring->stats.dropped_nohandler++;
+                }
+                for (int i=1;i<size;i++) {
+                    RECV(ep);
+                }
+                continue;
+            } else if (optimsoc_noc_maxpacketsize()<size) {
+                // Abort and drop if message cannot be stored
+                ring->stats.dropped_oversize++;
+                for (int i=1;i<size;i++) {
+                    RECV(ep);
+                }
                 continue;
             }
 
-            uint32_t src = (_buffer[0]>>OPTIMSOC_SRC_LSB) & 0x1f;
-            trace_mp_simple_recv(src, class, size);
+            if (ring->wr - ring->rd == RING_SLOTS) {
+                if (ring->deferred) {
+                    // The deferred handler does not keep up
+                    ring->stats.dropped_full++;
+                    for (int i=1;i<size;i++) {
+                        RECV(ep);
+                    }
+                    continue;
+                }
+                // Make room by handling the oldest packet now
+                _ring_dispatch_one(class);
+            }
+
+            uint32_t *buffer = _ring_slot(ring, ring->wr);
+            buffer[0] = header;
+            for (int i=1;i<size;i++) {
+                buffer[i] = RECV(ep);
+            }
+            ring->size[ring->wr % RING_SLOTS] = size;
 
-            cls_handlers[class](_buffer,size);
+            // Publish the packet
+            ring->wr++;
 
-            trace_mp_simple_recv_finished(src);
+            ring->stats.received++;
+            if (ring->wr - ring->rd > ring->stats.occupancy_max) {
+                ring->stats.occupancy_max = ring->wr - ring->rd;
+            }
         }
         if (empty == _num_endpoints)
             break;
     }
 }
 
+void _irq_handler(void* arg) {
+
+    (void) arg;
+
+    // First move everything out of the hardware, so that the network is not
+    // blocked while the handlers run
+    _drain();
+
+    // Handle the packets of the classes that are handled in the interrupt.
+    // The hardware is drained again after each packet.
+    int pending;
+    do {
+        pending = 0;
+        for (uint8_t class = 0; class < OPTIMSOC_CLASS_NUM; class++) {
+            struct mp_simple_ring *ring = &_rings[class];
+            if (!ring->deferred && (ring->rd != ring->wr)) {
+                _ring_dispatch_one(class);
+                _drain();
+                pending = 1;
+            }
+        }
+    } while (pending);
+}
+
+int optimsoc_mp_simple_dispatch(void) {
+    int handled = 0;
+
+    for (uint8_t class = 0; class < OPTIMSOC_CLASS_NUM; class++) {
+        struct mp_simple_ring *ring = &_rings[class];
+        if (!ring->deferred) {
+            continue;
+        }
+
+        while (ring->rd != ring->wr) {
+            _ring_dispatch_one(class);
+            handled++;
+        }
+    }
+
+    return handled;
+}
+
 void optimsoc_mp_simple_send(uint16_t endpoint, size_t size, uint32_t *buf) {
     trace_mp_simple_send(buf[0]>>OPTIMSOC_DEST_LSB, size, buf);
 
@@ -220,3 +348,22 @@ void optimsoc_mp_simple_send(uint16_t endpoint, size_t size, uint32_t *buf) {
     trace_mp_simple_send_finished(buf[0] >> OPTIMSOC_DEST_LSB);
 }
 
+void optimsoc_mp_simple_send_hdr(uint16_t endpoint, size_t hdr_size,
+                                 uint32_t *hdr, size_t size, uint32_t *buf) {
+    trace_mp_simple_send(hdr[0]>>OPTIMSOC_DEST_LSB, hdr_size+size, hdr);
+
+    uint32_t restore = or1k_critical_begin();
+
+    SEND(endpoint) = hdr_size + size;
+    for (int i=0;i<hdr_size;i++) {
+        SEND(endpoint) = hdr[i];
+    }
+    for (int i=0;i<size;i++) {
+        SEND(endpoint) = buf[i];
+    }
+
+    or1k_critical_end(restore);
+
+    trace_mp_simple_send_finished(hdr[0] >> OPTIMSOC_DEST_LSB);
+}
+
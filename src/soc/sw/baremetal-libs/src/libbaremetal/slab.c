@@ -0,0 +1,194 @@
+/* Copyright (c) 2026 by the author(s)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * =================================================================
+ *
+ * Fixed-size object pools with per-core caches.
+ */
+
+#include <or1k-support.h>
+#include <optimsoc-baremetal.h>
+
+#include <string.h>
+
+// Objects are linked through their first word while they are free
+struct slab_object {
+    struct slab_object *next;
+};
+
+#define SLAB_TRACE_STATS 0x24
+
+static struct optimsoc_slab_cache *slab_cache(struct optimsoc_slab *slab) {
+    uint32_t core = or1k_coreid();
+    assert(core < OPTIMSOC_SLAB_MAX_CORES);
+    return &slab->cache[core];
+}
+
+/*
+ * Refill the cache of this core from the shared free list, and take a new
+ * chunk from the heap if that is empty. Called with interrupts disabled.
+ */
+static void slab_refill(struct optimsoc_slab *slab,
+                        struct optimsoc_slab_cache *cache) {
+    int grown = 0;
+
+    optimsoc_mutex_lock(&slab->lock);
+
+    if (slab->free == NULL) {
+        char *chunk = malloc(slab->size * slab->chunk);
+        if (chunk == NULL) {
+            optimsoc_mutex_unlock(&slab->lock);
+            return;
+        }
+
+        for (uint32_t i = 0; i < slab->chunk; i++) {
+            struct slab_object *obj;
+            obj = (struct slab_object*) &chunk[i * slab->size];
+            obj->next = slab->free;
+            slab->free = obj;
+        }
+        slab->chunks++;
+        grown = 1;
+    }
+
+    for (int i = 0; (i < OPTIMSOC_SLAB_BATCH) && slab->free; i++) {
+        struct slab_object *obj = slab->free;
+        slab->free = obj->next;
+        obj->next = cache->free;
+        cache->free = obj;
+        cache->count++;
+    }
+
+    optimsoc_mutex_unlock(&slab->lock);
+
+    // Each time a pool grows its statistics go to the trace
+    if (grown) {
+        optimsoc_slab_trace(slab);
+    }
+}
+
+/*
+ * Return a batch of objects from the cache of this core to the shared free
+ * list. Called with interrupts disabled.
+ */
+static void slab_flush(struct optimsoc_slab *slab,
+                       struct optimsoc_slab_cache *cache) {
+    optimsoc_mutex_lock(&slab->lock);
+
+    for (int i = 0; (i < OPTIMSOC_SLAB_BATCH) && cache->free; i++) {
+        struct slab_object *obj = cache->free;
+        cache->free = obj->next;
+        cache->count--;
+        obj->next = slab->free;
+        slab->free = obj;
+    }
+
+    optimsoc_mutex_unlock(&slab->lock);
+}
+
+void *optimsoc_slab_alloc(struct optimsoc_slab *slab) {
+    struct slab_object *obj;
+
+    uint32_t restore = or1k_critical_begin();
+
+    struct optimsoc_slab_cache *cache = slab_cache(slab);
+
+    if (cache->free == NULL) {
+        slab_refill(slab, cache);
+    }
+
+    obj = cache->free;
+    if (obj) {
+        cache->free = obj->next;
+        cache->count--;
+        cache->allocs++;
+    }
+
+    or1k_critical_end(restore);
+
+    return obj;
+}
+
+void *optimsoc_slab_zalloc(struct optimsoc_slab *slab) {
+    void *obj = optimsoc_slab_alloc(slab);
+
+    if (obj) {
+        memset(obj, 0, slab->size);
+    }
+
+    return obj;
+}
+
+void optimsoc_slab_free(struct optimsoc_slab *slab, void *obj) {
+    if (obj == NULL) {
+        return;
+    }
+
+    uint32_t restore = or1k_critical_begin();
+
+    struct optimsoc_slab_cache *cache = slab_cache(slab);
+    struct slab_object *o = obj;
+
+    o->next = cache->free;
+    cache->free = o;
+    cache->count++;
+    cache->frees++;
+
+    // Keep the cache bounded, so that objects freed on this core are
+    // available to the others
+    if (cache->count >= 2 * OPTIMSOC_SLAB_BATCH) {
+        slab_flush(slab, cache);
+    }
+
+    or1k_critical_end(restore);
+}
+
+void optimsoc_slab_get_stats(struct optimsoc_slab *slab,
+                             struct optimsoc_slab_stats *stats) {
+    stats->allocs = 0;
+    stats->frees = 0;
+
+    for (int c = 0; c < OPTIMSOC_SLAB_MAX_CORES; c++) {
+        stats->allocs += slab->cache[c].allocs;
+        stats->frees += slab->cache[c].frees;
+    }
+
+    stats->in_use = stats->allocs - stats->frees;
+    stats->capacity = slab->chunks * slab->chunk;
+}
+
+void optimsoc_slab_trace(struct optimsoc_slab *slab) {
+    struct optimsoc_slab_stats stats;
+    const char *name = slab->name;
+
+    optimsoc_slab_get_stats(slab, &stats);
+
+    while (name && *name) {
+        OPTIMSOC_TRACE(SLAB_TRACE_STATS, *name);
+        name++;
+    }
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, 0); // Terminate string
+
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, slab->size);
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, stats.allocs);
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, stats.frees);
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, stats.in_use);
+    OPTIMSOC_TRACE(SLAB_TRACE_STATS, stats.capacity);
+}
@@ -28,32 +28,78 @@
 
 #include "include/optimsoc-baremetal.h"
 
+// The tile identifier in a packet header has five bits
+#define MAX_TILES (1 << (OPTIMSOC_DEST_MSB - OPTIMSOC_DEST_LSB + 1))
+
+// Mapping between compute tile ranks and tile identifiers, read once from
+// the network adapter
+static uint32_t _numct;
+static uint16_t _ranktile[MAX_TILES];
+static int16_t _tilerank[MAX_TILES];
+static int _ctrank;
+static volatile int _rankmap_initialized = 0;
+
+static void _rankmap_init(void) {
+    uint16_t *ctlist = (uint16_t*) OPTIMSOC_NA_CT_LIST;
+
+    for (int t = 0; t < MAX_TILES; t++) {
+        _tilerank[t] = -1;
+    }
+
+    _numct = REG32(OPTIMSOC_NA_CT_NUM);
+    if (_numct > MAX_TILES) {
+        _numct = MAX_TILES;
+    }
+
+    for (int i = 0; i < _numct; i++) {
+        uint16_t tile = REG16(&ctlist[i]);
+        _ranktile[i] = tile;
+        if (tile < MAX_TILES) {
+            _tilerank[tile] = i;
+        }
+    }
+
+    _ctrank = _tilerank[optimsoc_get_tileid() % MAX_TILES];
+
+    _rankmap_initialized = 1;
+}
+
+static inline void _rankmap_check(void) {
+    // Also works without optimsoc_init()
+    if (!_rankmap_initialized) {
+        _rankmap_init();
+    }
+}
+
 uint32_t optimsoc_get_numct(void) {
-    return REG32(OPTIMSOC_NA_CT_NUM);
+    _rankmap_check();
+    return _numct;
 }
 
 int optimsoc_get_ctrank(void) {
-    return optimsoc_get_tilerank(optimsoc_get_tileid());
+    _rankmap_check();
+    return _ctrank;
 }
 
 
 int optimsoc_get_tilerank(unsigned int tile) {
-    uint16_t *ctlist = (uint16_t*) OPTIMSOC_NA_CT_LIST;
-    for (int i = 0; i < optimsoc_get_numct(); i++) {
-        if (REG16(&ctlist[i]) == tile) {
-            return i;
-        }
+    _rankmap_check();
+    if (tile >= MAX_TILES) {
+        return -1;
     }
-    return -1;
+    return _tilerank[tile];
 }
 
 int optimsoc_get_ranktile(unsigned int rank) {
-    uint16_t *ctlist = (uint16_t*) OPTIMSOC_NA_CT_LIST;
-    return ctlist[rank];
+    _rankmap_check();
+    if (rank >= _numct) {
+        return -1;
+    }
+    return _ranktile[rank];
 }
 
 void optimsoc_init(optimsoc_conf *config) {
-
+    _rankmap_init();
 }
 
 uint32_t optimsoc_mainmem_size() {
@@ -88,16 +134,78 @@ void optimsoc_trace_kernelsection(void) {
     OPTIMSOC_TRACE(0x23,0);
 }
 
+// The mutex is a ticket lock: the upper half of the word is the next ticket
+// to hand out, the lower half is the ticket currently served. Waiters only
+// read the word while spinning, which keeps the atomic operations on the bus
+// to one per acquisition and release, and they are served in order.
+#define MUTEX_TICKET_ONE     (1 << 16)
+#define MUTEX_TICKET(v)      ((uint16_t) ((v) >> 16))
+#define MUTEX_SERVING(v)     ((uint16_t) ((v) & 0xffff))
+
+// Cycles a waiter backs off per waiter ahead of it, and the upper limit
+#define MUTEX_BACKOFF        16
+#define MUTEX_BACKOFF_MAX    1024
+
+static void _mutex_backoff(uint32_t cycles) {
+    for (uint32_t i = 0; i < cycles; i++) {
+        __asm__ volatile("l.nop");
+    }
+}
+
 void optimsoc_mutex_init(optimsoc_mutex_t *mutex) {
     *mutex = 0;
 }
 
 void optimsoc_mutex_lock(optimsoc_mutex_t *mutex) {
-    while (or1k_sync_tsl(mutex) != 0) {}
+    uint32_t v;
+
+    // Draw a ticket
+    do {
+        v = or1k_sync_ll(mutex);
+    } while (or1k_sync_sc(mutex, v + MUTEX_TICKET_ONE) != 1);
+
+    uint16_t ticket = MUTEX_TICKET(v);
+    uint32_t backoff = MUTEX_BACKOFF;
+
+    // Wait for our turn. The back off is proportional to the number of
+    // waiters ahead and doubles while the holder keeps the lock.
+    while (1) {
+        uint16_t ahead = ticket - MUTEX_SERVING(*(volatile uint32_t*) mutex);
+        if (ahead == 0) {
+            break;
+        }
+
+        uint32_t cycles = ahead * backoff;
+        _mutex_backoff(cycles < MUTEX_BACKOFF_MAX ? cycles : MUTEX_BACKOFF_MAX);
+
+        if (ahead == 1 && backoff < MUTEX_BACKOFF_MAX) {
+            backoff <<= 1;
+        }
+    }
+}
+
+int optimsoc_mutex_trylock(optimsoc_mutex_t *mutex) {
+    uint32_t v;
+
+    do {
+        v = or1k_sync_ll(mutex);
+        if (MUTEX_TICKET(v) != MUTEX_SERVING(v)) {
+            return 0;
+        }
+    } while (or1k_sync_sc(mutex, v + MUTEX_TICKET_ONE) != 1);
+
+    return 1;
 }
 
 void optimsoc_mutex_unlock(optimsoc_mutex_t *mutex) {
-    *mutex = 0;
+    uint32_t v;
+
+    // Only the holder advances the served ticket, but others draw tickets
+    // concurrently. Do not carry into the ticket half.
+    do {
+        v = or1k_sync_ll(mutex);
+    } while (or1k_sync_sc(mutex, (v & ~0xffff) |
+                          (uint16_t) (MUTEX_SERVING(v) + 1)) != 1);
 }
 
 uint32_t optimsoc_get_seed(void) {
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 unsigned int timeout_insns = 1000;
 
@@ -86,6 +87,8 @@ void control_msg_handler(uint32_t* buffer,size_t len) {
 
         struct endpoint *ep = (struct endpoint*) buffer[1];
         unsigned int size = buffer[2];
+        // Flit 3: number of slots the sender wants granted
+        unsigned int credit = buffer[3];
 
         trace_msg_alloc_req_recv(src, ep, size);
 
@@ -94,13 +97,19 @@ void control_msg_handler(uint32_t* buffer,size_t len) {
         if (rv == 0) {
             rbuffer[1] = CTRL_REQUEST_ACK;
             rbuffer[2] = ptr;
+            rbuffer[3] = endpoint_msg_credit_grant(ep, credit);
+            // Flit 4: maximum message size, limits the credited sends
+            rbuffer[4] = ep->buffer->max_element_size;
             trace_msg_alloc_resp_send(src, ep, ptr);
-            optimsoc_mp_simple_send(1,3, rbuffer);
+            optimsoc_mp_simple_send(1,5, rbuffer);
 
         } else {
             rbuffer[1] = CTRL_REQUEST_NACK;
+            // Flit 2: maximum message size, the sender stops retrying if
+            // the message can never fit
+            rbuffer[2] = ep->buffer->max_element_size;
             trace_msg_alloc_resp_send(src, ep, -1);
-            optimsoc_mp_simple_send(1,2,rbuffer);
+            optimsoc_mp_simple_send(1,3,rbuffer);
         }
 
         break;
@@ -119,13 +128,27 @@ void control_msg_handler(uint32_t* buffer,size_t len) {
 
         endpoint_write_complete(ep, buffer[2], buffer[3]);
 
-#ifdef RUNTIME
-        // TODO
-        /*        if (ep->waiting_thread) {
-                optimsoc_thread_resume(ep->waiting_thread);
-                ep->waiting_thread = 0;
-            }*/
-#endif
+        break;
+    }
+    case CTRL_REQUEST_MSG_SEND:
+    {
+        // A complete message in a slot granted before
+        // Flit 1: endpoint
+        // Flit 2: sender handle to return the credit to
+        // Flit 3: size in bytes
+        struct endpoint *ep = (struct endpoint*) buffer[1];
+
+        trace_msg_data_recv(ep, ep->buffer->write_ptr, buffer[3]);
+        endpoint_msg_write(ep, src, buffer[2], (uint32_t*) &buffer[4], buffer[3]);
+
+        break;
+    }
+    case CTRL_REQUEST_MSG_CREDIT:
+    {
+        struct endpoint_handle *eph = (struct endpoint_handle *) buffer[1];
+
+        endpoint_msg_credit_add(eph, buffer[2]);
+
         break;
     }
     case CTRL_REQUEST_CHAN_CONNECT_REQ:
@@ -139,8 +162,15 @@ void control_msg_handler(uint32_t* buffer,size_t len) {
                 (optimsoc_get_tileid() << OPTIMSOC_SRC_LSB) |
                 (CTRL_REQUEST_CHAN_CONNECT_RESP << CTRL_REQUEST_LSB);
 
+        // Flit 1: credit
+        // Flit 2: receive buffer base address
+        // Flit 3: element size (bytes) and number of elements
+        // Flit 4: write pointer
         rbuffer[1] = endpoint_channel_get_credit(ep);
-        optimsoc_mp_simple_send(1, 2, rbuffer);
+        rbuffer[2] = (uint32_t) ep->buffer->data[0];
+        rbuffer[3] = (ep->buffer->max_element_size << 16) | ep->buffer->size;
+        rbuffer[4] = ep->buffer->write_ptr;
+        optimsoc_mp_simple_send(1, 5, rbuffer);
         break;
     }
     case CTRL_REQUEST_CHAN_DATA:
@@ -156,9 +186,22 @@ void control_msg_handler(uint32_t* buffer,size_t len) {
             uint32_t ptr; // Move the pointer
             endpoint_push(ep, &ptr);
             trace_ep_bufferstate(ep, endpoint_channel_get_fillstate(ep));
+            endpoint_wakeup(ep);
         }
 
 
+        break;
+    }
+    case CTRL_REQUEST_CHAN_DMA_COMPLETE:
+    {
+        // The sender has written a packet with DMA
+        // Flit 1: endpoint
+        // Flit 2: slot
+        // Flit 3: size in bytes
+        struct endpoint *ep = (struct endpoint *) buffer[1];
+
+        endpoint_channel_write_complete(ep, buffer[2], buffer[3]);
+
         break;
     }
     case CTRL_REQUEST_CHAN_CREDIT:
@@ -259,21 +302,36 @@ uint32_t control_msg_alloc(struct endpoint_handle *to_ep, uint32_t size) {
                 (CTRL_REQUEST_MSG_ALLOC_REQ << CTRL_REQUEST_LSB);
         ctrl_request.buffer[1] = (unsigned int) to_ep->ep;
         ctrl_request.buffer[2] = (unsigned int) size;
+        // Ask for slots to send the following messages without allocation
+        if (size <= control_msg_send_maxsize()) {
+            ctrl_request.buffer[3] = MSG_CREDIT_GRANT;
+        } else {
+            ctrl_request.buffer[3] = 0;
+        }
         ctrl_request.done = 0;
 
         trace_msg_alloc_req_send(to_ep, size);
 
-        optimsoc_mp_simple_send(0,3,ctrl_request.buffer);
+        optimsoc_mp_simple_send(0,4,ctrl_request.buffer);
 
         control_wait_response();
 
         if (ctrl_request.buffer[1]==CTRL_REQUEST_NACK) {
+            to_ep->msgmaxsize = ctrl_request.buffer[2];
+            if (size > to_ep->msgmaxsize) {
+                trace_msg_alloc_end(to_ep, -1);
+                return CONTROL_MSG_ALLOC_TOOLARGE;
+            }
+
             for (int t=0;t<timeout_insns;t++) { asm __volatile__("l.nop 0x0"); }
             timeout_insns = timeout_insns * 10; // somewhat arbitrary..
         }
 
     } while (ctrl_request.buffer[1]==CTRL_REQUEST_NACK);
 
+    to_ep->msgmaxsize = ctrl_request.buffer[4];
+    endpoint_msg_credit_add(to_ep, ctrl_request.buffer[3]);
+
     trace_msg_alloc_end(to_ep, ctrl_request.buffer[2]);
 
     return ctrl_request.buffer[2];
@@ -324,6 +382,70 @@ void control_msg_data(struct endpoint_handle *ep, uint32_t address, void* buffer
     trace_msg_data_end(ep);
 }
 
+/**
+ * Maximum message size in bytes that fits into a single MSG_SEND packet
+ */
+uint32_t control_msg_send_maxsize() {
+    uint32_t words = optimsoc_noc_maxpacketsize() - 4;
+
+    if (words > sizeof(ctrl_request.buffer) / 4 - 4) {
+        words = sizeof(ctrl_request.buffer) / 4 - 4;
+    }
+
+    return words * 4;
+}
+
+/**
+ * Send a message into a slot granted before
+ *
+ * The message is streamed in a single packet, no allocation or completion
+ * is required. The caller must have taken a credit of the endpoint handle
+ * and the message must not exceed control_msg_send_maxsize().
+ */
+void control_msg_send(struct endpoint_handle *ep, void* buffer, uint32_t size) {
+    uint32_t hdr[4];
+    uint32_t words = (size+3)>>2;
+
+    trace_msg_data_begin(ep, -1, size);
+
+    hdr[0] = (ep->domain << OPTIMSOC_DEST_LSB) |
+            (NOC_CLASS_MP << OPTIMSOC_CLASS_LSB) |
+            (optimsoc_get_tileid() << OPTIMSOC_SRC_LSB) |
+            (CTRL_REQUEST_MSG_SEND << CTRL_REQUEST_LSB);
+    hdr[1] = (unsigned int) ep->ep;
+    hdr[2] = (unsigned int) ep;
+    hdr[3] = size;
+
+    trace_msg_data_send(ep, -1, words);
+
+    if (((size & 0x3) == 0) && (((uint32_t) buffer & 0x3) == 0)) {
+        // Send the payload straight from the user buffer
+        optimsoc_mp_simple_send_hdr(0, 4, hdr, words, (uint32_t*) buffer);
+    } else {
+        uint32_t payload[sizeof(ctrl_request.buffer) / 4 - 4];
+        memcpy(payload, buffer, size);
+        optimsoc_mp_simple_send_hdr(0, 4, hdr, words, payload);
+    }
+
+    trace_msg_data_end(ep);
+}
+
+/**
+ * Return message slot credit to the sender handle owner at tile
+ */
+void control_msg_credit(uint32_t tile, uint32_t owner, uint32_t credit) {
+    uint32_t buffer[3];
+
+    buffer[0] = (tile << OPTIMSOC_DEST_LSB) |
+            (NOC_CLASS_MP << OPTIMSOC_CLASS_LSB) |
+            (optimsoc_get_tileid() << OPTIMSOC_SRC_LSB) |
+            (CTRL_REQUEST_MSG_CREDIT << CTRL_REQUEST_LSB);
+    buffer[1] = owner;
+    buffer[2] = credit;
+
+    optimsoc_mp_simple_send(0, 3, buffer);
+}
+
 uint32_t control_channel_connect(struct endpoint_handle *from,
                                  struct endpoint_handle *to) {
     ctrl_request.buffer[0] = (to->domain << OPTIMSOC_DEST_LSB) |
@@ -339,6 +461,12 @@ uint32_t control_channel_connect(struct endpoint_handle *from,
 
     control_wait_response();
 
+    // Remember the receive buffer layout for direct transfers
+    from->ep->remotebuffer = ctrl_request.buffer[2];
+    from->ep->remoteelementsize = ctrl_request.buffer[3] >> 16;
+    from->ep->remotesize = ctrl_request.buffer[3] & 0xffff;
+    from->ep->remoteptr = ctrl_request.buffer[4];
+
     return ctrl_request.buffer[1];
 }
 
@@ -354,7 +482,7 @@ void control_channel_send(struct endpoint_handle *ep, uint8_t *data, uint32_t si
         ctrl_request.buffer[1] = (unsigned int) ep->ep;
         ctrl_request.buffer[2] = i;
         if (((i+wordsperpacket) >= words)) {
-            ctrl_request.buffer[3] = size - i * wordsperpacket;
+            ctrl_request.buffer[3] = size - i * 4;
         } else {
             ctrl_request.buffer[3] = 0;
         }
@@ -371,6 +499,24 @@ void control_channel_send(struct endpoint_handle *ep, uint8_t *data, uint32_t si
     }
 }
 
+/**
+ * Signal a packet written to slot ptr with DMA to the receiver
+ */
+void control_channel_dma_complete(struct endpoint_handle *ep, uint32_t ptr,
+                                  uint32_t size) {
+    uint32_t buffer[4];
+
+    buffer[0] = (ep->domain << OPTIMSOC_DEST_LSB) |
+            (NOC_CLASS_MP << OPTIMSOC_CLASS_LSB) |
+            (optimsoc_get_tileid() << OPTIMSOC_SRC_LSB) |
+            (CTRL_REQUEST_CHAN_DMA_COMPLETE << CTRL_REQUEST_LSB);
+    buffer[1] = (unsigned int) ep->ep;
+    buffer[2] = ptr;
+    buffer[3] = size;
+
+    optimsoc_mp_simple_send(0, 4, buffer);
+}
+
 void control_channel_sendcredit(struct endpoint_handle *ep, int32_t credit) {
     ctrl_request.buffer[0] = (ep->ep->remotedomain << OPTIMSOC_DEST_LSB) |
             (NOC_CLASS_MP << OPTIMSOC_CLASS_LSB) |
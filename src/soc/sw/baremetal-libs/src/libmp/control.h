@@ -28,9 +28,9 @@ struct {
 #define CTRL_REQUEST_CHAN_CONNECT_RESP    7
 #define CTRL_REQUEST_CHAN_DATA            8
 #define CTRL_REQUEST_CHAN_CREDIT          9
-#define CTRL_REQUEST_10                   10
-#define CTRL_REQUEST_11                   11
-#define CTRL_REQUEST_12                   12
+#define CTRL_REQUEST_MSG_SEND            10
+#define CTRL_REQUEST_MSG_CREDIT          11
+#define CTRL_REQUEST_CHAN_DMA_COMPLETE   12
 #define CTRL_REQUEST_13                   13
 #define CTRL_REQUEST_14                   14
 #define CTRL_REQUEST_15                   15
@@ -44,12 +44,19 @@ void control_init();
 
 struct endpoint *control_get_endpoint(uint32_t domain, uint32_t node,
                                       uint32_t port);
+// Returned by control_msg_alloc() if the message exceeds the endpoint
+#define CONTROL_MSG_ALLOC_TOOLARGE 0xffffffff
 uint32_t control_msg_alloc(struct endpoint_handle *eph, uint32_t size);
 void control_msg_data(struct endpoint_handle *ep, uint32_t address, void* buffer,
                       uint32_t size);
+uint32_t control_msg_send_maxsize();
+void control_msg_send(struct endpoint_handle *ep, void* buffer, uint32_t size);
+void control_msg_credit(uint32_t tile, uint32_t owner, uint32_t credit);
 
 uint32_t control_channel_connect(struct endpoint_handle *from, struct endpoint_handle *to);
 void control_channel_send(struct endpoint_handle *ep, uint8_t *data, uint32_t size);
+void control_channel_dma_complete(struct endpoint_handle *ep, uint32_t ptr,
+                                  uint32_t size);
 void control_channel_sendcredit(struct endpoint_handle *ep, int32_t credit);
 
 ///////////////////////////////////////////////////////////////////////////////
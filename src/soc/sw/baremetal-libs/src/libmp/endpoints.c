@@ -4,35 +4,133 @@
 #include <stdlib.h>
 #include <assert.h>
 
-// The endpoint handles are stored in a linked list with this element
-struct endpoint_handle_listelem {
-    struct endpoint_handle_listelem *next;
-    struct endpoint_handle          *handle;
-};
+// Endpoints, their buffers and the handles are allocated from pools
+static struct optimsoc_slab endpoint_slab =
+        OPTIMSOC_SLAB_INIT("endpoint", sizeof(struct endpoint), 8);
+static struct optimsoc_slab endpoint_buffer_slab =
+        OPTIMSOC_SLAB_INIT("endpoint_buffer", sizeof(struct endpoint_buffer), 8);
+static struct optimsoc_slab endpoint_handle_slab =
+        OPTIMSOC_SLAB_INIT("endpoint_handle", sizeof(struct endpoint_handle), 16);
 
-// Pointers to the actual list
-struct endpoint_handle_listelem *eplist_first;
-struct endpoint_handle_listelem *eplist_last;
+// The endpoint handles are stored in an open-addressed hash table keyed by
+// (domain, node, port). Deleted entries are marked so that probing
+// continues past them.
+#define EPTABLE_DELETED ((struct endpoint_handle *) 1)
+
+struct endpoint_handle *eptable[EPTABLE_SIZE];
+
+// Number of handles (and deleted markers) in the table
+unsigned int eptable_used;
+
+// Number of handles per port and a bitmap of the ports in use, to find a
+// free port number without scanning the endpoints
+uint16_t eptable_portrefs[MAX_ENDPOINTS];
+uint32_t eptable_portmap[(MAX_ENDPOINTS + 31) / 32];
 
 // Counters of local and remote endpoints
 unsigned int eplist_localnum;
 unsigned int eplist_remotenum;
 
+static inline uint32_t eptable_hash(unsigned int domain, unsigned int node,
+                                    unsigned int port) {
+    uint32_t h = (domain * 0x9e3779b1) ^ (node * 0x85ebca77) ^
+            (port * 0xc2b2ae3d);
+    h ^= h >> 15;
+    return h & (EPTABLE_SIZE - 1);
+}
+
+// Find the table index of a handle, or -1 if not found
+static int eptable_find(unsigned int domain, unsigned int node,
+                        unsigned int port) {
+    uint32_t idx = eptable_hash(domain, node, port);
+
+    for (int i = 0; i < EPTABLE_SIZE; i++) {
+        struct endpoint_handle *eph = eptable[idx];
+        if (eph == 0) {
+            return -1;
+        }
+        if ((eph != EPTABLE_DELETED) &&
+                (eph->domain == domain) &&
+                (eph->node == node) &&
+                (eph->port == port)) {
+            return idx;
+        }
+        idx = (idx + 1) & (EPTABLE_SIZE - 1);
+    }
+
+    return -1;
+}
+
+static void eptable_port_ref(unsigned int port) {
+    if (port >= MAX_ENDPOINTS) {
+        return;
+    }
+
+    if (eptable_portrefs[port]++ == 0) {
+        eptable_portmap[port / 32] |= 1 << (port % 32);
+    }
+}
+
+static void eptable_port_unref(unsigned int port) {
+    if (port >= MAX_ENDPOINTS) {
+        return;
+    }
+
+    if (--eptable_portrefs[port] == 0) {
+        eptable_portmap[port / 32] &= ~(1 << (port % 32));
+    }
+}
+
+// Rebuild the table without the deleted markers
+static void eptable_rehash(void) {
+    unsigned int num = eplist_localnum + eplist_remotenum;
+    struct endpoint_handle **live = malloc(num * sizeof(struct endpoint_handle*));
+    assert(live || (num == 0));
+
+    unsigned int n = 0;
+    for (int i = 0; i < EPTABLE_SIZE; i++) {
+        if ((eptable[i] != 0) && (eptable[i] != EPTABLE_DELETED)) {
+            live[n++] = eptable[i];
+        }
+        eptable[i] = 0;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint32_t idx = eptable_hash(live[i]->domain, live[i]->node,
+                                    live[i]->port);
+        while (eptable[idx] != 0) {
+            idx = (idx + 1) & (EPTABLE_SIZE - 1);
+        }
+        eptable[idx] = live[i];
+    }
 
-// Add an endpoint to the list by its handle
+    eptable_used = n;
+    free(live);
+}
+
+// Add an endpoint to the table by its handle
 int endpoint_add(struct endpoint_handle *ep) {
-    struct endpoint_handle_listelem *e = malloc(sizeof(struct endpoint_handle_listelem));
-    e->handle = ep;
-    e->next = 0;
+    // Keep the load low enough for short probe sequences
+    if (eptable_used >= EPTABLE_SIZE - EPTABLE_SIZE / 4) {
+        if (eplist_localnum + eplist_remotenum < eptable_used) {
+            eptable_rehash();
+        } else {
+            return -1;
+        }
+    }
 
-    if (eplist_first==0) {
-        eplist_first = e;
-        eplist_last = e;
-    } else {
-        eplist_last->next = e;
-        eplist_last = e;
+    uint32_t idx = eptable_hash(ep->domain, ep->node, ep->port);
+    while ((eptable[idx] != 0) && (eptable[idx] != EPTABLE_DELETED)) {
+        idx = (idx + 1) & (EPTABLE_SIZE - 1);
     }
 
+    if (eptable[idx] == 0) {
+        eptable_used++;
+    }
+    eptable[idx] = ep;
+
+    eptable_port_ref(ep->port);
+
     if (ep->type == LOCAL) {
         eplist_localnum++;
     } else {
@@ -42,20 +140,15 @@ int endpoint_add(struct endpoint_handle *ep) {
     return 0;
 }
 
-// Get an endpoint from the list by its metainformation
+// Get an endpoint from the table by its metainformation
 struct endpoint_handle *endpoint_get(unsigned int domain, unsigned int node,
                                      unsigned int port) {
     struct endpoint_handle *eph = 0;
 
     // Try to find endpoint in local database
-    struct endpoint_handle_listelem *lit;
-    for (lit=eplist_first;lit!=0;lit=lit->next) {
-        if ((lit->handle->domain == domain) &&
-                (lit->handle->node == node) &&
-                (lit->handle->port == port)) {
-            eph = lit->handle;
-            break;
-        }
+    int idx = eptable_find(domain, node, port);
+    if (idx >= 0) {
+        eph = eptable[idx];
     }
 
     if (eph == 0 && (domain != optimsoc_get_tileid())) {
@@ -63,15 +156,20 @@ struct endpoint_handle *endpoint_get(unsigned int domain, unsigned int node,
         struct endpoint *ep = control_get_endpoint(domain, node, port);
         // Create the respective handle
 
-        eph = malloc(sizeof(struct endpoint_handle));
+        eph = optimsoc_slab_alloc(&endpoint_handle_slab);
+        assert(eph);
         eph->domain = domain;
         eph->node = node;
         eph->port = port;
         eph->ep = ep;
         eph->type = REMOTE;
+        eph->msgcredit = 0;
+        eph->msgmaxsize = 0;
 
-        endpoint_add(eph);
-
+        if (endpoint_add(eph) != 0) {
+            optimsoc_slab_free(&endpoint_handle_slab, eph);
+            return 0;
+        }
     }
 
     return eph;
@@ -79,62 +177,50 @@ struct endpoint_handle *endpoint_get(unsigned int domain, unsigned int node,
 
 /// Verify that endpoint handle is valid
 struct endpoint_handle *endpoint_verify(struct endpoint_handle *eph) {
-    struct endpoint_handle_listelem *lit;
-    for (lit=eplist_first;lit!=0;lit=lit->next) {
-        if (lit->handle == eph) {
-            return eph;
-        }
+    if ((eph == 0) || (eph == EPTABLE_DELETED)) {
+        return 0;
+    }
+
+    // The handle is only valid if it is the one stored for its key
+    int idx = eptable_find(eph->domain, eph->node, eph->port);
+    if ((idx >= 0) && (eptable[idx] == eph)) {
+        return eph;
     }
 
     return 0;
 }
 
-// Delete an endpoint from the list
+// Delete an endpoint from the table
 void endpoint_delete(struct endpoint_handle *eph) {
-    struct endpoint_handle_listelem *lit;
+    int idx = eptable_find(eph->domain, eph->node, eph->port);
+    if ((idx < 0) || (eptable[idx] != eph)) {
+        return;
+    }
+
+    eptable[idx] = EPTABLE_DELETED;
+    eptable_port_unref(eph->port);
 
     if (eph->type==LOCAL) {
         eplist_localnum--;
     } else {
         eplist_remotenum--;
     }
-
-    if (eplist_first->handle == eph) {
-        free(eplist_first);
-        if (eplist_first==eplist_last) {
-            eplist_first = 0;
-            eplist_last = 0;
-        } else {
-            eplist_first = eplist_first->next;
-        }
-        return;
-    }
-
-    for (lit = eplist_first;lit != 0;lit=lit->next) {
-        if (lit->next &&
-                (lit->next->handle == eph) ) {
-            free(lit->next);
-            lit->next = lit->next->next;
-            return;
-        }
-        lit = lit->next;
-    }
 }
 
 int endpoint_generate_portnum(unsigned int *port) {
-    struct endpoint_handle_listelem *lit;
-    for (uint32_t p = 0;p<MAX_ENDPOINTS;p++) {
-        unsigned int found = 0;
-        for (lit=eplist_first;lit!=0;lit=lit->next) {
-            if (lit->handle->port == p) {
-                found = 1;
-                break;
-            }
+    for (uint32_t w = 0; w < (MAX_ENDPOINTS + 31) / 32; w++) {
+        uint32_t unused = ~eptable_portmap[w];
+        if (unused == 0) {
+            continue;
         }
-        if (found==0) {
-            *port = p;
-            return 0;
+
+        uint32_t p = w * 32 + __builtin_ctz(unused);
+        if (p >= MAX_ENDPOINTS) {
+            break;
         }
+
+        *port = p;
+        return 0;
     }
 
     return -1;
@@ -145,9 +231,17 @@ unsigned int endpoints_localnum() {
 }
 
 void endpoints_init() {
-    // Initialize endpoint list
-    eplist_first = 0;
-    eplist_last = 0;
+    // Initialize endpoint table
+    for (int i = 0; i < EPTABLE_SIZE; i++) {
+        eptable[i] = 0;
+    }
+    for (int p = 0; p < MAX_ENDPOINTS; p++) {
+        eptable_portrefs[p] = 0;
+    }
+    for (int w = 0; w < (MAX_ENDPOINTS + 31) / 32; w++) {
+        eptable_portmap[w] = 0;
+    }
+    eptable_used = 0;
     eplist_localnum = 0;
     eplist_remotenum = 0;
 }
@@ -157,18 +251,12 @@ struct endpoint_handle *endpoint_create(uint32_t node, uint32_t port,
                                         uint32_t buffer_size,
                                         int overwrite_max_size) {
 
-    struct endpoint *ep = malloc(sizeof(struct endpoint));
+    struct endpoint *ep = optimsoc_slab_alloc(&endpoint_slab);
     assert(ep!=0);
 
-    ep->buffer = calloc(1, sizeof(struct endpoint_buffer));
+    ep->buffer = optimsoc_slab_zalloc(&endpoint_buffer_slab);
     assert(ep->buffer != 0);
 
-    ep->buffer->data = malloc(buffer_size * sizeof(uint32_t*));
-    assert(ep->buffer->data != 0);
-
-    ep->buffer->data_size = malloc(buffer_size * sizeof(uint32_t*));
-    assert(ep->buffer->data_size != 0);
-
     uint32_t max_element_size_bytes;
     uint32_t max_element_size_words;
 
@@ -184,33 +272,52 @@ struct endpoint_handle *endpoint_create(uint32_t node, uint32_t port,
 
     max_element_size_words = (max_element_size_bytes + 3) >> 2;
 
-    uint32_t *datafield = malloc(max_element_size_bytes * buffer_size);
-    assert(datafield);
+    // The per-slot arrays and the data share one allocation: data
+    // pointers, data sizes, credit owners and tiles, then the elements
+    uint32_t *slots = calloc(buffer_size * (4 + max_element_size_words),
+                             sizeof(uint32_t));
+    assert(slots);
+
+    ep->buffer->data = (volatile uint32_t**) &slots[0];
+    ep->buffer->data_size = &slots[buffer_size];
+    ep->buffer->credit_owner = &slots[2 * buffer_size];
+    ep->buffer->credit_tile = &slots[3 * buffer_size];
+
+    uint32_t *datafield = &slots[4 * buffer_size];
 
     int i;
     for (i = 0; i < buffer_size; i++) {
         ep->buffer->data[i] = &datafield[i*max_element_size_words];
     }
 
+    ep->buffer->type = buffer_type;
+    ep->buffer->max_element_size = max_element_size_words << 2;
     ep->buffer->size = buffer_size;
     ep->buffer->write_ptr = 0;
     ep->buffer->read_ptr = 0;
 
+    // One slot always stays empty to distinguish a full from an empty buffer
+    ep->localcredit = buffer_size - 1;
+
 #ifdef RUNTIME
     ep->waiting_thread = 0;
 #endif
 
 
-    struct endpoint_handle *eph = malloc(sizeof(struct endpoint_handle));
+    struct endpoint_handle *eph = optimsoc_slab_alloc(&endpoint_handle_slab);
     assert(eph!=0);
 
     eph->ep = ep;
+    eph->type = LOCAL;
     eph->domain = optimsoc_get_tileid();
     eph->node = node;
     eph->port = port;
+    eph->msgcredit = 0;
+    eph->msgmaxsize = ep->buffer->max_element_size;
 
     trace_ep_create(ep);
-    endpoint_add(eph);
+    int rv = endpoint_add(eph);
+    assert(rv == 0);
 
     return eph;
 }
@@ -249,6 +356,69 @@ int endpoint_empty(struct endpoint *ep) {
     return !endpoint_msg_available(ep);
 }
 
+/**
+ * Block until the endpoint is not empty
+ *
+ * With the runtime system the calling thread is suspended on the endpoint
+ * and resumed by endpoint_wakeup() from the message handler. Only one
+ * thread can wait on an endpoint, further threads yield until the
+ * endpoint is not empty.
+ */
+void endpoint_wait(struct endpoint *ep) {
+#ifdef RUNTIME
+    // Interrupts are disabled so that the thread is not preempted between
+    // registering as waiting and suspending, the wakeup waits for that.
+    // The message handler may run on another core, the waiting thread is
+    // therefore published before the endpoint is checked again.
+    uint32_t restore = or1k_critical_begin();
+
+    while (endpoint_empty(ep)) {
+        optimsoc_thread_t current = optimsoc_thread_current();
+
+        if (or1k_sync_cas((void*) &ep->waiting_thread, 0,
+                          (uint32_t) current) != 0) {
+            or1k_critical_end(restore);
+            optimsoc_thread_yield(current);
+            restore = or1k_critical_begin();
+            continue;
+        }
+
+        if (!endpoint_empty(ep)) {
+            // A message arrived meanwhile. Withdraw, unless the wakeup
+            // already took us and resumes us once suspended.
+            if (or1k_sync_cas((void*) &ep->waiting_thread,
+                              (uint32_t) current, 0) == (uint32_t) current) {
+                break;
+            }
+        }
+
+        optimsoc_thread_suspend(current);
+    }
+
+    or1k_critical_end(restore);
+#else
+    while (endpoint_empty(ep)) { }
+#endif
+}
+
+/**
+ * Resume the thread waiting for the endpoint, if any
+ *
+ * Called from the message handler when a message or packet completed. The
+ * waiting thread may run on another core and still be on its way into the
+ * suspension.
+ */
+void endpoint_wakeup(struct endpoint *ep) {
+#ifdef RUNTIME
+    optimsoc_thread_t thread = ep->waiting_thread;
+
+    if (thread && (or1k_sync_cas((void*) &ep->waiting_thread,
+                                 (uint32_t) thread, 0) == (uint32_t) thread)) {
+        optimsoc_thread_wakeup(thread);
+    }
+#endif
+}
+
 int endpoint_full(struct endpoint *ep) {
     if (ep->buffer->write_ptr >= ep->buffer->read_ptr) {
         return ((ep->buffer->write_ptr - ep->buffer->read_ptr) == ep->buffer->size-1);
@@ -257,32 +427,141 @@ int endpoint_full(struct endpoint *ep) {
     }
 }
 
-int endpoint_alloc(struct endpoint *ep, uint32_t size, uint32_t *ptr) {
+// Take credit from the pool of free slots, returns the number taken
+static uint32_t endpoint_localcredit_take(struct endpoint *ep, uint32_t max,
+                                          uint32_t reserve) {
+    uint32_t oldcredit, take;
 
-    if (ep->buffer->type == MESSAGE) {
-        if (size > MAX_MESSAGE_SIZE) {
-            return -1;
+    do {
+        oldcredit = ep->localcredit;
+        if (oldcredit <= reserve) {
+            return 0;
         }
-    } else {
-        if (size > MAX_PACKET_SIZE) {
-            return -1;
+        take = oldcredit - reserve;
+        if (take > max) {
+            take = max;
         }
+    } while (or1k_sync_cas((void*) &ep->localcredit, oldcredit,
+                           oldcredit - take) != oldcredit);
+
+    return take;
+}
+
+static void endpoint_localcredit_add(struct endpoint *ep, uint32_t credit) {
+    uint32_t oldcredit;
+
+    do {
+        oldcredit = ep->localcredit;
+    } while (or1k_sync_cas((void*) &ep->localcredit, oldcredit,
+                           oldcredit + credit) != oldcredit);
+}
+
+int endpoint_alloc(struct endpoint *ep, uint32_t size, uint32_t *ptr) {
+
+    if (size > ep->buffer->max_element_size) {
+        return -1;
+    }
+
+    // Slots granted to senders are not free, even if the buffer is not full
+    if (endpoint_localcredit_take(ep, 1, 0) == 0) {
+        // Return error
+        return -1;
     }
 
-    if (!endpoint_full(ep)) {
-        // The sender can write to this address
-        endpoint_push(ep, ptr);
+    // The slot is not owned by a sender, the credit returns to the pool
+    ep->buffer->credit_owner[ep->buffer->write_ptr] = 0;
+
+    // Zero size (will also signal completeness)
+    ep->buffer->data_size[ep->buffer->write_ptr] = 0;
+
+    // The sender can write to this address
+    endpoint_push(ep, ptr);
 
-        // Zero size (will also signal completeness)
-        ep->buffer->data_size[*ptr] = 0;
+    // Return acknowledge
+    return 0;
+}
 
-        // Return acknowledge
+/**
+ * Grant message slots to a sender
+ *
+ * The sender can then send up to the granted number of messages without
+ * allocating a slot first. The slots are returned to the sender when the
+ * messages are received.
+ *
+ * Returns the number of granted slots.
+ */
+uint32_t endpoint_msg_credit_grant(struct endpoint *ep, uint32_t requested) {
+    if (ep->buffer->type != MESSAGE) {
         return 0;
+    }
+
+    return endpoint_localcredit_take(ep, requested, MSG_CREDIT_RESERVE);
+}
+
+/**
+ * Take one granted message slot at the sender
+ *
+ * Returns 1 if a slot was taken, 0 if there is no credit left.
+ */
+int endpoint_msg_credit_take(struct endpoint_handle *eph) {
+    uint32_t oldcredit;
+
+    do {
+        oldcredit = eph->msgcredit;
+        if (oldcredit == 0) {
+            return 0;
+        }
+    } while (or1k_sync_cas((void*) &eph->msgcredit, oldcredit,
+                           oldcredit - 1) != oldcredit);
+
+    return 1;
+}
+
+void endpoint_msg_credit_add(struct endpoint_handle *eph, uint32_t credit) {
+    uint32_t oldcredit;
+
+    do {
+        oldcredit = eph->msgcredit;
+    } while (or1k_sync_cas((void*) &eph->msgcredit, oldcredit,
+                           oldcredit + credit) != oldcredit);
+}
+
+// Return the credit for a received slot to its owner
+static void endpoint_msg_credit_return(struct endpoint *ep, uint32_t ptr) {
+    uint32_t owner = ep->buffer->credit_owner[ptr];
+
+    if (owner == 0) {
+        endpoint_localcredit_add(ep, 1);
     } else {
-        // Return error
-        return -1;
+        control_msg_credit(ep->buffer->credit_tile[ptr], owner, 1);
     }
+}
 
+/**
+ * Write a complete message into a granted slot
+ *
+ * This is called from the message handler only, which is the only writer
+ * of the buffer.
+ */
+void endpoint_msg_write(struct endpoint *ep, uint32_t tile, uint32_t owner,
+                        uint32_t *buffer, uint32_t size) {
+    if (size > ep->buffer->max_element_size) {
+        trace_ep_msg_drop(ep, size);
+        control_msg_credit(tile, owner, 1);
+        return;
+    }
+
+    uint32_t ptr = ep->buffer->write_ptr;
+
+    for (int i=0; i<((size+3)>>2); i++) {
+        ep->buffer->data[ptr][i] = buffer[i];
+    }
+    ep->buffer->credit_owner[ptr] = owner;
+    ep->buffer->credit_tile[ptr] = tile;
+    ep->buffer->data_size[ptr] = size;
+
+    endpoint_push(ep, &ptr);
+    endpoint_wakeup(ep);
 }
 
 void endpoint_write(struct endpoint *ep, uint32_t ptr, uint32_t offset,
@@ -295,6 +574,46 @@ void endpoint_write(struct endpoint *ep, uint32_t ptr, uint32_t offset,
 
 void endpoint_write_complete(struct endpoint *ep, uint32_t ptr, uint32_t size) {
     ep->buffer->data_size[ptr] = size;
+    endpoint_wakeup(ep);
+}
+
+/**
+ * A channel packet was written to the slot ptr directly (DMA)
+ */
+void endpoint_channel_write_complete(struct endpoint *ep, uint32_t ptr,
+                                     uint32_t size) {
+    // The sender tracks our write pointer, both must be in sync
+    assert(ptr == ep->buffer->write_ptr);
+
+    ep->buffer->data_size[ptr] = size;
+    endpoint_push(ep, &ptr);
+    trace_ep_bufferstate(ep, endpoint_channel_get_fillstate(ep));
+    endpoint_wakeup(ep);
+}
+
+/**
+ * Get the address of the next slot in the connected remote endpoint
+ *
+ * Only valid for the sender of a connected channel, where the sender is the
+ * only writer of the remote buffer and can track its write pointer.
+ */
+void *endpoint_channel_remote_slot(struct endpoint *ep, uint32_t *ptr) {
+    *ptr = ep->remoteptr;
+    return (void*) (ep->remotebuffer + ep->remoteptr * ep->remoteelementsize);
+}
+
+/**
+ * Follow the write pointer of the remote endpoint after a packet was sent
+ */
+void endpoint_channel_remote_advance(struct endpoint *ep) {
+    if (ep->remotesize == 0) {
+        return;
+    }
+
+    ep->remoteptr++;
+    if (ep->remoteptr >= ep->remotesize) {
+        ep->remoteptr = 0;
+    }
 }
 
 int endpoint_msg_available(struct endpoint *ep) {
@@ -310,7 +629,7 @@ int endpoint_msg_available(struct endpoint *ep) {
 void endpoint_msg_recv(struct endpoint *ep, uint32_t *buffer,
                        uint32_t buffer_size, uint32_t *received) {
 
-    while (!endpoint_msg_available(ep)) {}
+    endpoint_wait(ep);
 
     *received = ep->buffer->data_size[ep->buffer->read_ptr];
 
@@ -327,6 +646,9 @@ void endpoint_msg_recv(struct endpoint *ep, uint32_t *buffer,
     for(int i=0; i<wordsize; i++) {
         buffer[i] = ep->buffer->data[ptr][i];
     }
+
+    // The slot can be reused now
+    endpoint_msg_credit_return(ep, ptr);
 }
 
 uint32_t endpoint_channel_get_credit(struct endpoint *ep) {
@@ -13,6 +13,17 @@
 
 #define MAX_ENDPOINTS 100
 
+// Capacity of the endpoint handle table (power of two), of which at most
+// three quarters are used
+#define EPTABLE_SIZE 512
+
+// Message slots a receiver grants to a sender with one allocation, so that
+// the following messages can be sent without an allocation round trip
+#define MSG_CREDIT_GRANT   4
+// Message slots a receiver never grants, they are left for the allocation
+// protocol so that senders without credit always make progress
+#define MSG_CREDIT_RESERVE 1
+
 // The endpoint handle contains the metainformation of an endpoint
 // and a pointer to the actual endpoint if local
 struct endpoint_handle {
@@ -21,6 +32,10 @@ struct endpoint_handle {
     unsigned int   domain;
     unsigned int   node;
     unsigned int   port;
+    // Message slots pre-allocated for us at the remote endpoint
+    volatile uint32_t msgcredit;
+    // Maximum message size of the remote endpoint, 0 until it is known
+    uint32_t msgmaxsize;
 };
 
 typedef enum { MESSAGE = 0, CHANNEL = 1 } endpoint_buffer_type;
@@ -29,6 +44,11 @@ struct endpoint_buffer {
     volatile uint32_t     **data;
     volatile uint32_t     *data_size;
     endpoint_buffer_type  type;
+    uint32_t              max_element_size;
+    // Sender handle and tile to return the credit for a slot to, or 0 if
+    // the slot was allocated without credit
+    volatile uint32_t     *credit_owner;
+    volatile uint32_t     *credit_tile;
     volatile unsigned int size;
     volatile unsigned int read_ptr;
     volatile unsigned int write_ptr;
@@ -41,6 +61,14 @@ struct endpoint {
     uint32_t remotedomain;
     struct endpoint   *remote;
     volatile uint32_t remotecredit;
+    // Free message slots that are not granted to any sender
+    volatile uint32_t localcredit;
+    // Receive buffer of the connected endpoint, used by the channel sender
+    // to write packets directly with DMA
+    uint32_t remotebuffer;
+    uint32_t remoteelementsize;
+    uint32_t remotesize;
+    uint32_t remoteptr;
 #ifdef RUNTIME
     volatile optimsoc_thread_t waiting_thread;
 #endif
@@ -75,11 +103,22 @@ int endpoint_generate_portnum(unsigned int *port);
 unsigned int endpoints_localnum();
 
 int endpoint_alloc(struct endpoint *ep, uint32_t size, uint32_t *ptr);
+uint32_t endpoint_msg_credit_grant(struct endpoint *ep, uint32_t requested);
+int endpoint_msg_credit_take(struct endpoint_handle *eph);
+void endpoint_msg_credit_add(struct endpoint_handle *eph, uint32_t credit);
+void endpoint_msg_write(struct endpoint *ep, uint32_t tile, uint32_t owner,
+                        uint32_t *buffer, uint32_t size);
 void endpoint_write(struct endpoint *ep, uint32_t ptr, uint32_t offset,
                     uint32_t *buffer, uint32_t size);
 void endpoint_write_complete(struct endpoint *ep, uint32_t ptr, uint32_t size);
+void endpoint_channel_write_complete(struct endpoint *ep, uint32_t ptr,
+                                     uint32_t size);
+void *endpoint_channel_remote_slot(struct endpoint *ep, uint32_t *ptr);
+void endpoint_channel_remote_advance(struct endpoint *ep);
 
 int endpoint_empty(struct endpoint *ep);
+void endpoint_wait(struct endpoint *ep);
+void endpoint_wakeup(struct endpoint *ep);
 int endpoint_full(struct endpoint *ep);
 
 int endpoint_pop(struct endpoint *ep, uint32_t *ptr);
@@ -106,6 +145,7 @@ void endpoint_channel_add_credit(struct endpoint *ep, uint32_t credit);
 
 #define TRACE_EP_CREATE      0x380
 #define TRACE_EP_BUFFERSTATE 0x381
+#define TRACE_EP_MSG_DROP    0x382
 
 static inline void trace_ep_create(struct endpoint *ep) {
 #ifdef TRACE_ENABLE
@@ -121,6 +161,13 @@ static inline void trace_ep_bufferstate(struct endpoint *ep,
 #endif
 }
 
+static inline void trace_ep_msg_drop(struct endpoint *ep, uint32_t size) {
+#ifdef TRACE_ENABLE
+    OPTIMSOC_TRACE(TRACE_EP_MSG_DROP, ep);
+    OPTIMSOC_TRACE(TRACE_EP_MSG_DROP, size);
+#endif
+}
+
 #ifdef TRACE_ENABLE
 #undef TRACE_ENABLE
 #endif
@@ -72,19 +72,37 @@ typedef enum {
 
 #define OPTIMSOC_MP_CONF_DOMAINS 1
 
+/**
+ * Transfer large channel packets with the DMA
+ *
+ * If this flag is set in the attributes, channel packets of at least
+ * dma_threshold bytes are written directly into the receiver's endpoint
+ * buffer by the DMA controller of the tile instead of being pushed through
+ * the message passing buffers word by word. A packet must also fit into an
+ * element of the receiving endpoint, endpoints for packets larger than 64
+ * bytes are created with overwrite_max_size.
+ */
+#define OPTIMSOC_MP_ATTR_DMA 0x1
+
+/**
+ * Default minimum size of a channel packet to be transferred with DMA, half
+ * the default element size of an endpoint
+ */
+#define OPTIMSOC_MP_DMA_THRESHOLD_DEFAULT 32
+
 /**
  * Configuration attributes
- *
- * Currently not used.
  */
 struct optimsoc_mp_attributes {
-    uint32_t flags;
+    uint32_t flags; /*!< Combination of OPTIMSOC_MP_ATTR_* flags */
+    uint32_t dma_threshold; /*!< Minimum size in bytes for DMA transfers,
+                                 0 for the default */
 };
 
 /**
  * Initialize the message passing subsystem
  *
- * \param attr Configuration attributes (currently ignored)
+ * \param attr Configuration attributes, or NULL for the defaults
  * \return 0 on success, an error code otherwise
  */
 int optimsoc_mp_initialize(struct optimsoc_mp_attributes* attr);
@@ -28,6 +28,9 @@ enum {
     OPTIMSOC_MP_DATA_DMA = 1
 } _optimsoc_mp_data;
 
+// Minimum size of channel packets sent with DMA
+uint32_t _optimsoc_mp_dma_threshold;
+
 int optimsoc_mp_initialize(struct optimsoc_mp_attributes *attr) {
 
     // Initialize endpoints
@@ -39,6 +42,58 @@ int optimsoc_mp_initialize(struct optimsoc_mp_attributes *attr) {
     _optimsoc_mp_control = OPTIMSOC_MP_CONTROL_FIFO;
     _optimsoc_mp_data = OPTIMSOC_MP_DATA_FIFO;
 
+    if (attr && (attr->flags & OPTIMSOC_MP_ATTR_DMA)) {
+        _optimsoc_mp_data = OPTIMSOC_MP_DATA_DMA;
+        _optimsoc_mp_dma_threshold = attr->dma_threshold;
+        if (_optimsoc_mp_dma_threshold == 0) {
+            _optimsoc_mp_dma_threshold = OPTIMSOC_MP_DMA_THRESHOLD_DEFAULT;
+        }
+#ifndef RUNTIME
+        // The runtime system initializes the DMA on boot
+        dma_init();
+#endif
+    }
+
+    return 0;
+}
+
+/*
+ * Write a channel packet directly into the receive buffer of the remote
+ * endpoint with DMA
+ *
+ * Returns 0 on success, or -1 if the packet must be sent via the FIFO.
+ */
+static int _optimsoc_mp_channel_send_dma(struct endpoint_handle *from,
+                                         struct endpoint_handle *to,
+                                         uint8_t* buffer,
+                                         uint32_t size) {
+    if ((_optimsoc_mp_data != OPTIMSOC_MP_DATA_DMA) ||
+            (size < _optimsoc_mp_dma_threshold) ||
+            (size > from->ep->remoteelementsize) ||
+            ((uint32_t) buffer & 0x3)) {
+        return -1;
+    }
+
+    uint32_t ptr;
+    void *remote = endpoint_channel_remote_slot(from->ep, &ptr);
+
+#ifdef RUNTIME
+    optimsoc_dma_transfer(buffer, to->domain, remote, (size+3) & ~0x3,
+                          LOCAL2REMOTE);
+#else
+    dma_transfer_handle_t slot;
+    if (dma_alloc(&slot) != DMA_SUCCESS) {
+        return -1;
+    }
+
+    dma_transfer(buffer, to->domain, remote, (size+3)>>2, LOCAL2REMOTE, slot);
+    dma_wait(slot);
+    dma_free(slot);
+#endif
+
+    // The data is in place, let the receiver publish it
+    control_channel_dma_complete(to, ptr, size);
+
     return 0;
 }
 
@@ -90,6 +145,14 @@ int optimsoc_mp_channel_connect(struct endpoint_handle *from,
 
     // Get credit from remote
     endpoint_channel_add_credit(from->ep, control_channel_connect(from, to));
+
+    if ((_optimsoc_mp_data == OPTIMSOC_MP_DATA_DMA) &&
+            (_optimsoc_mp_dma_threshold > from->ep->remoteelementsize)) {
+        printf("DMA threshold %u exceeds element size %u of %p, "
+               "no packet uses DMA\n",
+               (unsigned int) _optimsoc_mp_dma_threshold,
+               (unsigned int) from->ep->remoteelementsize, to);
+    }
     trace_chan_conn_end(from, to);
     return 0;
 }
@@ -100,11 +163,7 @@ int optimsoc_mp_channel_recv(struct endpoint_handle *eph,
     int ret = 0;
     uint32_t read_ptr;
 
-    while(endpoint_empty(eph->ep)) {
-#ifdef RUNTIME
-        optimsoc_thread_yield(optimsoc_thread_current());
-#endif
-    }
+    endpoint_wait(eph->ep);
 
     endpoint_pop(eph->ep, &read_ptr);
     trace_ep_bufferstate(eph->ep, endpoint_channel_get_fillstate(eph->ep));
@@ -158,12 +217,10 @@ int optimsoc_mp_channel_send(struct endpoint_handle *from,
 
     trace_chan_send_xmit(from);
 
-    if (_optimsoc_mp_data == OPTIMSOC_MP_DATA_FIFO) {
+    if (_optimsoc_mp_channel_send_dma(from, to, buffer, size) != 0) {
         control_channel_send(to, buffer, size);
-    } else {
-//        dma_transfer()
-//        control_channel_send(to, buffer, size);
     }
+    endpoint_channel_remote_advance(from->ep);
 
     trace_chan_send_end(from);
 
@@ -182,6 +239,7 @@ int optimsoc_mp_channel_send_i(struct endpoint_handle *from,
     }
 
     control_channel_send(to, buffer, size);
+    endpoint_channel_remote_advance(from->ep);
 
     // TODO: CAS!
     from->ep->remotecredit--;
@@ -193,7 +251,25 @@ int optimsoc_mp_msg_send(optimsoc_mp_endpoint_handle from,
                          optimsoc_mp_endpoint_handle to, uint8_t *data,
                          uint32_t size) {
 
+    // The receiver reports its maximum message size with the first
+    // allocation, larger messages are never accepted
+    if ((to->msgmaxsize != 0) && (size > to->msgmaxsize)) {
+        return OPTIMSOC_MP_ERROR_BUFFEROVERFLOW;
+    }
+
+    // Small messages go into a slot granted by the receiver with a single
+    // packet. Without credit, a slot is allocated first, which also asks
+    // the receiver for credit for the next messages.
+    if ((size <= control_msg_send_maxsize()) &&
+            endpoint_msg_credit_take(to)) {
+        control_msg_send(to, data, size);
+        return 0;
+    }
+
     uint32_t addr = control_msg_alloc(to, size);
+    if (addr == CONTROL_MSG_ALLOC_TOOLARGE) {
+        return OPTIMSOC_MP_ERROR_BUFFEROVERFLOW;
+    }
 
     control_msg_data(to, addr, data, size);
 
@@ -206,12 +282,6 @@ int optimsoc_mp_msg_recv(optimsoc_mp_endpoint_handle eph, uint8_t *buffer,
 
     // TODO: This needs to be extended as another thread may picked up
     // the data from the endpoint
-    while(endpoint_empty(eph->ep)) {
-#ifdef RUNTIME
-        optimsoc_thread_yield(optimsoc_thread_current());
-#endif
-    }
-
     endpoint_msg_recv(eph->ep, (uint32_t*) buffer, buffer_size, received_size);
 
     return ret;
@@ -24,6 +24,8 @@
 
 unsigned int runtime_config_use_globalids = 0;
 unsigned int runtime_config_ticks = 100;
+unsigned int runtime_config_tickless = 0;
+unsigned int runtime_config_tlb_tagging = 0;
 
 void runtime_config_set_use_globalids(unsigned int v) {
     runtime_config_use_globalids = v;
@@ -40,3 +42,19 @@ void runtime_config_set_numticks(unsigned int ticks) {
 unsigned int runtime_config_get_numticks() {
     return runtime_config_ticks;
 }
+
+void runtime_config_set_tickless(unsigned int v) {
+    runtime_config_tickless = v;
+}
+
+unsigned int runtime_config_get_tickless() {
+    return runtime_config_tickless;
+}
+
+void runtime_config_set_tlb_tagging(unsigned int v) {
+    runtime_config_tlb_tagging = v;
+}
+
+unsigned int runtime_config_get_tlb_tagging() {
+    return runtime_config_tlb_tagging;
+}
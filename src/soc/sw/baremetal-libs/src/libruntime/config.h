@@ -26,3 +26,7 @@ extern void runtime_config_set_use_globalids(unsigned int v);
 extern unsigned int runtime_config_get_use_globalids();
 extern void runtime_config_set_numticks(unsigned int ticks);
 extern unsigned int runtime_config_get_numticks();
+extern void runtime_config_set_tickless(unsigned int v);
+extern unsigned int runtime_config_get_tickless();
+extern void runtime_config_set_tlb_tagging(unsigned int v);
+extern unsigned int runtime_config_get_tlb_tagging();
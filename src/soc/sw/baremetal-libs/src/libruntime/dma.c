@@ -1,20 +1,31 @@
 #include "include/optimsoc-runtime.h"
 #include "optimsoc-baremetal.h"
+#include "runtime.h"
 
 void optimsoc_dma_transfer(void *local, uint32_t remote_tile, void *remote,
                            size_t size, dma_direction_t dir)
 {
-    dma_transfer_handle_t dma_handle;
-
-    /* allocate transfer handle */
-    while(dma_alloc(&dma_handle) != DMA_SUCCESS) {
-        optimsoc_thread_yield(optimsoc_thread_current());
-    }
+    struct dma_sg_entry entry;
+    struct dma_chain chain;
 
     assert(size % 4 == 0);
-    dma_transfer(local, remote_tile, remote, size/4, dir, dma_handle);
 
-    dma_wait(dma_handle);
+    entry.local = local;
+    entry.remote_tile = remote_tile;
+    entry.remote = remote;
+    entry.size = size/4;
+    entry.dir = dir;
 
-    dma_free(dma_handle);
+    dma_chain_start(&chain, &entry, 1, NULL, NULL);
+
+    _optimsoc_dma_chain_wait(&chain);
+}
+
+void _optimsoc_dma_chain_wait(struct dma_chain *chain)
+{
+    /* let other threads run while the transfer is in flight */
+    while (!dma_chain_done(chain)) {
+        optimsoc_thread_yield(optimsoc_thread_current());
+        dma_process();
+    }
 }
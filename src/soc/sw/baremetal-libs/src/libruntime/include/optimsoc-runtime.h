@@ -95,6 +95,23 @@ optimsoc_page_dir_t optimsoc_vmm_create_page_dir(void);
 int optimsoc_vmm_map(optimsoc_page_dir_t directory, uint32_t vaddr,
                      uint32_t paddr);
 
+/**
+ * Map a range of contiguous physical pages
+ *
+ * Maps npages pages starting at vaddr to the physical pages starting at
+ * paddr. The page table is looked up once per table instead of once per
+ * page, which makes this considerably faster than mapping the pages one by
+ * one with optimsoc_vmm_map().
+ *
+ * @param directory Directory to add page mappings to
+ * @param vaddr Virtual address of the first page
+ * @param paddr Physical address of the first page
+ * @param npages Number of pages to map
+ * @return Number of pages that were mapped
+ */
+int optimsoc_vmm_map_range(optimsoc_page_dir_t directory, uint32_t vaddr,
+                           uint32_t paddr, uint32_t npages);
+
 /**
  * Remove a page from directory
  *
@@ -119,13 +136,43 @@ int optimsoc_vmm_unmap(optimsoc_page_dir_t directory, uint32_t vaddr);
 int optimsoc_vmm_virt2phys(optimsoc_page_dir_t directory, uint32_t vaddr,
                            uint32_t *paddr);
 
+/**
+ * Physically contiguous part of a virtual address range
+ */
+struct optimsoc_vmm_segment {
+    /*! Physical start address */
+    uint32_t paddr;
+    /*! Size in bytes */
+    uint32_t size;
+};
+
+/**
+ * Virtual to physical mapping of a range
+ *
+ * Translate the virtual address range [vaddr, vaddr+size) into physically
+ * contiguous segments. Adjacent pages that are also adjacent in physical
+ * memory are merged into one segment.
+ *
+ * @param directory Directory for lookup
+ * @param vaddr Virtual start address
+ * @param size Size of the range in bytes
+ * @param[out] segments Physical segments of the range
+ * @param maxsegments Number of elements of segments
+ * @return Number of segments, 0 if a page of the range is not mapped and -1
+ *   if more than maxsegments segments are needed
+ */
+int optimsoc_vmm_virt2phys_range(optimsoc_page_dir_t directory,
+                                 uint32_t vaddr, uint32_t size,
+                                 struct optimsoc_vmm_segment *segments,
+                                 int maxsegments);
+
 /**
  * Physical to virtual mapping
  *
- * Find virtual address for a physical address. This is a very time consuming
- * operation, especially if the virtual address space is fully or sparsely
- * populated. It also only finds the first mapping, but may be usefull to
- * find and delete incorrect mappings.
+ * Find virtual address for a physical address. The virtual memory system
+ * keeps a reverse map of all mapped pages, so this is a hash lookup. If the
+ * physical page is mapped multiple times in the directory, any of the
+ * mappings is returned.
  *
  * @param directory Directory for lookup
  * @param paddr Physical address
@@ -135,6 +182,29 @@ int optimsoc_vmm_virt2phys(optimsoc_page_dir_t directory, uint32_t vaddr,
 int optimsoc_vmm_phys2virt(optimsoc_page_dir_t directory, uint32_t paddr,
                            uint32_t *vaddr);
 
+/**
+ * Page walk callback type
+ *
+ * @param vaddr Virtual address of the page
+ * @param paddr Physical address of the page
+ * @param arg Argument passed to optimsoc_vmm_dir_walk()
+ */
+typedef void (*optimsoc_vmm_walk_fptr) (uint32_t vaddr, uint32_t paddr,
+                                        void *arg);
+
+/**
+ * Iterate all mapped pages of a directory
+ *
+ * Calls fnc for each page that is present in the directory. The directory
+ * must not be changed during the walk.
+ *
+ * @param dir Directory to walk
+ * @param fnc Function to call for each page
+ * @param arg Argument passed to fnc
+ */
+void optimsoc_vmm_dir_walk(optimsoc_page_dir_t dir,
+                           optimsoc_vmm_walk_fptr fnc, void *arg);
+
 /**
  * Page fault handler type
  *
@@ -173,12 +243,114 @@ void optimsoc_vmm_set_ifault_handler(optimsoc_pfault_handler_fptr handler);
  */
 void optimsoc_vmm_destroy_page_dir(optimsoc_page_dir_t dir);
 
+/**
+ * TLB statistics of a core
+ */
+struct optimsoc_vmm_tlb_stats {
+    /*! Data TLB misses */
+    uint32_t dmiss;
+    /*! Instruction TLB misses */
+    uint32_t imiss;
+    /*! Data TLB misses served from the software translation cache */
+    uint32_t dstc_hits;
+    /*! Instruction TLB misses served from the software translation cache */
+    uint32_t istc_hits;
+    /*! Tick timer cycles spent in the miss handlers */
+    uint32_t cycles;
+    /*! TLB flushes on address space switches */
+    uint32_t flushes;
+};
+
+/**
+ * Get the TLB statistics of this core
+ *
+ * @param[out] stats Statistics to fill
+ */
+void optimsoc_vmm_tlb_get_stats(struct optimsoc_vmm_tlb_stats *stats);
+
+/**
+ * Trace the TLB statistics of this core
+ */
+void optimsoc_vmm_tlb_trace(void);
+
+/**
+ * Page allocation function
+ *
+ * Returns the physical page number of a free page.
+ */
 typedef void* (*page_alloc_fptr)();
 
+/**
+ * Copy pages on first access instead of during the directory copy
+ */
+#define OPTIMSOC_VMM_COPY_LAZY 0x1
+
+/**
+ * Copy a page directory from another tile
+ *
+ * The remote directory and its page tables are fetched and a local page is
+ * allocated for each mapped remote page. All pages are then copied with a
+ * single scatter-gather DMA chain. The table fetches are double-buffered,
+ * the next table is in flight while the previous is processed. Must be
+ * called from a kernel thread.
+ *
+ * @param remote_tile Tile the directory is on
+ * @param remote_addr Address of the directory on the remote tile
+ * @param page_alloc_fnc Allocator of the local pages
+ * @return The local copy of the directory
+ */
 optimsoc_page_dir_t optimsoc_vmm_dir_copy(uint32_t remote_tile,
                                           void *remote_addr,
                                           page_alloc_fptr page_alloc_fnc);
 
+/**
+ * Copy a page directory from another tile with options
+ *
+ * With OPTIMSOC_VMM_COPY_LAZY only the directory and the page tables are
+ * copied. The pages are fetched from the remote tile on the first TLB miss
+ * to them, before the page fault handler would be called, or by
+ * optimsoc_vmm_dir_fetch(). The remote pages must stay valid until
+ * optimsoc_vmm_dir_pending() returns 0. If too many lazy copies are
+ * pending, the pages are copied right away.
+ *
+ * @param remote_tile Tile the directory is on
+ * @param remote_addr Address of the directory on the remote tile
+ * @param page_alloc_fnc Allocator of the local pages
+ * @param flags OPTIMSOC_VMM_COPY_* flags
+ * @return The local copy of the directory
+ */
+optimsoc_page_dir_t optimsoc_vmm_dir_copy_flags(uint32_t remote_tile,
+                                                void *remote_addr,
+                                                page_alloc_fptr page_alloc_fnc,
+                                                uint32_t flags);
+
+/**
+ * Fetch a lazily copied page
+ *
+ * @param dir Directory copied with OPTIMSOC_VMM_COPY_LAZY
+ * @param vaddr Virtual address in the page
+ * @return 1 if the page is present now, 0 if it is not mapped
+ */
+int optimsoc_vmm_dir_fetch(optimsoc_page_dir_t dir, uint32_t vaddr);
+
+/**
+ * Fetch the next page of a lazy copy that was not accessed yet
+ *
+ * Can be used to complete a lazy copy in the background.
+ *
+ * @param dir Directory copied with OPTIMSOC_VMM_COPY_LAZY
+ * @return 1 if a page was fetched, 0 if no page is pending
+ */
+int optimsoc_vmm_dir_fetch_next(optimsoc_page_dir_t dir);
+
+/**
+ * Number of pages of a lazy copy that are not fetched yet
+ *
+ * @param dir Directory copied with OPTIMSOC_VMM_COPY_LAZY
+ * @return Number of pending pages
+ */
+uint32_t optimsoc_vmm_dir_pending(optimsoc_page_dir_t dir);
+
 /**
  * @}
  */
@@ -200,12 +372,27 @@ optimsoc_page_dir_t optimsoc_vmm_dir_copy(uint32_t remote_tile,
 #define OPTIMSOC_THREAD_FLAG_KERNEL           0x20000000
 #define OPTIMSOC_THREAD_FLAG_CREATE_SUSPENDED 0x10000000
 
+/*
+ * Priority levels of the per-core ready queues. Level 0 is scheduled
+ * first, threads of the same level are scheduled round-robin.
+ */
+#define OPTIMSOC_THREAD_PRIORITY_LEVELS  4
+#define OPTIMSOC_THREAD_PRIORITY_HIGHEST 0
+#define OPTIMSOC_THREAD_PRIORITY_DEFAULT 1
+#define OPTIMSOC_THREAD_PRIORITY_LOWEST  (OPTIMSOC_THREAD_PRIORITY_LEVELS - 1)
+
 struct optimsoc_thread_attr {
     void *args;
     uint32_t flags;
     uint32_t force_id;
     char *identifier;
     void *extra_data;
+    /* Priority level, see OPTIMSOC_THREAD_PRIORITY_* */
+    uint32_t priority;
+    /* Bitmask of cores the thread may run on, 0 for all cores. Setting
+     * OPTIMSOC_THREAD_FLAG_PIN pins the thread to the core given in the
+     * flags instead. */
+    uint32_t affinity;
 };
 
 void optimsoc_thread_attr_init(struct optimsoc_thread_attr *attr);
@@ -262,6 +449,16 @@ void optimsoc_thread_exit();
  */
 void optimsoc_thread_resume(optimsoc_thread_t thread);
 
+/**
+ * Resume a thread that suspends itself.
+ *
+ * The thread may be about to suspend itself on another core, this waits
+ * until it is suspended and resumes it. The thread must have committed to
+ * suspending, e.g., by registering as waiting under a lock it releases with
+ * interrupts disabled right before optimsoc_thread_suspend().
+ */
+void optimsoc_thread_wakeup(optimsoc_thread_t thread);
+
 /**
  * Insert a thread in the system.
  */
@@ -377,6 +574,24 @@ extern void runtime_config_set_numticks(unsigned int ticks);
 
 extern void runtime_config_set_use_globalids(unsigned int v);
 
+/**
+ * Enable tickless idle
+ *
+ * When enabled, an idle core does not take periodic ticks. It programs its
+ * tick timer for the next timer expiry and dozes until an interrupt
+ * arrives. Must be set before the runtime starts the scheduler.
+ */
+extern void runtime_config_set_tickless(unsigned int v);
+
+/**
+ * Enable TLB tagging with context IDs
+ *
+ * Set this if the MMUs compare the context ID of TLB entries. Switching
+ * between address spaces then keeps the TLB entries of the other threads,
+ * otherwise the TLBs are flushed on each switch.
+ */
+extern void runtime_config_set_tlb_tagging(unsigned int v);
+
 struct optimsoc_list_entry_t {
     void* data;
     struct optimsoc_list_entry_t* prev;
@@ -416,6 +631,13 @@ struct optimsoc_list_t *optimsoc_list_dma_copy(uint32_t remote_tile,
  */
 void optimsoc_timer_wait_ticks(uint32_t ticks);
 
+/**
+ * Timestamp of this core in tick timer cycles
+ *
+ * Timestamps of different cores are not synchronized.
+ */
+uint32_t optimsoc_timer_timestamp(void);
+
 /**
  * Initiate a DMA transfer
  */
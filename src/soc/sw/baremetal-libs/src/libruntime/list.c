@@ -24,13 +24,22 @@
  */
 
 #include "include/optimsoc-runtime.h"
+#include <optimsoc-baremetal.h>
 #include <assert.h>
 
 // TODO: create non-blocking data structure
 
+// Lists and their entries are allocated from pools, an entry is allocated
+// on each insertion
+static struct optimsoc_slab list_slab =
+        OPTIMSOC_SLAB_INIT("list", sizeof(struct optimsoc_list_t), 32);
+static struct optimsoc_slab list_entry_slab =
+        OPTIMSOC_SLAB_INIT("list_entry", sizeof(struct optimsoc_list_entry_t),
+                           64);
+
 struct optimsoc_list_t* optimsoc_list_init(void* data)
 {
-    struct optimsoc_list_t* l = malloc(sizeof(struct optimsoc_list_t));
+    struct optimsoc_list_t* l = optimsoc_slab_alloc(&list_slab);
     assert(l != NULL);
 
     if(data == NULL) { /* create empty list */
@@ -38,7 +47,7 @@ struct optimsoc_list_t* optimsoc_list_init(void* data)
         l->tail = NULL;
     } else {
         /* create first element */
-        l->head =l->tail = malloc(sizeof(struct optimsoc_list_entry_t));
+        l->head =l->tail = optimsoc_slab_alloc(&list_entry_slab);
         assert(l->tail != NULL);
 
         /* set data for first element */
@@ -55,7 +64,7 @@ void optimsoc_list_add_tail(struct optimsoc_list_t* l, void* data)
     assert(l != NULL);
     /* create new element */
     struct optimsoc_list_entry_t* e;
-    e = malloc(sizeof(struct optimsoc_list_entry_t));
+    e = optimsoc_slab_alloc(&list_entry_slab);
     assert(e != NULL);
 
     /* set data */
@@ -81,7 +90,7 @@ void optimsoc_list_add_head(struct optimsoc_list_t* l, void* data)
     assert(l != NULL);
     /* create new element */
     struct optimsoc_list_entry_t* e;
-    e = malloc(sizeof(struct optimsoc_list_entry_t));
+    e = optimsoc_slab_alloc(&list_entry_slab);
     assert(e != NULL);
 
     /* set data */
@@ -116,10 +125,12 @@ void* optimsoc_list_remove_tail(struct optimsoc_list_t* l)
     void* data = entry->data;
     l->tail = entry->prev;
 
-    free(entry);
+    optimsoc_slab_free(&list_entry_slab, entry);
     /* if list is empty now, set head to NULL */
     if(l->tail == NULL) {
         l->head = NULL;
+    } else {
+        l->tail->next = NULL;
     }
 
     return data;
@@ -140,10 +151,12 @@ void* optimsoc_list_remove_head(struct optimsoc_list_t* l)
     void* data = entry->data;
     l->head = entry->next;
 
-    free(entry);
+    optimsoc_slab_free(&list_entry_slab, entry);
     /* if list is empty now, set tail to NULL */
     if(l->head == NULL) {
         l->tail = NULL;
+    } else {
+        l->head->prev = NULL;
     }
 
     return data;
@@ -175,7 +188,7 @@ int optimsoc_list_remove(struct optimsoc_list_t* l, void* data)
                 entry->next->prev = entry->prev;
             }
 
-            free(entry);
+            optimsoc_slab_free(&list_entry_slab, entry);
             return 1;
         }
         entry = entry->next;
@@ -25,4 +25,12 @@
 #ifndef __RUNTIME_H__
 #define __RUNTIME_H__
 
+#include <optimsoc-baremetal.h>
+
+/*
+ * Wait for a DMA chain to finish, letting other threads run meanwhile.
+ * Must be called from a kernel thread.
+ */
+void _optimsoc_dma_chain_wait(struct dma_chain *chain);
+
 #endif /* RUNTIME_H_ */
@@ -25,6 +25,7 @@
 
 #include <optimsoc-baremetal.h>
 #include <or1k-support.h>
+#include <or1k-sprs.h>
 #include <context.h>
 
 #include "runtime.h"
@@ -34,30 +35,283 @@
 #include "timer.h"
 #include "scheduler.h"
 #include "trace.h"
+#include "vmm.h"
 
 #include <stdio.h>
 #include <assert.h>
 
 // Shared structures
 struct optimsoc_list_t* all_threads;
-struct optimsoc_list_t* ready_q;
 struct optimsoc_list_t* wait_q;
+// Threads are suspended and resumed from all cores
+static optimsoc_mutex_t wait_q_lock;
 
 // This is the entry point
 optimsoc_thread_t init_thread;
 
+/*
+ * Per-core ready queue
+ *
+ * Each core schedules from its own queue, one list per priority level. The
+ * queue lock is a test-and-set lock on top of l.lwa/l.swa and is only taken
+ * with interrupts disabled. It is held for a few list operations, a core
+ * looking for work from another core never waits for it but moves on to
+ * the next core.
+ */
+struct _optimsoc_runqueue {
+    volatile uint32_t lock;
+    volatile uint32_t nr_ready;
+    struct optimsoc_list_t *level[OPTIMSOC_THREAD_PRIORITY_LEVELS];
+};
+
 // Core specifics
 struct _optimsoc_scheduler_core {
     optimsoc_thread_t idle_thread;
     optimsoc_thread_t active_thread;
+    struct _optimsoc_runqueue runqueue;
 };
 
 struct _optimsoc_scheduler_core* _optimsoc_scheduler_core;
 
 extern void init();
 
+static inline void runqueue_lock(struct _optimsoc_runqueue *rq) {
+    while (or1k_sync_tsl((void*) &rq->lock) != 0) {}
+}
+
+static inline int runqueue_trylock(struct _optimsoc_runqueue *rq) {
+    return (or1k_sync_tsl((void*) &rq->lock) == 0);
+}
+
+static inline void runqueue_unlock(struct _optimsoc_runqueue *rq) {
+    rq->lock = 0;
+}
+
+static int thread_allowed_on(optimsoc_thread_t t, int core) {
+    return (t->affinity == 0) || (t->affinity & (1 << core));
+}
+
+/*
+ * Select the ready queue for a thread. A thread stays on the core it ran
+ * last as long as its affinity allows it, otherwise the least loaded
+ * allowed core is taken.
+ */
+static int thread_select_core(optimsoc_thread_t t) {
+    int numcores = or1k_numcores();
+
+    if ((t->core >= 0) && (t->core < numcores) &&
+            thread_allowed_on(t, t->core)) {
+        return t->core;
+    }
+
+    int best = -1;
+    uint32_t best_load = 0;
+    for (int c = 0; c < numcores; c++) {
+        if (!thread_allowed_on(t, c)) {
+            continue;
+        }
+
+        uint32_t load = _optimsoc_scheduler_core[c].runqueue.nr_ready;
+        if ((best < 0) || (load < best_load)) {
+            best = c;
+            best_load = load;
+        }
+    }
+
+    // Affinity does not match any core of this tile
+    assert(best >= 0);
+
+    return best;
+}
+
+/*
+ * Take the first thread of the highest priority level. Must be called with
+ * the queue lock held.
+ */
+static optimsoc_thread_t runqueue_pop(struct _optimsoc_runqueue *rq) {
+    for (int l = 0; l < OPTIMSOC_THREAD_PRIORITY_LEVELS; l++) {
+        optimsoc_thread_t t;
+        t = (optimsoc_thread_t) optimsoc_list_remove_head(rq->level[l]);
+        if (t) {
+            rq->nr_ready--;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Take a thread from another core that is allowed to run on this core.
+ * Threads are taken from the tail of a level, as they are the ones the
+ * victim would run last. Must be called with the queue lock held.
+ */
+static optimsoc_thread_t runqueue_steal(struct _optimsoc_runqueue *rq,
+                                        int core) {
+    for (int l = 0; l < OPTIMSOC_THREAD_PRIORITY_LEVELS; l++) {
+        optimsoc_list_iterator_t it;
+        optimsoc_thread_t t, candidate = NULL;
+
+        t = optimsoc_list_first_element(rq->level[l], &it);
+        while (t) {
+            if (thread_allowed_on(t, core)) {
+                candidate = t;
+            }
+            t = optimsoc_list_next_element(rq->level[l], &it);
+        }
+
+        if (candidate) {
+            optimsoc_list_remove(rq->level[l], candidate);
+            rq->nr_ready--;
+            candidate->core = core;
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Check if a queue holds a thread that may run on this core. Must be called
+ * with the queue lock held.
+ */
+static int runqueue_stealable(struct _optimsoc_runqueue *rq, int core) {
+    for (int l = 0; l < OPTIMSOC_THREAD_PRIORITY_LEVELS; l++) {
+        optimsoc_list_iterator_t it;
+        optimsoc_thread_t t;
+
+        t = optimsoc_list_first_element(rq->level[l], &it);
+        while (t) {
+            if (thread_allowed_on(t, core)) {
+                return 1;
+            }
+            t = optimsoc_list_next_element(rq->level[l], &it);
+        }
+    }
+    return 0;
+}
+
+static optimsoc_thread_t scheduler_steal(int core) {
+    int numcores = or1k_numcores();
+
+    for (int i = 1; i < numcores; i++) {
+        struct _optimsoc_runqueue *rq;
+        rq = &_optimsoc_scheduler_core[(core + i) % numcores].runqueue;
+
+        if ((rq->nr_ready == 0) || !runqueue_trylock(rq)) {
+            continue;
+        }
+
+        optimsoc_thread_t t = runqueue_steal(rq, core);
+        runqueue_unlock(rq);
+
+        if (t) {
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+void _optimsoc_scheduler_ready(optimsoc_thread_t t) {
+    uint32_t restore = or1k_critical_begin();
+
+    int core = thread_select_core(t);
+    struct _optimsoc_runqueue *rq;
+    rq = &_optimsoc_scheduler_core[core].runqueue;
+
+    t->state = THREAD_RUNNABLE;
+    t->ready_stamp = _optimsoc_timer_timestamp();
+
+    runqueue_lock(rq);
+    t->core = core;
+    optimsoc_list_add_tail(rq->level[t->priority], (void*) t);
+    rq->nr_ready++;
+    runqueue_unlock(rq);
+
+    or1k_critical_end(restore);
+}
+
+int _optimsoc_scheduler_unready(optimsoc_thread_t t) {
+    int found = 0;
+    uint32_t restore = or1k_critical_begin();
+
+    // The thread's core only changes with its queue locked, another core
+    // may steal it before we hold the lock
+    while (t->core >= 0) {
+        int core = t->core;
+        struct _optimsoc_runqueue *rq;
+        rq = &_optimsoc_scheduler_core[core].runqueue;
+
+        runqueue_lock(rq);
+        if (t->core != core) {
+            runqueue_unlock(rq);
+            continue;
+        }
+
+        found = optimsoc_list_remove(rq->level[t->priority], (void*) t);
+        if (found) {
+            rq->nr_ready--;
+        }
+        runqueue_unlock(rq);
+        break;
+    }
+
+    or1k_critical_end(restore);
+
+    return found;
+}
+
+int _optimsoc_scheduler_has_ready(void) {
+    int core = or1k_coreid();
+    int ready = 0;
+
+    if (_optimsoc_scheduler_core[core].runqueue.nr_ready > 0) {
+        return 1;
+    }
+
+    // Threads ready on other cores only count if this core may steal them
+    uint32_t restore = or1k_critical_begin();
+    for (int c = 0; (c < or1k_numcores()) && !ready; c++) {
+        struct _optimsoc_runqueue *rq = &_optimsoc_scheduler_core[c].runqueue;
+
+        if ((c == core) || (rq->nr_ready == 0)) {
+            continue;
+        }
+
+        // A busy queue is changing, look again rather than miss work
+        if (!runqueue_trylock(rq)) {
+            ready = 1;
+            break;
+        }
+        ready = runqueue_stealable(rq, core);
+        runqueue_unlock(rq);
+    }
+    or1k_critical_end(restore);
+
+    return ready;
+}
+
 void _optimsoc_idle_thread_func() {
-    while (1) { }
+    while (1) {
+        // A thread can become ready from an interrupt, e.g., when it was
+        // waiting for a message, or another core may have work to spare.
+        // Switch right away instead of spinning until the next tick.
+        if (_optimsoc_scheduler_has_ready()) {
+            uint32_t restore = or1k_critical_begin();
+            _optimsoc_thread_ctx_t *ctx;
+
+            ctx = _optimsoc_scheduler_get_current()->ctx;
+            if (_optimsoc_context_enter_exception(ctx) == 1) {
+                _optimsoc_schedule();
+                _optimsoc_context_replace(_optimsoc_scheduler_get_current()->ctx);
+            } else {
+                or1k_critical_end(restore);
+            }
+        } else if (runtime_config_get_tickless()) {
+            // Stop the periodic tick and doze until the next timer expires
+            // or an interrupt arrives
+            _optimsoc_timer_idle();
+        }
+    }
 }
 
 optimsoc_thread_t _optimsoc_scheduler_get_current(void) {
@@ -80,7 +334,7 @@ void _optimsoc_scheduler_tick() {
     /* put active thread into the queue */
     if (core_ctx->active_thread != core_ctx->idle_thread) {
         // only if this is not the idle thread of course..
-        _optimsoc_scheduler_add(core_ctx->active_thread, ready_q);
+        _optimsoc_scheduler_ready(core_ctx->active_thread);
     }
 
     /* schedule next thread */
@@ -93,9 +347,22 @@ void _optimsoc_scheduler_tick() {
 void _optimsoc_scheduler_init() {
 
     wait_q = optimsoc_list_init(0);
-    ready_q= optimsoc_list_init(0);
+    optimsoc_mutex_init(&wait_q_lock);
     all_threads = optimsoc_list_init(0);
 
+    _optimsoc_scheduler_core = calloc(or1k_numcores(),
+                                      sizeof(struct _optimsoc_scheduler_core));
+    assert(_optimsoc_scheduler_core);
+
+    _optimsoc_timer_init();
+
+    for (int c = 0; c < or1k_numcores(); c++) {
+        struct _optimsoc_runqueue *rq = &_optimsoc_scheduler_core[c].runqueue;
+        for (int l = 0; l < OPTIMSOC_THREAD_PRIORITY_LEVELS; l++) {
+            rq->level[l] = optimsoc_list_init(0);
+        }
+    }
+
     struct optimsoc_thread_attr *attr_init;
     attr_init = malloc(sizeof(struct optimsoc_thread_attr));
 
@@ -105,29 +372,43 @@ void _optimsoc_scheduler_init() {
 
     optimsoc_thread_create(&init_thread, &init, attr_init);
 
-    _optimsoc_scheduler_core = calloc(or1k_numcores(),
-                                      sizeof(struct _optimsoc_scheduler_core));
-
     for (int c = 0; c < or1k_numcores(); c++) {
         struct optimsoc_thread_attr *attr_idle;
         attr_idle = malloc(sizeof(struct optimsoc_thread_attr));
         optimsoc_thread_attr_init(attr_idle);
-        attr_idle->flags |= OPTIMSOC_THREAD_FLAG_KERNEL;
+        attr_idle->flags |= OPTIMSOC_THREAD_FLAG_KERNEL |
+                OPTIMSOC_THREAD_FLAG_CREATE_SUSPENDED |
+                OPTIMSOC_THREAD_FLAG_PIN | c;
         attr_idle->identifier = "idle";
         optimsoc_thread_create(&(_optimsoc_scheduler_core[c].idle_thread),
                                &_optimsoc_idle_thread_func, attr_idle);
-        optimsoc_list_remove(ready_q,
-                             (void*) _optimsoc_scheduler_core[c].idle_thread);
+        _optimsoc_scheduler_wait_remove(_optimsoc_scheduler_core[c].idle_thread);
         optimsoc_list_remove(all_threads,
                              (void*) _optimsoc_scheduler_core[c].idle_thread);
     }
 }
 
-void _optimsoc_scheduler_add(optimsoc_thread_t t, struct optimsoc_list_t* q) {
-    if(q == ready_q) {
-        t->state = THREAD_RUNNABLE;
-    }
+void _optimsoc_scheduler_wait_add(optimsoc_thread_t t) {
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&wait_q_lock);
+    optimsoc_list_add_tail(wait_q, (void*) t);
+    optimsoc_mutex_unlock(&wait_q_lock);
+    or1k_critical_end(restore);
+}
+
+int _optimsoc_scheduler_wait_remove(optimsoc_thread_t t) {
+    int found;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&wait_q_lock);
+    found = optimsoc_list_remove(wait_q, (void*) t);
+    optimsoc_mutex_unlock(&wait_q_lock);
+    or1k_critical_end(restore);
+
+    return found;
+}
 
+void _optimsoc_scheduler_add(optimsoc_thread_t t, struct optimsoc_list_t* q) {
     optimsoc_list_add_tail(q, (void*)t);
 }
 
@@ -137,6 +418,7 @@ void _optimsoc_scheduler_start() {
     or1k_timer_init(runtime_config_get_numticks());
     /* timer set handle must be after timer init */
     or1k_timer_set_handler(&_optimsoc_scheduler_tick);
+    _optimsoc_timer_start();
 
     _optimsoc_schedule();
 
@@ -150,27 +432,50 @@ void _optimsoc_scheduler_start() {
 }
 
 void _optimsoc_schedule() {
+    int core = or1k_coreid();
+    struct _optimsoc_scheduler_core *core_ctx;
+    core_ctx = &_optimsoc_scheduler_core[core];
+
+    /* get the next thread from the local ready queue */
+    optimsoc_thread_t t = NULL;
+    uint32_t latency = 0;
 
-    /* get the next thread from the ready_q */
-    optimsoc_thread_t t;
-    t = (optimsoc_thread_t) optimsoc_list_remove_head(ready_q);
+    if (core_ctx->runqueue.nr_ready > 0) {
+        runqueue_lock(&core_ctx->runqueue);
+        t = runqueue_pop(&core_ctx->runqueue);
+        runqueue_unlock(&core_ctx->runqueue);
+    }
+
+    /* otherwise try to take work from another core */
+    if (!t) {
+        t = scheduler_steal(core);
+    }
 
-    /* In case we don't have a thread in the ready_q: schedule idle thread */
-    if(!t) {
-        t = _optimsoc_scheduler_core[or1k_coreid()].idle_thread;
+    if (t) {
+        t->core = core;
+        latency = _optimsoc_timer_timestamp() - t->ready_stamp;
+        /* Timestamps of different cores are not synchronized */
+        if ((int32_t) latency < 0) {
+            latency = 0;
+        }
+    } else {
+        /* In case there is no ready thread: schedule idle thread */
+        t = core_ctx->idle_thread;
     }
 
     assert(t);
 
     /* set active */
-    _optimsoc_scheduler_core[or1k_coreid()].active_thread = t;
+    core_ctx->active_thread = t;
 
-    runtime_trace_schedule(t->id);
+    runtime_trace_schedule(t->id, latency);
 
-    /* switch the context */
+    /* switch the address space, the context ID goes to the status register */
     _optimsoc_thread_ctx_t *ctx;
-    ctx = _optimsoc_scheduler_core[or1k_coreid()].active_thread->ctx;
-    _optimsoc_context_restore(ctx);
+    ctx = core_ctx->active_thread->ctx;
+    uint32_t cid = _optimsoc_vmm_switch(t->page_dir);
+    ctx->sr = OR1K_SPR_SYS_SR_CID_SET(ctx->sr, cid);
 
-    // TODO: Clear TLB
+    /* switch the context */
+    _optimsoc_context_restore(ctx);
 }
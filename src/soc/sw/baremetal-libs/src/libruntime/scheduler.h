@@ -32,12 +32,22 @@
 #include "thread.h"
 
 extern struct optimsoc_list_t* all_threads;
-extern struct optimsoc_list_t* ready_q;
 extern struct optimsoc_list_t* wait_q;
 
 void _optimsoc_scheduler_init();
 void _optimsoc_scheduler_start();
 void _optimsoc_scheduler_add(optimsoc_thread_t t, struct optimsoc_list_t* q);
+/* Add a thread to the wait queue of suspended threads */
+void _optimsoc_scheduler_wait_add(optimsoc_thread_t t);
+/* Remove a thread from the wait queue, returns 1 if found */
+int _optimsoc_scheduler_wait_remove(optimsoc_thread_t t);
+
+/* Make a thread runnable by adding it to the ready queue of a core */
+void _optimsoc_scheduler_ready(optimsoc_thread_t t);
+/* Remove a runnable thread from its ready queue, returns 1 if found */
+int _optimsoc_scheduler_unready(optimsoc_thread_t t);
+/* Check if a thread is ready that this core may run or steal */
+int _optimsoc_scheduler_has_ready(void);
 void _optimsoc_schedule();
 void _optimsoc_scheduler_yieldcurrent();
 void _optimsoc_scheduler_suspendcurrent();
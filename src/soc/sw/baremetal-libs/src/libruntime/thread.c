@@ -75,10 +75,19 @@ void optimsoc_thread_attr_init(struct optimsoc_thread_attr *attr) {
     attr->flags = 0;
     attr->force_id = 0;
     attr->identifier = NULL;
+    attr->priority = OPTIMSOC_THREAD_PRIORITY_DEFAULT;
+    attr->affinity = 0;
 }
 
 volatile uint32_t _optimsoc_thread_next_id;
 
+// Thread control blocks and contexts are allocated from pools
+static struct optimsoc_slab thread_slab =
+        OPTIMSOC_SLAB_INIT("thread", sizeof(struct optimsoc_thread), 8);
+static struct optimsoc_slab thread_ctx_slab =
+        OPTIMSOC_SLAB_INIT("thread_ctx", sizeof(struct _optimsoc_thread_ctx_t),
+                           8);
+
 int optimsoc_thread_create(optimsoc_thread_t *thread,
                            void (*start)(void*),
                            struct optimsoc_thread_attr *attr) {
@@ -95,11 +104,21 @@ int optimsoc_thread_create(optimsoc_thread_t *thread,
     }
 
     // Allocate a new thread control block
-    t = malloc(sizeof(struct optimsoc_thread));
+    t = optimsoc_slab_alloc(&thread_slab);
     assert(t);
 
     t->flags = attr->flags;
 
+    // Scheduling parameters
+    assert(attr->priority < OPTIMSOC_THREAD_PRIORITY_LEVELS);
+    t->priority = attr->priority;
+    if (attr->flags & OPTIMSOC_THREAD_FLAG_PIN) {
+        t->affinity = 1 << (attr->flags & OPTIMSOC_THREAD_FLAG_CORE_MASK);
+    } else {
+        t->affinity = attr->affinity;
+    }
+    t->core = -1;
+
     // Generate a context for the thread
     _optimsoc_context_create(t, start, attr->args);
 
@@ -140,14 +159,12 @@ int optimsoc_thread_create(optimsoc_thread_t *thread,
     // Set initial state of thread
     if(attr->flags & OPTIMSOC_THREAD_FLAG_CREATE_SUSPENDED) {
         // Add to wait queue for suspended threads
-        _optimsoc_scheduler_add(t, wait_q);
+        _optimsoc_scheduler_wait_add(t);
         // Set suspended state
         t->state = THREAD_SUSPENDED;
     } else {
-        // Add to ready queue for active threads
-        _optimsoc_scheduler_add(t,ready_q);
-        // Set runnable state
-        t->state = THREAD_RUNNABLE;
+        // Add to a ready queue and set runnable state
+        _optimsoc_scheduler_ready(t);
     }
 
     // Add to list of all threads
@@ -168,10 +185,12 @@ optimsoc_thread_t optimsoc_thread_current() {
 void optimsoc_thread_yield(optimsoc_thread_t thread) {
     optimsoc_thread_t current = optimsoc_thread_current();
 
-    optimsoc_list_remove(ready_q, thread);
-    optimsoc_list_add_tail(ready_q, thread);
-
-    if (thread == current) {
+    if (thread != current) {
+        // Move to the end of its ready queue
+        if (_optimsoc_scheduler_unready(thread)) {
+            _optimsoc_scheduler_ready(thread);
+        }
+    } else {
         if (thread->flags & OPTIMSOC_THREAD_FLAG_KERNEL) {
             uint32_t restore = or1k_critical_begin();
             // Store the current context
@@ -179,6 +198,9 @@ void optimsoc_thread_yield(optimsoc_thread_t thread) {
 
             ctx = _optimsoc_scheduler_get_current()->ctx;
             if (_optimsoc_context_enter_exception(ctx) == 1) {
+                // Only enqueue once the context is stored, another core
+                // may pick the thread up right away
+                _optimsoc_scheduler_ready(thread);
                 _optimsoc_schedule();
                 _optimsoc_context_replace(_optimsoc_scheduler_get_current()->ctx);
             } else {
@@ -230,7 +252,7 @@ int _optimsoc_context_create(optimsoc_thread_t thread,
                              void (*start_routine)(void*), void *arg)
 {
     /* Create context and initialize to 0 */
-    thread->ctx = calloc(sizeof(struct _optimsoc_thread_ctx_t), 1);
+    thread->ctx = optimsoc_slab_zalloc(&thread_ctx_slab);
 
     assert(thread->ctx != NULL);
 
@@ -286,7 +308,7 @@ void optimsoc_thread_suspend(optimsoc_thread_t thread)
                 _optimsoc_scheduler_get_current()->ctx) == 1) {
 
             /* add thread to wait_q */
-            optimsoc_list_add_tail(wait_q, thread);
+            _optimsoc_scheduler_wait_add(thread);
             thread->state = THREAD_SUSPENDED;
 
             /* re-schedule */
@@ -295,8 +317,8 @@ void optimsoc_thread_suspend(optimsoc_thread_t thread)
         }
     } else {
         /* thread currently not running */
-        assert(optimsoc_list_remove(ready_q, thread));
-        optimsoc_list_add_tail(wait_q, thread);
+        assert(_optimsoc_scheduler_unready(thread));
+        _optimsoc_scheduler_wait_add(thread);
         thread->state = THREAD_SUSPENDED;
     }
 
@@ -306,15 +328,28 @@ void optimsoc_thread_suspend(optimsoc_thread_t thread)
 void optimsoc_thread_resume(optimsoc_thread_t thread)
 {
     assert(thread->state == THREAD_SUSPENDED);
-    assert(optimsoc_list_remove(wait_q, thread));
+    int found = _optimsoc_scheduler_wait_remove(thread);
+    assert(found);
+    (void) found;
 
-    optimsoc_list_add_tail(ready_q, thread);
-    thread->state = THREAD_RUNNABLE;
+    _optimsoc_scheduler_ready(thread);
+}
+
+void optimsoc_thread_wakeup(optimsoc_thread_t thread)
+{
+    // The thread may still be on its way into the suspension on another
+    // core, it can be resumed once its context is stored
+    while (((volatile struct optimsoc_thread*) thread)->state !=
+            THREAD_SUSPENDED) { }
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_thread_resume(thread);
+    or1k_critical_end(restore);
 }
 
 void optimsoc_thread_remove(optimsoc_thread_t thread)
 {
-    if (optimsoc_list_remove(ready_q, thread) == 0) {
+    if (_optimsoc_scheduler_unready(thread) == 0) {
         /* thread is no in the ready_q */
         /* either suspended (not supported) */
         /* or running on other core (not supported) */
@@ -333,7 +368,7 @@ void optimsoc_thread_add(optimsoc_thread_t thread)
 
     optimsoc_list_add_tail(all_threads, thread);
 
-    optimsoc_list_add_tail(ready_q, thread);
+    _optimsoc_scheduler_ready(thread);
 
     // Trace creation of thread
     runtime_trace_createthread(thread->name, thread->id, thread,
@@ -349,7 +384,7 @@ optimsoc_thread_t optimsoc_thread_dma_copy(uint32_t remote_tile,
     struct optimsoc_thread remote_thread;
     uint32_t id;
 
-    local_thread = malloc(sizeof(struct optimsoc_thread));
+    local_thread = optimsoc_slab_alloc(&thread_slab);
     assert(local_thread != NULL);
 
     optimsoc_dma_transfer(&remote_thread, remote_tile, remote_addr,
@@ -366,7 +401,7 @@ optimsoc_thread_t optimsoc_thread_dma_copy(uint32_t remote_tile,
     } while (or1k_sync_cas((void*) &_optimsoc_thread_next_id, id, id+1) != id);
 
     /* struct _optimsoc_thread_ctx_t *ctx */
-    local_thread->ctx = malloc(sizeof(struct _optimsoc_thread_ctx_t));
+    local_thread->ctx = optimsoc_slab_alloc(&thread_ctx_slab);
     assert(local_thread->ctx != NULL);
 
     optimsoc_dma_transfer(local_thread->ctx, remote_tile, remote_thread.ctx,
@@ -413,5 +448,12 @@ optimsoc_thread_t optimsoc_thread_dma_copy(uint32_t remote_tile,
     /* extra data will be added externally */
     local_thread->extra_data = NULL;
 
+    /* scheduling parameters */
+    /* the affinity refers to the cores of the remote tile */
+    local_thread->priority = remote_thread.priority;
+    local_thread->affinity = 0;
+    local_thread->core = -1;
+    local_thread->ready_stamp = 0;
+
     return local_thread;
 }
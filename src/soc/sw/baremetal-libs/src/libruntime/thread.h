@@ -63,6 +63,15 @@ struct optimsoc_thread {
     char *name;
 
     void *extra_data;
+
+    /* Scheduling parameters */
+    uint32_t priority;
+    uint32_t affinity;
+
+    /* Core whose ready queue holds the thread or which ran it last */
+    int core;
+    /* Timestamp of the last transition to runnable */
+    uint32_t ready_stamp;
 };
 
 optimsoc_page_dir_t _optimsoc_thread_get_pagedir_current();
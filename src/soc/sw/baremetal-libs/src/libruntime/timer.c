@@ -1,54 +1,312 @@
 #include <or1k-support.h>
+#include <optimsoc-baremetal.h>
 
+#include <assert.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "scheduler.h"
 #include "timer.h"
 
+/*
+ * Each core keeps its own time and its own hierarchical timer wheel. Level
+ * 0 has one slot per tick for the next 64 ticks, each further level covers
+ * 64 times the range of the level below. A timer is put into the level its
+ * distance falls in and moves down a level each time the level below has
+ * wrapped around, so a tick only touches the timers in one level 0 slot,
+ * which are all due, and occasionally cascades one slot of a higher level.
+ * Timers further away than the wheel covers stay in the top level and are
+ * re-inserted there until they are in range.
+ *
+ * As nothing is shared, the timers are protected by disabling interrupts.
+ */
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
 
-struct optimsoc_list_t *_optimsoc_timers;
+struct _optimsoc_timer_core {
+    /* Ticks since the scheduler started on this core */
+    volatile uint32_t now;
+    /* Tick timer period in cycles */
+    uint32_t period;
+    /* Number of ticks the timer is programmed for while idle, 0 if the
+     * timer runs periodically */
+    volatile uint32_t sleep;
+    /* Number of pending timers */
+    uint32_t pending;
+    struct _optimsoc_timer_t *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
 
-void _optimsoc_timer_tick()
-{
-    if (_optimsoc_timers != NULL) {
+static struct _optimsoc_timer_core *_optimsoc_timer_core;
+
+static inline int timer_due(uint32_t deadline, uint32_t now) {
+    return ((int32_t) (deadline - now) <= 0);
+}
+
+static inline uint32_t timer_slot(uint32_t deadline, int level) {
+    return (deadline >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+}
+
+static void timer_set_period(uint32_t cycles) {
+    uint32_t ttmr = or1k_mfspr(OR1K_SPR_TICK_TTMR_ADDR);
+    ttmr = OR1K_SPR_TICK_TTMR_TP_SET(ttmr, cycles);
+    or1k_mtspr(OR1K_SPR_TICK_TTMR_ADDR, ttmr);
+}
+
+/* Put a timer into the level its distance from now falls in */
+static void timer_insert(struct _optimsoc_timer_core *tc,
+                         struct _optimsoc_timer_t *timer) {
+    uint32_t delta = timer->deadline - tc->now;
+    int level = 0;
+
+    if (timer_due(timer->deadline, tc->now)) {
+        delta = 0;
+    }
 
-        optimsoc_list_iterator_t iter;
+    while ((level < TIMER_WHEEL_LEVELS - 1) &&
+            (delta >> ((level + 1) * TIMER_WHEEL_BITS)) != 0) {
+        level++;
+    }
+
+    struct _optimsoc_timer_t **slot;
+    if (delta == 0) {
+        slot = &tc->wheel[0][timer_slot(tc->now, 0)];
+    } else {
+        slot = &tc->wheel[level][timer_slot(timer->deadline, level)];
+    }
+
+    timer->next = *slot;
+    *slot = timer;
+}
 
-        struct _optimsoc_timer_t *timer =
-            optimsoc_list_first_element(_optimsoc_timers, &iter);
-        while (timer) {
-            timer->ticks++;
+/* Move all timers of a slot to the levels below */
+static void timer_cascade(struct _optimsoc_timer_core *tc, int level) {
+    struct _optimsoc_timer_t **slot;
+    slot = &tc->wheel[level][timer_slot(tc->now, level)];
 
-            if (timer->ticks == timer->goal) {
+    struct _optimsoc_timer_t *timer = *slot;
+    *slot = NULL;
 
-                /* save addr and thread of current timer */
-                optimsoc_thread_t resume = timer->thread;
-                void *remove = timer;
+    while (timer) {
+        struct _optimsoc_timer_t *next = timer->next;
+        timer_insert(tc, timer);
+        timer = next;
+    }
+}
+
+/* Advance time by one tick and expire the timers that became due */
+static void timer_step(struct _optimsoc_timer_core *tc) {
+    tc->now++;
 
-                /* go to the next element before removing current */
-                timer = optimsoc_list_next_element(_optimsoc_timers, &iter);
+    if (tc->pending == 0) {
+        return;
+    }
 
-                optimsoc_list_remove(_optimsoc_timers, remove);
-                optimsoc_thread_resume(resume);
-            } else {
-                timer = optimsoc_list_next_element(_optimsoc_timers, &iter);
+    /* Find the levels that wrapped around and cascade them, top down */
+    int wrapped = 0;
+    while ((wrapped < TIMER_WHEEL_LEVELS - 1) &&
+            (timer_slot(tc->now, wrapped) == 0)) {
+        wrapped++;
+    }
+    for (int level = wrapped; level > 0; level--) {
+        timer_cascade(tc, level);
+    }
+
+    /* All timers in the current slot of level 0 are due */
+    struct _optimsoc_timer_t **slot;
+    slot = &tc->wheel[0][timer_slot(tc->now, 0)];
+
+    struct _optimsoc_timer_t *timer = *slot;
+    *slot = NULL;
+
+    while (timer) {
+        struct _optimsoc_timer_t *next = timer->next;
+        tc->pending--;
+        optimsoc_thread_resume(timer->thread);
+        timer = next;
+    }
+}
+
+static void timer_advance(struct _optimsoc_timer_core *tc, uint32_t ticks) {
+    if (tc->pending == 0) {
+        tc->now += ticks;
+        return;
+    }
+
+    for (uint32_t t = 0; t < ticks; t++) {
+        timer_step(tc);
+    }
+}
+
+/* Number of ticks until the next timer is due */
+static uint32_t timer_next_expiry(struct _optimsoc_timer_core *tc) {
+    uint32_t next = UINT32_MAX;
+
+    if (tc->pending == 0) {
+        return next;
+    }
+
+    /* The first occupied slot of each level holds its earliest timers. The
+     * current slot of a higher level was cascaded when it was entered, the
+     * timers in it now are a full rotation ahead, so it comes last. */
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t cur = timer_slot(tc->now, level);
+        int first = (level == 0) ? 0 : 1;
+
+        for (int s = first; s < first + TIMER_WHEEL_SLOTS; s++) {
+            struct _optimsoc_timer_t *timer;
+            timer = tc->wheel[level][(cur + s) & TIMER_WHEEL_MASK];
+            if (timer == NULL) {
+                continue;
             }
+
+            for (; timer != NULL; timer = timer->next) {
+                uint32_t delta = timer->deadline - tc->now;
+                if (timer_due(timer->deadline, tc->now)) {
+                    delta = 1;
+                }
+                if (delta < next) {
+                    next = delta;
+                }
+            }
+            break;
         }
     }
+
+    return next;
+}
+
+void _optimsoc_timer_init()
+{
+    _optimsoc_timer_core = calloc(or1k_numcores(),
+                                  sizeof(struct _optimsoc_timer_core));
+    assert(_optimsoc_timer_core);
+}
+
+void _optimsoc_timer_start()
+{
+    struct _optimsoc_timer_core *tc = &_optimsoc_timer_core[or1k_coreid()];
+
+    tc->period = OR1K_SPR_TICK_TTMR_TP_GET(or1k_mfspr(OR1K_SPR_TICK_TTMR_ADDR));
+    tc->sleep = 0;
+}
+
+void _optimsoc_timer_tick()
+{
+    struct _optimsoc_timer_core *tc = &_optimsoc_timer_core[or1k_coreid()];
+    uint32_t ticks = 1;
+
+    if (tc->sleep) {
+        /* The timer fired at the end of an idle period */
+        ticks = tc->sleep;
+        tc->sleep = 0;
+        timer_set_period(tc->period);
+    }
+
+    timer_advance(tc, ticks);
+}
+
+uint32_t _optimsoc_timer_timestamp()
+{
+    struct _optimsoc_timer_core *tc = &_optimsoc_timer_core[or1k_coreid()];
+
+    /* While idle the counter runs over multiple periods since the last
+     * tick, so this holds in both modes */
+    return tc->now * tc->period + or1k_mfspr(OR1K_SPR_TICK_TTCR_ADDR);
+}
+
+uint32_t optimsoc_timer_timestamp(void)
+{
+    return _optimsoc_timer_timestamp();
+}
+
+/*
+ * Leave an idle period before the timer fired. Account the full ticks that
+ * have passed and continue with periodic ticks in the same phase.
+ */
+static void timer_idle_exit(struct _optimsoc_timer_core *tc) {
+    uint32_t ttmr = or1k_mfspr(OR1K_SPR_TICK_TTMR_ADDR);
+
+    if (OR1K_SPR_TICK_TTMR_IP_GET(ttmr)) {
+        /* The timer fired meanwhile, the tick handler accounts for it */
+        return;
+    }
+
+    uint32_t count = or1k_mfspr(OR1K_SPR_TICK_TTCR_ADDR);
+
+    tc->sleep = 0;
+    timer_set_period(tc->period);
+    or1k_mtspr(OR1K_SPR_TICK_TTCR_ADDR, count % tc->period);
+
+    timer_advance(tc, count / tc->period);
+}
+
+static void timer_doze(void) {
+    /* Without power management unit the core keeps polling */
+    if (OR1K_SPR_SYS_UPR_PMP_GET(or1k_mfspr(OR1K_SPR_SYS_UPR_ADDR))) {
+        or1k_mtspr(OR1K_SPR_PM_PMR_ADDR, OR1K_SPR_PM_PMR_DME_SET(0, 1));
+    }
+}
+
+void _optimsoc_timer_idle()
+{
+    struct _optimsoc_timer_core *tc = &_optimsoc_timer_core[or1k_coreid()];
+
+    uint32_t restore = or1k_critical_begin();
+
+    if (_optimsoc_scheduler_has_ready() || (tc->period == 0)) {
+        or1k_critical_end(restore);
+        return;
+    }
+
+    /* Program the timer for the next expiry, limited by the width of the
+     * period field */
+    uint32_t ticks = timer_next_expiry(tc);
+    uint32_t max = OR1K_SPR_TICK_TTMR_TP_MASK / tc->period;
+    if (ticks > max) {
+        ticks = max;
+    }
+
+    if (ticks > 1) {
+        tc->sleep = ticks;
+        timer_set_period(tc->period * ticks);
+    }
+
+    /* Wait for the timer or another interrupt making a thread ready. The
+     * check and the doze are done with interrupts masked, so a wakeup
+     * cannot slip in between them. A pending interrupt ends the doze, it
+     * is handled before checking again. */
+    while (tc->sleep && !_optimsoc_scheduler_has_ready()) {
+        timer_doze();
+        or1k_critical_end(restore);
+        restore = or1k_critical_begin();
+    }
+
+    if (tc->sleep) {
+        timer_idle_exit(tc);
+    }
+    or1k_critical_end(restore);
 }
 
 void optimsoc_timer_wait_ticks(uint32_t ticks)
 {
     struct _optimsoc_timer_t timer;
+    struct _optimsoc_timer_core *tc;
+
+    if (ticks == 0) {
+        return;
+    }
 
     uint32_t restore = or1k_critical_begin();
 
-    timer.ticks = 0;
-    timer.goal = ticks;
+    tc = &_optimsoc_timer_core[or1k_coreid()];
+
+    timer.deadline = tc->now + ticks;
     timer.thread = optimsoc_thread_current();
 
-    if (_optimsoc_timers == NULL) {
-        _optimsoc_timers = optimsoc_list_init(&timer);
-    } else {
-        optimsoc_list_add_tail(_optimsoc_timers, &timer);
-    }
+    timer_insert(tc, &timer);
+    tc->pending++;
 
     optimsoc_thread_suspend(timer.thread);
 
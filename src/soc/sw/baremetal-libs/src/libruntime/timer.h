@@ -3,12 +3,22 @@
 
 #include "include/optimsoc-runtime.h"
 
+/*
+ * A thread sleeping until an absolute tick count. The timer lives on the
+ * stack of the sleeping thread and is linked into a slot of the timer
+ * wheel of the core the thread went to sleep on.
+ */
 struct _optimsoc_timer_t {
-    uint32_t ticks;
-    uint32_t goal;
+    uint32_t deadline;
     optimsoc_thread_t thread;
+    struct _optimsoc_timer_t *next;
 };
 
+void _optimsoc_timer_init();
+void _optimsoc_timer_start();
 void _optimsoc_timer_tick();
+void _optimsoc_timer_idle();
+
+uint32_t _optimsoc_timer_timestamp();
 
 #endif //TIMER_H
@@ -26,6 +26,7 @@
 #define TRACE_H_
 
 #include <optimsoc-baremetal.h>
+#include "include/optimsoc-runtime.h"
 #include "runtime.h"
 #include "config.h"
 
@@ -43,6 +44,8 @@
 
 #define TRACE_THREAD_SEND       0x30b
 #define TRACE_THREAD_DESTROY    0x30c
+#define TRACE_SCHEDULE_LATENCY  0x30d
+#define TRACE_TLB_STATS         0x30e
 
 static inline void runtime_trace_sendthread(char *name,
                                             unsigned int id,
@@ -90,8 +93,10 @@ static inline void runtime_trace_createthread(char *name,
     OPTIMSOC_TRACE(TRACE_THREAD_CREATE,func);
 }
 
-static inline void runtime_trace_schedule(unsigned int id) {
+static inline void runtime_trace_schedule(unsigned int id,
+                                          unsigned int latency) {
     OPTIMSOC_TRACE(TRACE_SCHEDULE,id);
+    OPTIMSOC_TRACE(TRACE_SCHEDULE_LATENCY,latency);
     optimsoc_trace_section((int)id);
 }
 
@@ -121,6 +126,15 @@ static inline void runtime_trace_dtlb_miss(uint32_t vaddr) {
     OPTIMSOC_TRACE(TRACE_DTLBMISS,vaddr);
 }
 
+static inline void runtime_trace_tlb_stats(struct optimsoc_vmm_tlb_stats *stats) {
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->dmiss);
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->imiss);
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->dstc_hits);
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->istc_hits);
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->cycles);
+    OPTIMSOC_TRACE(TRACE_TLB_STATS, stats->flushes);
+}
+
 static inline void runtime_trace_thread_exit() {
     OPTIMSOC_TRACE(TRACE_EXIT, 1);
 }
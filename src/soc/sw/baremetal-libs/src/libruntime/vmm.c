@@ -32,6 +32,7 @@
 #include <inttypes.h>
 
 #include "include/optimsoc-runtime.h"
+#include "runtime.h"
 #include "vmm.h"
 #include "list.h"
 #include "thread.h"
@@ -115,7 +116,7 @@
 /*! Get the L2 index from a virtual address */
 #define OR1K_ADDR_L2_INDEX_GET(addr) ((addr >> OR1K_ADDR_L2_INDEX_LSB) & 0x7ff)
 /*! Set the L2 index in a virtual address */
-#define OR1K_ADDR_L2_INDEX_SET(addr,idx) ((addr & 0xff001ff) | \
+#define OR1K_ADDR_L2_INDEX_SET(addr,idx) ((addr & 0xff001fff) | \
         ((idx & 0x7ff) << OR1K_ADDR_L2_INDEX_LSB))
 
 // Page table entries are found both in the page directory and the page tables.
@@ -193,6 +194,101 @@
 /*! Helper macro to verify directory address from user input. */
 #define VERIFY_DIR_ADDR(dir) assert(dir && (((uint32_t) dir & 0x3ff) == 0));
 
+static void vmm_stc_invalidate(optimsoc_page_dir_t dir, uint32_t vaddr);
+
+/*
+ * Reverse map
+ *
+ * Every mapped page is recorded in a hash table indexed by the physical page
+ * number. This makes optimsoc_vmm_phys2virt() a hash lookup instead of a
+ * scan of the entire directory.
+ */
+#define VMM_RMAP_BITS 8
+#define VMM_RMAP_SIZE (1 << VMM_RMAP_BITS)
+
+struct vmm_rmap_entry {
+    uint32_t ppn;
+    optimsoc_page_dir_t dir;
+    uint32_t vaddr;
+    struct vmm_rmap_entry *next;
+};
+
+static struct vmm_rmap_entry *vmm_rmap[VMM_RMAP_SIZE];
+static optimsoc_mutex_t vmm_rmap_lock;
+static struct optimsoc_slab vmm_rmap_slab =
+        OPTIMSOC_SLAB_INIT("vmm_rmap", sizeof(struct vmm_rmap_entry), 64);
+
+static inline uint32_t vmm_rmap_hash(uint32_t ppn) {
+    return (ppn ^ (ppn >> VMM_RMAP_BITS)) & (VMM_RMAP_SIZE - 1);
+}
+
+static void vmm_rmap_add(optimsoc_page_dir_t dir, uint32_t vaddr,
+                         uint32_t paddr) {
+    struct vmm_rmap_entry *e = optimsoc_slab_alloc(&vmm_rmap_slab);
+    assert(e);
+
+    e->ppn = OR1K_ADDR_PN_GET(paddr);
+    e->dir = dir;
+    e->vaddr = OR1K_ADDR_PN_SET(0, OR1K_ADDR_PN_GET(vaddr));
+
+    uint32_t h = vmm_rmap_hash(e->ppn);
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&vmm_rmap_lock);
+    e->next = vmm_rmap[h];
+    vmm_rmap[h] = e;
+    optimsoc_mutex_unlock(&vmm_rmap_lock);
+    or1k_critical_end(restore);
+}
+
+static void vmm_rmap_remove(optimsoc_page_dir_t dir, uint32_t vaddr,
+                            uint32_t paddr) {
+    uint32_t ppn = OR1K_ADDR_PN_GET(paddr);
+    uint32_t page = OR1K_ADDR_PN_SET(0, OR1K_ADDR_PN_GET(vaddr));
+    struct vmm_rmap_entry *e;
+    struct vmm_rmap_entry **prev;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&vmm_rmap_lock);
+    for (prev = &vmm_rmap[vmm_rmap_hash(ppn)]; (e = *prev); prev = &e->next) {
+        if ((e->ppn == ppn) && (e->dir == dir) && (e->vaddr == page)) {
+            *prev = e->next;
+            break;
+        }
+    }
+    optimsoc_mutex_unlock(&vmm_rmap_lock);
+    or1k_critical_end(restore);
+
+    if (e) {
+        optimsoc_slab_free(&vmm_rmap_slab, e);
+    }
+}
+
+static void vmm_rmap_remove_page(uint32_t vaddr, uint32_t paddr, void *dir) {
+    vmm_rmap_remove((optimsoc_page_dir_t) dir, vaddr, paddr);
+}
+
+static int vmm_rmap_lookup(optimsoc_page_dir_t dir, uint32_t paddr,
+                           uint32_t *vaddr) {
+    uint32_t ppn = OR1K_ADDR_PN_GET(paddr);
+    int found = 0;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&vmm_rmap_lock);
+    for (struct vmm_rmap_entry *e = vmm_rmap[vmm_rmap_hash(ppn)]; e;
+            e = e->next) {
+        if ((e->ppn == ppn) && (e->dir == dir)) {
+            *vaddr = e->vaddr;
+            found = 1;
+            break;
+        }
+    }
+    optimsoc_mutex_unlock(&vmm_rmap_lock);
+    or1k_critical_end(restore);
+
+    return found;
+}
+
 optimsoc_page_dir_t optimsoc_vmm_create_page_dir() {
     optimsoc_page_dir_t dir;
 
@@ -313,6 +409,7 @@ int optimsoc_vmm_map(optimsoc_page_dir_t directory, uint32_t vaddr,
         // Try to write pte
         if (or1k_sync_sc(pteaddr, pte) == 1) {
             // Operation was successful
+            vmm_rmap_add(directory, vaddr, paddr);
             break;
         } else {
             // Another write occured
@@ -330,6 +427,47 @@ int optimsoc_vmm_map(optimsoc_page_dir_t directory, uint32_t vaddr,
     return 1;
 }
 
+int optimsoc_vmm_map_range(optimsoc_page_dir_t directory, uint32_t vaddr,
+                           uint32_t paddr, uint32_t npages) {
+    optimsoc_page_table_t table = NULL;
+    uint32_t mapped = 0;
+
+    // Verify input
+    VERIFY_DIR_ADDR(directory);
+
+    // Allow all page accesses, as optimsoc_vmm_map does
+    uint32_t ppi = (1 << OR1K_PTE_PPI_USER_BIT) | \
+            (1 << OR1K_PTE_PPI_WRITE_BIT) | (1 << OR1K_PTE_PPI_EXEC_BIT);
+
+    for (uint32_t i = 0; i < npages; i++) {
+        uint32_t v = vaddr + (i << 13);
+        uint32_t p = paddr + (i << 13);
+
+        if (!table || (OR1K_ADDR_L2_INDEX_GET(v) == 0)) {
+            // First page in this table. The regular map allocates the table
+            // if it is not present yet, afterwards we can use it directly.
+            mapped += optimsoc_vmm_map(directory, v, p);
+
+            optimsoc_pte_t dirpte = directory[OR1K_ADDR_L1_INDEX_GET(v)];
+            table = (optimsoc_page_table_t) OR1K_PTABLE(dirpte);
+            continue;
+        }
+
+        optimsoc_pte_t pte = OR1K_PTE_PPN_SET(0, OR1K_PTE_PPN_GET(p));
+        pte = OR1K_PTE_PRESENT_SET(pte, 1);
+        pte = OR1K_PTE_PPI_SET(pte, ppi);
+
+        // Only set the entry if no other page is mapped there
+        void *pteaddr = (void*) &table[OR1K_ADDR_L2_INDEX_GET(v)];
+        if (or1k_sync_cas(pteaddr, 0, pte) == 0) {
+            vmm_rmap_add(directory, v, p);
+            mapped++;
+        }
+    }
+
+    return mapped;
+}
+
 int optimsoc_vmm_unmap(optimsoc_page_dir_t directory,
                        uint32_t vaddr) {
     optimsoc_pte_t dirpte;
@@ -370,6 +508,12 @@ int optimsoc_vmm_unmap(optimsoc_page_dir_t directory,
     // Reset page table entry
     table[OR1K_ADDR_L2_INDEX_GET(vaddr)] = 0;
 
+    vmm_rmap_remove(directory, vaddr,
+                    OR1K_ADDR_PN_SET(0, OR1K_PTE_PPN_GET(pte)));
+
+    // Drop the translation from the TLB and the translation caches
+    vmm_stc_invalidate(directory, vaddr);
+
     return 1;
 }
 
@@ -436,52 +580,138 @@ int optimsoc_vmm_virt2phys(optimsoc_page_dir_t directory,
 
 int optimsoc_vmm_phys2virt(optimsoc_page_dir_t directory,
                            uint32_t paddr, uint32_t *vaddr) {
+    uint32_t addr;
 
     // Verify input
     VERIFY_DIR_ADDR(directory);
 
-    // First we iterate the directory
+    // Lookup page in reverse map
+    if (!vmm_rmap_lookup(directory, paddr, &addr)) {
+        return 0;
+    }
+
+    *vaddr = OR1K_ADDR_OFFSET_SET(addr, OR1K_ADDR_OFFSET_GET(paddr));
+
+    return 1;
+}
+
+int optimsoc_vmm_virt2phys_range(optimsoc_page_dir_t directory,
+                                 uint32_t vaddr, uint32_t size,
+                                 struct optimsoc_vmm_segment *segments,
+                                 int maxsegments) {
+    optimsoc_page_table_t table = NULL;
+    int num = 0;
+
+    // Verify input
+    VERIFY_DIR_ADDR(directory);
+
+    while (size > 0) {
+        // Load the page table once per table
+        if (!table || (OR1K_ADDR_L2_INDEX_GET(vaddr) == 0)) {
+            optimsoc_pte_t dirpte = directory[OR1K_ADDR_L1_INDEX_GET(vaddr)];
+            if (OR1K_PTE_PRESENT_GET(dirpte) == 0) {
+                return 0;
+            }
+
+            // Huge tables are not supported
+            assert(OR1K_PTE_LAST_GET(dirpte) == 0);
+
+            table = (optimsoc_page_table_t) OR1K_PTABLE(dirpte);
+        }
+
+        optimsoc_pte_t pte = table[OR1K_ADDR_L2_INDEX_GET(vaddr)];
+        if (OR1K_PTE_PRESENT_GET(pte) == 0) {
+            return 0;
+        }
+
+        // Bytes until the end of the range or the page
+        uint32_t len = 0x2000 - OR1K_ADDR_OFFSET_GET(vaddr);
+        if (len > size) {
+            len = size;
+        }
+
+        uint32_t paddr = OR1K_ADDR_PN_SET(0, OR1K_PTE_PPN_GET(pte));
+        paddr = OR1K_ADDR_OFFSET_SET(paddr, OR1K_ADDR_OFFSET_GET(vaddr));
+
+        if ((num > 0) && (segments[num - 1].paddr + segments[num - 1].size
+                == paddr)) {
+            // Physically contiguous with the previous page
+            segments[num - 1].size += len;
+        } else {
+            if (num == maxsegments) {
+                return -1;
+            }
+            segments[num].paddr = paddr;
+            segments[num].size = len;
+            num++;
+        }
+
+        vaddr += len;
+        size -= len;
+    }
+
+    return num;
+}
+
+void optimsoc_vmm_dir_walk(optimsoc_page_dir_t dir,
+                           optimsoc_vmm_walk_fptr fnc, void *arg) {
+    // Verify input
+    VERIFY_DIR_ADDR(dir);
+
     for (int dirindex = 0; dirindex < 256; dirindex++) {
-        // Extract each entry
-        optimsoc_pte_t pte = directory[dirindex];
+        optimsoc_pte_t pte = dir[dirindex];
 
-        // If the entry is invalid, try next one
-        if (OR1K_PTE_PPI_GET(pte) == 0) {
+        if (OR1K_PTE_PRESENT_GET(pte) == 0) {
             continue;
         }
 
         // Huge pages are not supported
         assert(OR1K_PTE_LAST_GET(pte) == 0);
 
-        // No huge page, instead search (L2) page table
         optimsoc_page_table_t table = (optimsoc_page_table_t) OR1K_PTABLE(pte);
 
-        // Iterate the page table
         for (int tableindex = 0; tableindex < 2048; tableindex++) {
-            // Extract each entry
             pte = table[tableindex];
 
-            // Try next one if invalid
             if (OR1K_PTE_PRESENT_GET(pte) == 0) {
                 continue;
             }
 
-            // If PPN matches the MSBs of the physical address this is a match
-            if (OR1K_PTE_PPN_GET(paddr) == OR1K_PTE_PPN_GET(pte)) {
-                // The vaddr is (L1 index, L2 index, offset)
-                uint32_t addr = OR1K_ADDR_L1_INDEX_SET(0, dirindex);
-                addr = OR1K_ADDR_L2_INDEX_SET(addr, tableindex);
-                addr = OR1K_ADDR_OFFSET_SET(addr, OR1K_ADDR_OFFSET_GET(paddr));
-                *vaddr = addr;
-                return 1;
-            }
+            uint32_t vaddr = OR1K_ADDR_L1_INDEX_SET(0, dirindex);
+            vaddr = OR1K_ADDR_L2_INDEX_SET(vaddr, tableindex);
+            uint32_t paddr = OR1K_ADDR_PN_SET(0, OR1K_PTE_PPN_GET(pte));
+
+            fnc(vaddr, paddr, arg);
         }
     }
-
-    return 0;
 }
 
+/*! Number of TLB sets, the refill only uses way 0 */
+#define VMM_TLB_SETS 64
+
+struct _optimsoc_vmm_core **_optimsoc_vmm_core;
+
 void _optimsoc_vmm_init(void) {
+    _optimsoc_vmm_core = calloc(or1k_numcores(), 4);
+    assert(_optimsoc_vmm_core);
+
+    for (int c = 0; c < or1k_numcores(); c++) {
+        struct _optimsoc_vmm_core *vc;
+        vc = calloc(1, sizeof(struct _optimsoc_vmm_core));
+        assert(vc);
+
+        // Entries are invalid as long as the valid bit is cleared
+        vc->dstc = calloc(OPTIMSOC_VMM_STC_SIZE,
+                          sizeof(struct _optimsoc_vmm_stc_entry));
+        vc->istc = calloc(OPTIMSOC_VMM_STC_SIZE,
+                          sizeof(struct _optimsoc_vmm_stc_entry));
+        assert(vc->dstc && vc->istc);
+
+        vc->ctx_next = 1;
+
+        _optimsoc_vmm_core[c] = vc;
+    }
+
     // Register exception handlers
     or1k_exception_handler_add(0x9, _optimsoc_dtlb_miss);
     or1k_exception_handler_add(0xA, _optimsoc_itlb_miss);
@@ -490,8 +720,10 @@ void _optimsoc_vmm_init(void) {
 }
 
 void _optimsoc_set_itlb(uint32_t vaddr, optimsoc_pte_t pte) {
+    struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[or1k_coreid()];
+
     // Extract the index
-    uint32_t index = OR1K_ADDR_L2_INDEX_GET(vaddr) & 0x3f;
+    uint32_t index = OR1K_ADDR_L2_INDEX_GET(vaddr) & (VMM_TLB_SETS - 1);
 
     // Extract PPN from pte
     uint32_t ppn = OR1K_PTE_PPN_GET(pte);
@@ -516,16 +748,26 @@ void _optimsoc_set_itlb(uint32_t vaddr, optimsoc_pte_t pte) {
     //  - valid
     //  - level 2 (8kB)
     //  - VPN from vaddr
+    //  - context ID
     uint32_t mr = OR1K_SPR_IMMU_ITLBW_MR_V_SET(0, 1);
     mr = OR1K_SPR_IMMU_ITLBW_MR_VPN_SET(mr, OR1K_ADDR_PN_GET(vaddr));
+    mr = OR1K_SPR_IMMU_ITLBW_MR_CID_SET(mr, vc->cid);
 
     // Write match register
     or1k_mtspr (OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, index), mr);
+
+    // Keep the registers for the next miss on this page
+    struct _optimsoc_vmm_stc_entry *e;
+    e = &vc->istc[OR1K_ADDR_PN_GET(vaddr) & (OPTIMSOC_VMM_STC_SIZE - 1)];
+    e->mr = mr;
+    e->tr = tr;
 }
 
 void _optimsoc_set_dtlb(uint32_t vaddr, optimsoc_pte_t pte) {
+    struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[or1k_coreid()];
+
     // Extract the index
-    uint32_t index = OR1K_ADDR_L2_INDEX_GET(vaddr) & 0x3f;
+    uint32_t index = OR1K_ADDR_L2_INDEX_GET(vaddr) & (VMM_TLB_SETS - 1);
 
     // Extract PPN from pte
     uint32_t ppn = OR1K_PTE_PPN_GET(pte);
@@ -557,11 +799,327 @@ void _optimsoc_set_dtlb(uint32_t vaddr, optimsoc_pte_t pte) {
     //  - valid
     //  - level 2 (8kB)
     //  - VPN from vaddr
+    //  - context ID
     uint32_t mr = OR1K_SPR_DMMU_DTLBW_MR_V_SET(0, 1);
     mr = OR1K_SPR_DMMU_DTLBW_MR_VPN_SET(mr, OR1K_ADDR_PN_GET(vaddr));
+    mr = OR1K_SPR_DMMU_DTLBW_MR_CID_SET(mr, vc->cid);
 
     // Write match register
     or1k_mtspr (OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, index), mr);
+
+    // Keep the registers for the next miss on this page
+    struct _optimsoc_vmm_stc_entry *e;
+    e = &vc->dstc[OR1K_ADDR_PN_GET(vaddr) & (OPTIMSOC_VMM_STC_SIZE - 1)];
+    e->mr = mr;
+    e->tr = tr;
+}
+
+// Lazily copied pages are not present and carry the remote page number in
+// their PTE. These bits are only meaningful while the page is not present.
+#define VMM_PTE_LAZY_BIT  OR1K_PTE_WOM_BIT
+#define VMM_PTE_BUSY_BIT  OR1K_PTE_ACCESSED_BIT
+#define VMM_PTE_LAZY      (1 << VMM_PTE_LAZY_BIT)
+#define VMM_PTE_BUSY      (1 << VMM_PTE_BUSY_BIT)
+
+// Directories with pages that were not fetched yet, further lazy copies are
+// done eagerly
+#define VMM_LAZY_DIRS 8
+
+struct vmm_lazy_dir {
+    optimsoc_page_dir_t dir;
+    uint32_t remote_tile;
+    page_alloc_fptr page_alloc;
+    volatile uint32_t pending;
+    // Next directory index to look at in optimsoc_vmm_dir_fetch_next
+    uint32_t cursor;
+};
+
+static struct vmm_lazy_dir vmm_lazy_dirs[VMM_LAZY_DIRS];
+static optimsoc_mutex_t vmm_lazy_lock;
+
+static struct vmm_lazy_dir *vmm_lazy_get(optimsoc_page_dir_t dir) {
+    for (int i = 0; i < VMM_LAZY_DIRS; i++) {
+        if (vmm_lazy_dirs[i].dir == dir) {
+            return &vmm_lazy_dirs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Claim an entry for a directory that is about to be copied lazily. Returns
+ * NULL if all entries are in use, the directory is then copied eagerly.
+ */
+static struct vmm_lazy_dir *vmm_lazy_claim(optimsoc_page_dir_t dir,
+                                           uint32_t remote_tile,
+                                           page_alloc_fptr page_alloc) {
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&vmm_lazy_lock);
+
+    struct vmm_lazy_dir *ld = vmm_lazy_get(NULL);
+    if (ld) {
+        ld->remote_tile = remote_tile;
+        ld->page_alloc = page_alloc;
+        ld->pending = 0;
+        ld->cursor = 0;
+        ld->dir = dir;
+    }
+
+    optimsoc_mutex_unlock(&vmm_lazy_lock);
+    or1k_critical_end(restore);
+
+    return ld;
+}
+
+static void vmm_lazy_release(struct vmm_lazy_dir *ld) {
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&vmm_lazy_lock);
+    ld->dir = NULL;
+    optimsoc_mutex_unlock(&vmm_lazy_lock);
+    or1k_critical_end(restore);
+}
+
+static inline optimsoc_pte_t vmm_page_pte(void *page, uint32_t ppi) {
+    optimsoc_pte_t pte = OR1K_PTE_PPN_SET(0, OR1K_PTE_PPN_GET(page));
+    pte = OR1K_PTE_PRESENT_SET(pte, 1);
+    return OR1K_PTE_PPI_SET(pte, ppi);
+}
+
+/*
+ * Fetch the lazily copied page a PTE points to. A core claims the page by
+ * setting the busy bit, other cores faulting on it wait until it is present.
+ * Returns 1 if the page is present afterwards.
+ */
+static int vmm_lazy_fetch_pte(struct vmm_lazy_dir *ld, optimsoc_pte_t *pteaddr,
+                              uint32_t vaddr, optimsoc_pte_t *result) {
+    optimsoc_pte_t pte;
+
+    while (1) {
+        pte = *pteaddr;
+
+        if (OR1K_PTE_PRESENT_GET(pte) == 1) {
+            *result = pte;
+            return 1;
+        }
+
+        if ((pte & VMM_PTE_LAZY) == 0) {
+            return 0;
+        }
+
+        if ((pte & VMM_PTE_BUSY) == 0) {
+            if (or1k_sync_cas(pteaddr, pte, pte | VMM_PTE_BUSY) == pte) {
+                break;
+            }
+        }
+    }
+
+    void *local_page = (void *)((uint32_t)(ld->page_alloc)() << 13);
+    void *remote_page = (void *) OR1K_ADDR_PN_SET(0, OR1K_PTE_PPN_GET(pte));
+
+    // This may run in the TLB miss handler, wait without yielding
+    struct dma_sg_entry entry = { local_page, ld->remote_tile, remote_page,
+                                  0x2000 / 4, REMOTE2LOCAL };
+    struct dma_chain chain;
+    dma_chain_start(&chain, &entry, 1, NULL, NULL);
+    dma_chain_wait(&chain);
+
+    vmm_rmap_add(ld->dir, vaddr, (uint32_t) local_page);
+
+    pte = vmm_page_pte(local_page, OR1K_PTE_PPI_GET(pte));
+    *pteaddr = pte;
+    *result = pte;
+
+    uint32_t pending;
+    do {
+        pending = ld->pending;
+    } while (or1k_sync_cas((void*) &ld->pending, pending, pending - 1)
+             != pending);
+
+    if (pending == 1) {
+        // All pages are local now
+        vmm_lazy_release(ld);
+    }
+
+    return 1;
+}
+
+static optimsoc_pte_t *vmm_table_pte(optimsoc_page_dir_t dir, uint32_t vaddr) {
+    optimsoc_pte_t dirpte = dir[OR1K_ADDR_L1_INDEX_GET(vaddr)];
+
+    if (OR1K_PTE_PRESENT_GET(dirpte) == 0) {
+        return NULL;
+    }
+
+    optimsoc_page_table_t table = (optimsoc_page_table_t) OR1K_PTABLE(dirpte);
+    return &table[OR1K_ADDR_L2_INDEX_GET(vaddr)];
+}
+
+/* Resolve a TLB miss on a lazily copied page */
+static int vmm_lazy_resolve(optimsoc_page_dir_t dir, uint32_t vaddr,
+                            optimsoc_pte_t *pte) {
+    struct vmm_lazy_dir *ld = vmm_lazy_get(dir);
+    if (!ld) {
+        return 0;
+    }
+
+    optimsoc_pte_t *pteaddr = vmm_table_pte(dir, vaddr);
+    if (!pteaddr) {
+        return 0;
+    }
+
+    return vmm_lazy_fetch_pte(ld, pteaddr, vaddr, pte);
+}
+
+/* Invalidate the TLB entries and cached translations of a context ID */
+static void vmm_ctx_flush(struct _optimsoc_vmm_core *vc, uint32_t cid) {
+    for (int i = 0; i < VMM_TLB_SETS; i++) {
+        uint32_t mr = or1k_mfspr(OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, i));
+        if (OR1K_SPR_DMMU_DTLBW_MR_CID_GET(mr) == cid) {
+            or1k_mtspr(OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, i), 0);
+        }
+
+        mr = or1k_mfspr(OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, i));
+        if (OR1K_SPR_IMMU_ITLBW_MR_CID_GET(mr) == cid) {
+            or1k_mtspr(OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, i), 0);
+        }
+    }
+
+    for (int i = 0; i < OPTIMSOC_VMM_STC_SIZE; i++) {
+        if (OR1K_SPR_DMMU_DTLBW_MR_CID_GET(vc->dstc[i].mr) == cid) {
+            vc->dstc[i].mr = 0;
+        }
+        if (OR1K_SPR_IMMU_ITLBW_MR_CID_GET(vc->istc[i].mr) == cid) {
+            vc->istc[i].mr = 0;
+        }
+    }
+}
+
+/* Invalidate all TLB entries of this core */
+static void vmm_tlb_flush(void) {
+    for (int i = 0; i < VMM_TLB_SETS; i++) {
+        or1k_mtspr(OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, i), 0);
+        or1k_mtspr(OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, i), 0);
+    }
+}
+
+uint32_t _optimsoc_vmm_switch(optimsoc_page_dir_t dir) {
+    struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[or1k_coreid()];
+    uint32_t cid;
+
+    if (!dir || (vc->ctx_dir[vc->cid] == dir)) {
+        // Kernel threads run untranslated, nothing to do for them or if
+        // the address space does not change
+        return vc->cid;
+    }
+
+    for (cid = 1; cid < OPTIMSOC_VMM_CONTEXTS; cid++) {
+        if (vc->ctx_dir[cid] == dir) {
+            break;
+        }
+    }
+
+    if (cid == OPTIMSOC_VMM_CONTEXTS) {
+        // No context ID yet, take a released one or recycle round robin
+        for (cid = 1; cid < OPTIMSOC_VMM_CONTEXTS; cid++) {
+            if (vc->ctx_dir[cid] == NULL) {
+                break;
+            }
+        }
+
+        if (cid == OPTIMSOC_VMM_CONTEXTS) {
+            cid = vc->ctx_next;
+            vc->ctx_next = (cid % (OPTIMSOC_VMM_CONTEXTS - 1)) + 1;
+        }
+
+        vmm_ctx_flush(vc, cid);
+        vc->ctx_dir[cid] = dir;
+    }
+
+    if (!runtime_config_get_tlb_tagging()) {
+        // The MMUs ignore the context ID. The software translation cache is
+        // tagged anyway, so the refills after the flush are cheap.
+        vmm_tlb_flush();
+        vc->flushes++;
+    }
+
+    vc->cid = cid;
+
+    return cid;
+}
+
+/*
+ * Drop the cached translation of a page in all contexts of the directory.
+ * The hardware TLB entry can only be invalidated on this core.
+ */
+static void vmm_stc_invalidate(optimsoc_page_dir_t dir, uint32_t vaddr) {
+    uint32_t vpn = OR1K_ADDR_PN_GET(vaddr);
+    uint32_t index = vpn & (OPTIMSOC_VMM_STC_SIZE - 1);
+
+    for (int c = 0; c < or1k_numcores(); c++) {
+        struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[c];
+
+        for (uint32_t cid = 1; cid < OPTIMSOC_VMM_CONTEXTS; cid++) {
+            if (vc->ctx_dir[cid] != dir) {
+                continue;
+            }
+
+            uint32_t mr = OR1K_SPR_DMMU_DTLBW_MR_V_SET(0, 1);
+            mr = OR1K_SPR_DMMU_DTLBW_MR_VPN_SET(mr, vpn);
+            mr = OR1K_SPR_DMMU_DTLBW_MR_CID_SET(mr, cid);
+
+            if (vc->dstc[index].mr == mr) {
+                vc->dstc[index].mr = 0;
+            }
+            if (vc->istc[index].mr == mr) {
+                vc->istc[index].mr = 0;
+            }
+        }
+    }
+
+    struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[or1k_coreid()];
+    if (vc->ctx_dir[vc->cid] == dir) {
+        uint32_t set = vpn & (VMM_TLB_SETS - 1);
+        uint32_t mr = or1k_mfspr(OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, set));
+        if (OR1K_SPR_DMMU_DTLBW_MR_VPN_GET(mr) == vpn) {
+            or1k_mtspr(OR1K_SPR_DMMU_DTLBW_MR_ADDR(0, set), 0);
+        }
+        mr = or1k_mfspr(OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, set));
+        if (OR1K_SPR_IMMU_ITLBW_MR_VPN_GET(mr) == vpn) {
+            or1k_mtspr(OR1K_SPR_IMMU_ITLBW_MR_ADDR(0, set), 0);
+        }
+    }
+}
+
+/* Release the context IDs of a directory on all cores */
+static void vmm_ctx_release(optimsoc_page_dir_t dir) {
+    for (int c = 0; c < or1k_numcores(); c++) {
+        struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[c];
+
+        for (uint32_t cid = 1; cid < OPTIMSOC_VMM_CONTEXTS; cid++) {
+            if (vc->ctx_dir[cid] == dir) {
+                // The entries are flushed when the ID is taken again
+                vc->ctx_dir[cid] = NULL;
+            }
+        }
+    }
+}
+
+void optimsoc_vmm_tlb_get_stats(struct optimsoc_vmm_tlb_stats *stats) {
+    struct _optimsoc_vmm_core *vc = _optimsoc_vmm_core[or1k_coreid()];
+
+    stats->dmiss = vc->dmiss;
+    stats->imiss = vc->imiss;
+    stats->dstc_hits = vc->dstc_hits;
+    stats->istc_hits = vc->istc_hits;
+    stats->cycles = vc->cycles;
+    stats->flushes = vc->flushes;
+}
+
+void optimsoc_vmm_tlb_trace(void) {
+    struct optimsoc_vmm_tlb_stats stats;
+
+    optimsoc_vmm_tlb_get_stats(&stats);
+    runtime_trace_tlb_stats(&stats);
 }
 
 // Allocate the callback function pointers for the page fault handlers
@@ -576,7 +1134,7 @@ void optimsoc_vmm_set_ifault_handler(optimsoc_pfault_handler_fptr handler) {
     _optimsoc_vmm_ifault_handler = handler;
 }
 
-void _optimsoc_dtlb_miss(void) {
+void _optimsoc_dtlb_refill(void) {
     optimsoc_page_dir_t dir;
 
     // Get current thread's page directory
@@ -595,6 +1153,9 @@ void _optimsoc_dtlb_miss(void) {
     if (pte) {
         // Update TLB
         _optimsoc_set_dtlb(vaddr, pte);
+    } else if (vmm_lazy_resolve(dir, vaddr, &pte)) {
+        // The page of a lazy directory copy was fetched
+        _optimsoc_set_dtlb(vaddr, pte);
     } else {
         // Raise page fault
         assert(_optimsoc_vmm_dfault_handler);
@@ -602,7 +1163,7 @@ void _optimsoc_dtlb_miss(void) {
     }
 }
 
-void _optimsoc_itlb_miss(void) {
+void _optimsoc_itlb_refill(void) {
     optimsoc_page_dir_t dir;
 
     // Get current thread's page directory
@@ -621,6 +1182,9 @@ void _optimsoc_itlb_miss(void) {
     if (pte) {
         // Update TLB
         _optimsoc_set_itlb(vaddr, pte);
+    } else if (vmm_lazy_resolve(dir, vaddr, &pte)) {
+        // The page of a lazy directory copy was fetched
+        _optimsoc_set_itlb(vaddr, pte);
     } else {
         // Raise page fault
         assert(_optimsoc_vmm_ifault_handler);
@@ -651,6 +1215,18 @@ void optimsoc_vmm_destroy_page_dir(optimsoc_page_dir_t dir) {
     // Verify input
     VERIFY_DIR_ADDR(dir);
 
+    // Drop pages of a lazy copy that were never fetched
+    struct vmm_lazy_dir *ld = vmm_lazy_get(dir);
+    if (ld) {
+        vmm_lazy_release(ld);
+    }
+
+    // The directory has no context ID anymore
+    vmm_ctx_release(dir);
+
+    // Drop the reverse mappings of all pages
+    optimsoc_vmm_dir_walk(dir, vmm_rmap_remove_page, (void*) dir);
+
     // First we iterate the directory
     for (int dirindex = 0; dirindex < 256; dirindex++) {
         // Extract each entry
@@ -674,78 +1250,210 @@ void optimsoc_vmm_destroy_page_dir(optimsoc_page_dir_t dir) {
     free(dir);
 }
 
+int optimsoc_vmm_dir_fetch(optimsoc_page_dir_t dir, uint32_t vaddr) {
+    optimsoc_pte_t pte;
+
+    VERIFY_DIR_ADDR(dir);
+
+    if (vmm_lazy_resolve(dir, vaddr, &pte)) {
+        return 1;
+    }
+
+    return (_optimsoc_vmm_lookup(dir, vaddr) != 0);
+}
+
+int optimsoc_vmm_dir_fetch_next(optimsoc_page_dir_t dir) {
+    VERIFY_DIR_ADDR(dir);
+
+    struct vmm_lazy_dir *ld = vmm_lazy_get(dir);
+    if (!ld) {
+        return 0;
+    }
+
+    for (; ld->cursor < 0x100; ld->cursor++) {
+        optimsoc_pte_t dirpte = dir[ld->cursor];
+        if (OR1K_PTE_PRESENT_GET(dirpte) == 0) {
+            continue;
+        }
+
+        optimsoc_page_table_t table;
+        table = (optimsoc_page_table_t) OR1K_PTABLE(dirpte);
+
+        for (uint32_t t = 0; t < 0x800; t++) {
+            optimsoc_pte_t pte = table[t];
+            if ((OR1K_PTE_PRESENT_GET(pte) == 0) && (pte & VMM_PTE_LAZY)) {
+                uint32_t vaddr = OR1K_ADDR_L1_INDEX_SET(0, ld->cursor);
+                vaddr = OR1K_ADDR_L2_INDEX_SET(vaddr, t);
+                return vmm_lazy_fetch_pte(ld, &table[t], vaddr, &pte);
+            }
+        }
+    }
+
+    return 0;
+}
+
+uint32_t optimsoc_vmm_dir_pending(optimsoc_page_dir_t dir) {
+    struct vmm_lazy_dir *ld = vmm_lazy_get(dir);
+    return ld ? ld->pending : 0;
+}
+
 optimsoc_page_dir_t optimsoc_vmm_dir_copy(uint32_t remote_tile,
                                           void *remote_addr,
                                           page_alloc_fptr page_alloc_fnc)
+{
+    return optimsoc_vmm_dir_copy_flags(remote_tile, remote_addr,
+                                       page_alloc_fnc, 0);
+}
+
+static void vmm_fetch_table(struct dma_chain *chain,
+                            struct dma_sg_entry *entry, uint32_t *buffer,
+                            uint32_t remote_tile, optimsoc_pte_t dirpte) {
+    entry->local = buffer;
+    entry->remote_tile = remote_tile;
+    entry->remote = (void*) OR1K_PTABLE(dirpte);
+    entry->size = 0x2000 / 4;
+    entry->dir = REMOTE2LOCAL;
+
+    dma_chain_start(chain, entry, 1, NULL, NULL);
+}
+
+optimsoc_page_dir_t optimsoc_vmm_dir_copy_flags(uint32_t remote_tile,
+                                                void *remote_addr,
+                                                page_alloc_fptr page_alloc_fnc,
+                                                uint32_t flags)
 {
     optimsoc_page_dir_t local_dir;
     optimsoc_page_dir_t remote_dir;
+    int lazy = (flags & OPTIMSOC_VMM_COPY_LAZY);
 
     local_dir = optimsoc_vmm_create_page_dir();
 
+    struct vmm_lazy_dir *ld = NULL;
+    if (lazy) {
+        ld = vmm_lazy_claim(local_dir, remote_tile, page_alloc_fnc);
+        // Too many lazy copies pending, copy this one right away
+        lazy = (ld != NULL);
+    }
+
     remote_dir = (optimsoc_page_dir_t) malloc(0x400);
     assert(remote_dir);
 
-    uint32_t *remote_table = malloc(0x2000);
-    assert(remote_table);
-
     /* copy remote page dir */
     optimsoc_dma_transfer(remote_dir, remote_tile, remote_addr,
                           0x400, REMOTE2LOCAL);
 
-    for (uint32_t dir_index = 0; dir_index < 0x100; dir_index ++) {
+    /* indices of the present tables */
+    uint32_t tables[0x100];
+    uint32_t numtables = 0;
 
+    for (uint32_t dir_index = 0; dir_index < 0x100; dir_index ++) {
         if (OR1K_PTE_PRESENT_GET(remote_dir[dir_index]) == 1) {
+            tables[numtables++] = dir_index;
+        }
+    }
 
-            uint32_t *local_table =
-                _optimsoc_vmm_create_page_table();
+    /* two table buffers, the next table is fetched while one is processed */
+    uint32_t *remote_table[2];
+    struct dma_chain table_chain[2];
+    struct dma_sg_entry table_entry[2];
 
-            optimsoc_pte_t dirpte = 0;
-            dirpte = OR1K_PTE_PRESENT_SET(dirpte, 1);
-            dirpte = OR1K_PTE_PPN_SET(dirpte, OR1K_PTE_PPN_GET(local_table));
-            local_dir[dir_index] = (uint32_t) dirpte;
+    remote_table[0] = malloc(0x2000);
+    remote_table[1] = malloc(0x2000);
+    assert(remote_table[0] && remote_table[1]);
 
-            optimsoc_dma_transfer(remote_table, remote_tile,
-                                  (void*) OR1K_PTABLE(remote_dir[dir_index]),
-                                  0x2000,
-                                  REMOTE2LOCAL);
+    /* list of pages to copy, grows while the tables are processed */
+    struct dma_sg_entry *pages = NULL;
+    uint32_t numpages = 0;
+    uint32_t maxpages = 0;
 
-            for (uint32_t table_index = 0;
-                table_index < 0x800;
-                table_index ++) {
+    if (numtables > 0) {
+        vmm_fetch_table(&table_chain[0], &table_entry[0], remote_table[0],
+                        remote_tile, remote_dir[tables[0]]);
+    }
 
-                if (OR1K_PTE_PRESENT_GET(remote_table[table_index])) {
-                    void *local_page = (void *)((uint32_t)(page_alloc_fnc)() << 13);
+    for (uint32_t t = 0; t < numtables; t++) {
+        uint32_t dir_index = tables[t];
+        uint32_t *table = remote_table[t % 2];
 
-                    uint32_t ppn = OR1K_PTE_PPN_GET(local_page);
-                    uint32_t pte = OR1K_PTE_PPN_SET(0, ppn);
-                    pte = OR1K_PTE_PRESENT_SET(pte, 1);
+        _optimsoc_dma_chain_wait(&table_chain[t % 2]);
 
-                    uint32_t ppi = (1 << OR1K_PTE_PPI_USER_BIT)
-                        | (1 << OR1K_PTE_PPI_WRITE_BIT)
-                        | (1 << OR1K_PTE_PPI_EXEC_BIT);
+        if (t + 1 < numtables) {
+            vmm_fetch_table(&table_chain[(t + 1) % 2],
+                            &table_entry[(t + 1) % 2],
+                            remote_table[(t + 1) % 2], remote_tile,
+                            remote_dir[tables[t + 1]]);
+        }
 
-                    pte = OR1K_PTE_PPI_SET(pte, ppi);
+        uint32_t *local_table =
+            _optimsoc_vmm_create_page_table();
 
-                    local_table[table_index] = pte;
+        optimsoc_pte_t dirpte = 0;
+        dirpte = OR1K_PTE_PRESENT_SET(dirpte, 1);
+        dirpte = OR1K_PTE_PPN_SET(dirpte, OR1K_PTE_PPN_GET(local_table));
+        local_dir[dir_index] = (uint32_t) dirpte;
 
-                    void *remote_page = (void *) OR1K_ADDR_PN_SET(0, OR1K_PTE_PPN_GET(remote_table[table_index]));
+        for (uint32_t table_index = 0;
+            table_index < 0x800;
+            table_index ++) {
 
-                    printf("copy page %p (tile %"PRIx32") to local page %p\n",
-                           remote_page, remote_tile, local_page);
+            if (OR1K_PTE_PRESENT_GET(table[table_index]) == 0) {
+                continue;
+            }
 
-                    optimsoc_dma_transfer(local_page,
-                                          remote_tile,
-                                          remote_page,
-                                          0x2000,
-                                          REMOTE2LOCAL);
-                }
+            uint32_t ppi = (1 << OR1K_PTE_PPI_USER_BIT)
+                | (1 << OR1K_PTE_PPI_WRITE_BIT)
+                | (1 << OR1K_PTE_PPI_EXEC_BIT);
+
+            uint32_t remote_ppn = OR1K_PTE_PPN_GET(table[table_index]);
+
+            if (lazy) {
+                /* not present, remember where the page is */
+                uint32_t pte = OR1K_PTE_PPN_SET(0, remote_ppn);
+                pte = OR1K_PTE_PPI_SET(pte, ppi);
+                local_table[table_index] = pte | VMM_PTE_LAZY;
+                numpages++;
+                continue;
             }
 
+            void *local_page = (void *)((uint32_t)(page_alloc_fnc)() << 13);
+
+            local_table[table_index] = vmm_page_pte(local_page, ppi);
+
+            uint32_t vaddr = OR1K_ADDR_L1_INDEX_SET(0, dir_index);
+            vaddr = OR1K_ADDR_L2_INDEX_SET(vaddr, table_index);
+            vmm_rmap_add(local_dir, vaddr, (uint32_t) local_page);
+
+            if (numpages == maxpages) {
+                maxpages = maxpages ? 2 * maxpages : 64;
+                pages = realloc(pages, maxpages * sizeof(struct dma_sg_entry));
+                assert(pages);
+            }
+
+            pages[numpages].local = local_page;
+            pages[numpages].remote_tile = remote_tile;
+            pages[numpages].remote = (void *) OR1K_ADDR_PN_SET(0, remote_ppn);
+            pages[numpages].size = 0x2000 / 4;
+            pages[numpages].dir = REMOTE2LOCAL;
+            numpages++;
+        }
+    }
+
+    if (lazy) {
+        if (numpages > 0) {
+            ld->pending = numpages;
+        } else {
+            vmm_lazy_release(ld);
         }
+    } else if (numpages > 0) {
+        /* copy all pages, the driver keeps all DMA slots busy */
+        struct dma_chain page_chain;
+        dma_chain_start(&page_chain, pages, numpages, NULL, NULL);
+        _optimsoc_dma_chain_wait(&page_chain);
     }
 
-    free(remote_table);
+    free(pages);
+    free(remote_table[0]);
+    free(remote_table[1]);
     free(remote_dir);
     return local_dir;
 }
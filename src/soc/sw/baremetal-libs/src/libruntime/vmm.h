@@ -95,10 +95,74 @@ void _optimsoc_set_dtlb(uint32_t vaddr, optimsoc_pte_t pte);
 void _optimsoc_set_itlb(uint32_t vaddr, optimsoc_pte_t pte);
 
 
-/*! DTLB miss handler */
+/*! Number of hardware context IDs, 0 is used for no address space */
+#define OPTIMSOC_VMM_CONTEXTS   16
+
+/*! Number of entries of the software translation caches */
+#define OPTIMSOC_VMM_STC_BITS   8
+#define OPTIMSOC_VMM_STC_SIZE   (1 << OPTIMSOC_VMM_STC_BITS)
+
+/**
+ * Software translation cache entry
+ *
+ * Holds the ready-to-write TLB registers. The match register contains the
+ * valid bit, context ID and VPN and doubles as the tag.
+ */
+struct _optimsoc_vmm_stc_entry {
+    uint32_t mr;
+    uint32_t tr;
+};
+
+/**
+ * Per-core TLB state
+ *
+ * The TLB miss handlers in tlb-asm.S access this structure by offset, keep
+ * the layout in sync.
+ */
+struct _optimsoc_vmm_core {
+    /*! Current context ID */
+    uint32_t cid;
+    /*! Software translation caches, direct mapped by VPN */
+    struct _optimsoc_vmm_stc_entry *dstc;
+    struct _optimsoc_vmm_stc_entry *istc;
+    /*! TLB misses */
+    uint32_t dmiss;
+    uint32_t imiss;
+    /*! TLB misses served from the software translation cache */
+    uint32_t dstc_hits;
+    uint32_t istc_hits;
+    /*! Tick timer cycles spent in the TLB miss handlers */
+    uint32_t cycles;
+    /*! TLB flushes on address space switches */
+    uint32_t flushes;
+    /*! Directory of each context ID */
+    optimsoc_page_dir_t ctx_dir[OPTIMSOC_VMM_CONTEXTS];
+    /*! Next context ID to recycle */
+    uint32_t ctx_next;
+};
+
+extern struct _optimsoc_vmm_core **_optimsoc_vmm_core;
+
+/**
+ * Switch the address space of this core
+ *
+ * Assigns a context ID to the directory. The TLB is only flushed if the
+ * hardware does not tag TLB entries with the context ID or a context ID is
+ * recycled.
+ *
+ * @param dir Directory of the thread to run, NULL for kernel threads
+ * @return Context ID to set in the supervision register
+ */
+uint32_t _optimsoc_vmm_switch(optimsoc_page_dir_t dir);
+
+/*! DTLB miss handler, fast path in tlb-asm.S */
 void _optimsoc_dtlb_miss(void);
-/*! ITLB miss handler */
+/*! ITLB miss handler, fast path in tlb-asm.S */
 void _optimsoc_itlb_miss(void);
+/*! DTLB refill from the page directory */
+void _optimsoc_dtlb_refill(void);
+/*! ITLB refill from the page directory */
+void _optimsoc_itlb_refill(void);
 
 /*! DMMU fault handler */
 void _optimsoc_dpage_fault(void);
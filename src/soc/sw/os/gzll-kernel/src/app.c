@@ -7,6 +7,7 @@
 #include "gzll.h"
 
 #include "app.h"
+#include "messages.h"
 
 struct optimsoc_list_t *gzll_app_list;
 
@@ -93,4 +94,7 @@ void gzll_apps_bootstrap() {
         map = gzll_boot_apps.instances[appidx].mappings;
         _gzll_app_bootstrap(appidx, name, map);
     }
+
+    // Tell the other ranks about all nodes started here at once
+    message_flush_node_updates();
 }
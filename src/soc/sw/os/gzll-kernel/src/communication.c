@@ -1,15 +1,18 @@
 
 #include <stdio.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include <optimsoc-baremetal.h>
 #include <optimsoc-runtime.h>
 #include <optimsoc-mp.h>
+#include <or1k-support.h>
 
 #include "gzll.h"
 #include "app.h"
 #include "messages.h"
 #include "node.h"
+#include "node_migrate.h"
 #include "taskdir.h"
 
 optimsoc_mp_endpoint_handle _gzll_mp_ep_system;
@@ -19,14 +22,166 @@ typedef void (*gzll_message_handler_fptr)(struct gzll_message *);
 
 gzll_message_handler_fptr gzll_message_handlers[GZLL_NUM_MESSAGE_TYPES];
 
+/*
+ * Message pump
+ *
+ * The communication thread receives the kernel messages. Messages with short
+ * handlers are handled right away, the others are queued for a pool of
+ * worker threads, so that for example a node fetch does not hold back the
+ * other messages. Incoming and outgoing messages use a pool of buffers.
+ */
+#define GZLL_MESSAGE_WORKERS 2
+
+struct gzll_message_work {
+    struct gzll_message_work *next;
+    uint32_t stamp;
+    uint32_t buffer[GZLL_MESSAGE_MAX_SIZE / 4];
+};
+
+static struct optimsoc_slab gzll_message_slab =
+        OPTIMSOC_SLAB_INIT("gzll_message", sizeof(struct gzll_message_work), 8);
+
+/* Message types that are handled by the workers */
+static const uint8_t gzll_message_deferred[GZLL_NUM_MESSAGE_TYPES] = {
+    [GZLL_NODE_FETCH] = 1
+};
+
+static struct gzll_message_work *gzll_work_head;
+static struct gzll_message_work *gzll_work_tail;
+static uint32_t gzll_work_depth;
+static optimsoc_mutex_t gzll_work_lock;
+
+static optimsoc_thread_t gzll_message_worker_threads[GZLL_MESSAGE_WORKERS];
+
+/* Workers suspended on the empty queue, protected by the queue lock */
+static optimsoc_thread_t gzll_work_idle[GZLL_MESSAGE_WORKERS];
+static uint32_t gzll_work_nidle;
+
+static struct gzll_message *message_alloc(uint32_t type, uint32_t len) {
+    assert(len <= GZLL_MESSAGE_MAX_SIZE);
+
+    struct gzll_message_work *work = optimsoc_slab_alloc(&gzll_message_slab);
+    assert(work != NULL);
+
+    struct gzll_message *msg = (struct gzll_message*) work->buffer;
+    msg->type = type;
+    msg->source_rank = gzll_rank;
+    msg->len = len;
+
+    return msg;
+}
+
+static void message_free(struct gzll_message *msg) {
+    struct gzll_message_work *work;
+    work = (struct gzll_message_work*) ((uint8_t*) msg -
+            offsetof(struct gzll_message_work, buffer));
+
+    optimsoc_slab_free(&gzll_message_slab, work);
+}
+
+static void work_queue_push(struct gzll_message_work *work) {
+    uint32_t depth;
+    optimsoc_thread_t worker = NULL;
+
+    work->next = NULL;
+    work->stamp = optimsoc_timer_timestamp();
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_work_lock);
+    if (gzll_work_tail) {
+        gzll_work_tail->next = work;
+    } else {
+        gzll_work_head = work;
+    }
+    gzll_work_tail = work;
+    depth = ++gzll_work_depth;
+    if (gzll_work_nidle > 0) {
+        worker = gzll_work_idle[--gzll_work_nidle];
+    }
+    optimsoc_mutex_unlock(&gzll_work_lock);
+    or1k_critical_end(restore);
+
+    OPTIMSOC_TRACE(GZLL_TRACE_MESSAGE_QUEUE, depth);
+
+    if (worker) {
+        optimsoc_thread_wakeup(worker);
+    }
+}
+
+/* Take the next message, the worker is suspended while the queue is empty */
+static struct gzll_message_work *work_queue_pop() {
+    struct gzll_message_work *work;
+    optimsoc_thread_t current = optimsoc_thread_current();
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_work_lock);
+    while ((work = gzll_work_head) == NULL) {
+        /* Interrupts stay disabled until the thread is suspended, a push
+           from another core waits for that before it resumes us */
+        gzll_work_idle[gzll_work_nidle++] = current;
+        optimsoc_mutex_unlock(&gzll_work_lock);
+        optimsoc_thread_suspend(current);
+        optimsoc_mutex_lock(&gzll_work_lock);
+    }
+    gzll_work_head = work->next;
+    if (!gzll_work_head) {
+        gzll_work_tail = NULL;
+    }
+    gzll_work_depth--;
+    optimsoc_mutex_unlock(&gzll_work_lock);
+    or1k_critical_end(restore);
+
+    return work;
+}
+
+static void message_worker() {
+    while (1) {
+        struct gzll_message_work *work = work_queue_pop();
+
+        uint32_t latency = optimsoc_timer_timestamp() - work->stamp;
+        /* Timestamps of different cores are not synchronized */
+        if ((int32_t) latency < 0) {
+            latency = 0;
+        }
+        OPTIMSOC_TRACE(GZLL_TRACE_MESSAGE_LATENCY, latency);
+
+        struct gzll_message *msg = (struct gzll_message*) work->buffer;
+        gzll_message_handlers[msg->type](msg);
+
+        optimsoc_slab_free(&gzll_message_slab, work);
+    }
+}
+
+/* Pending task directory updates, broadcast as one message */
+static uint32_t gzll_node_updates[GZLL_MESSAGE_MAX_SIZE / 4];
+static optimsoc_mutex_t gzll_node_updates_lock;
+
 void communication_init() {
     // Initialize function pointers
-    gzll_message_handlers[GZLL_NODE_NEW] = &gzll_message_node_new_handler;
+    gzll_message_handlers[GZLL_NODE_UPDATE] = &gzll_message_node_update_handler;
     gzll_message_handlers[GZLL_NODE_MIGRATE] = &gzll_message_node_migrate_handler;
     gzll_message_handlers[GZLL_NODE_FETCH] = &gzll_message_node_fetch_handler;
 
+    struct gzll_message *updates = (struct gzll_message*) gzll_node_updates;
+    updates->type = GZLL_NODE_UPDATE;
+    updates->source_rank = gzll_rank;
+    updates->len = sizeof(struct gzll_message);
+    optimsoc_mutex_init(&gzll_node_updates_lock);
+    optimsoc_mutex_init(&gzll_work_lock);
+
+    for (int w = 0; w < GZLL_MESSAGE_WORKERS; w++) {
+        struct optimsoc_thread_attr *attr;
+        attr = malloc(sizeof(struct optimsoc_thread_attr));
+        optimsoc_thread_attr_init(attr);
+        attr->identifier = "msgworker";
+        attr->flags |= OPTIMSOC_THREAD_FLAG_KERNEL;
+        optimsoc_thread_create(&gzll_message_worker_threads[w],
+                               &message_worker, attr);
+    }
+
     optimsoc_mp_endpoint_create(&_gzll_mp_ep_system, 0, 0,
-                                OPTIMSOC_MP_EP_CONNECTIONLESS, 32, 64);
+                                OPTIMSOC_MP_EP_CONNECTIONLESS, 32,
+                                GZLL_MESSAGE_MAX_SIZE);
 
     printf("Local endpoint created: %p\n", _gzll_mp_ep_system);
 
@@ -47,81 +202,169 @@ void communication_init() {
 }
 
 void communication_thread() {
-    uint8_t buffer[256];
-    struct gzll_message *msg = (struct gzll_message*) buffer;
-
     printf("Communication thread started\n");
 
     while (1) {
+        struct gzll_message_work *work;
+        work = optimsoc_slab_alloc(&gzll_message_slab);
+        assert(work != NULL);
+
+        struct gzll_message *msg = (struct gzll_message*) work->buffer;
+
         uint32_t received;
-        optimsoc_mp_msg_recv(_gzll_mp_ep_system, buffer, 256, &received);
+        optimsoc_mp_msg_recv(_gzll_mp_ep_system, (uint8_t*) work->buffer,
+                             GZLL_MESSAGE_MAX_SIZE, &received);
 
         assert((received > 1) && (received == msg->len));
         assert(msg->type < GZLL_NUM_MESSAGE_TYPES);
-        gzll_message_handlers[msg->type](msg);
 
+        if (gzll_message_deferred[msg->type]) {
+            work_queue_push(work);
+        } else {
+            gzll_message_handlers[msg->type](msg);
+            optimsoc_slab_free(&gzll_message_slab, work);
+        }
     }
 
 }
 
-void message_send_node_new(uint32_t app_id, uint32_t app_nodeid,
-                           uint32_t nodeid, const char *nodename) {
-    uint32_t msg_size, namelen, namelen_align;
+static void message_broadcast(struct gzll_message *msg) {
+    for (int r = 0; r < optimsoc_get_numct(); ++r) {
+        if (r == gzll_rank) {
+            continue;
+        }
+        optimsoc_mp_msg_send(_gzll_mp_ep_system, _gzll_mp_ep_system_remote[r],
+                             (uint8_t*) msg, msg->len);
+    }
+}
+
+/*
+ * Take the pending updates out of the batch. Called with the lock held,
+ * the message is sent after the lock is released.
+ */
+static int node_updates_take(uint32_t *buffer) {
+    struct gzll_message *updates = (struct gzll_message*) gzll_node_updates;
+
+    if (updates->len == sizeof(struct gzll_message)) {
+        return 0;
+    }
 
-    // Determine the length of the name appended to the message
-    namelen = strlen(nodename);
+    memcpy(buffer, gzll_node_updates, updates->len);
+    updates->len = sizeof(struct gzll_message);
+
+    return 1;
+}
+
+static void node_update_queue(uint32_t app_id, uint32_t app_nodeid,
+                              uint32_t nodeid, const char *nodename) {
+    uint32_t namelen, namelen_align, size, restore;
+    uint32_t full[GZLL_MESSAGE_MAX_SIZE / 4];
+    int send;
+
+    // Determine the length of the name appended to the update
+    namelen = nodename ? strlen(nodename) : 0;
     // Align this to the next multiple of 4
     namelen_align = ((namelen + 3) >> 2) << 2;
 
-    // The overall message size
-    msg_size = namelen_align + sizeof(struct gzll_message) +
-            sizeof(struct gzll_message_node_new);
+    size = sizeof(struct gzll_message_node_update) + namelen_align;
+    assert(sizeof(struct gzll_message) + size <= GZLL_MESSAGE_MAX_SIZE);
 
-    struct gzll_message *msg;
-    struct gzll_message_node_new *msg_node_new;
+    struct gzll_message *updates = (struct gzll_message*) gzll_node_updates;
 
-    msg = calloc(1, msg_size);
-    msg->len = msg_size;
-    msg->source_rank = gzll_rank;
-    msg->type = GZLL_NODE_NEW;
+    restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_node_updates_lock);
 
-    msg_node_new = (struct gzll_message_node_new*) &msg->data[0];
-    msg_node_new->app_id = app_id;
-    msg_node_new->app_nodeid = app_nodeid;
-    memcpy(msg_node_new->app_nodename, nodename, namelen);
+    // Send the batch first if the update does not fit anymore
+    send = 0;
+    if (updates->len + size > GZLL_MESSAGE_MAX_SIZE) {
+        send = node_updates_take(full);
+    }
 
-    for (int r = 0; r < optimsoc_get_numct(); ++r) {
-        if (r == gzll_rank) {
-            continue;
-        }
-        optimsoc_mp_msg_send(_gzll_mp_ep_system, _gzll_mp_ep_system_remote[r],
-                             (uint8_t*) msg, msg_size);
+    struct gzll_message_node_update *update;
+    update = (struct gzll_message_node_update*) ((uint8_t*) updates +
+            updates->len);
+    update->app_id = app_id;
+    update->app_nodeid = app_nodeid;
+    update->rank_nodeid = nodeid;
+    update->namelen = namelen;
+    memset(update->app_nodename, 0, namelen_align);
+    memcpy(update->app_nodename, nodename, namelen);
+    updates->len += size;
+
+    optimsoc_mutex_unlock(&gzll_node_updates_lock);
+    or1k_critical_end(restore);
+
+    if (send) {
+        message_broadcast((struct gzll_message*) full);
     }
-    free(msg);
 }
 
-void gzll_message_node_new_handler(struct gzll_message *msg) {
-    struct gzll_message_node_new *msg_node;
-    char name[256]; int strlen;
+void message_send_node_new(uint32_t app_id, uint32_t app_nodeid,
+                           uint32_t nodeid, const char *nodename) {
+    node_update_queue(app_id, app_nodeid, nodeid, nodename);
+}
+
+void message_send_node_moved(uint32_t app_id, uint32_t app_nodeid,
+                             uint32_t nodeid) {
+    node_update_queue(app_id, app_nodeid, nodeid, NULL);
+}
 
-    msg_node = (struct gzll_message_node_new*) msg->data;
-    strlen = msg->len - sizeof(struct gzll_message) - sizeof (struct gzll_message_node_new);
-    memcpy(name, msg_node->app_nodename, strlen);
-    name[strlen] = 0;
+void message_flush_node_updates() {
+    uint32_t buffer[GZLL_MESSAGE_MAX_SIZE / 4];
+    int send;
 
-/*    printf("Received new node information\n");
-    printf("  on rank: %d\n", msg->source_rank);
-    printf("  appid: %d, nodeid: %d, ranknode: %d\n", msg_node->app_id,
-           msg_node->app_nodeid, msg_node->rank_nodeid);
-    printf("  nodename: '%s'\n", name);*/
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_node_updates_lock);
+    send = node_updates_take(buffer);
+    optimsoc_mutex_unlock(&gzll_node_updates_lock);
+    or1k_critical_end(restore);
 
-    struct gzll_app *app;
-    app = gzll_app_get(msg_node->app_id);
-    assert(app);
+    if (send) {
+        message_broadcast((struct gzll_message*) buffer);
+    }
+}
+
+void gzll_message_node_update_handler(struct gzll_message *msg) {
+    uint32_t offset = 0;
+    uint32_t len = msg->len - sizeof(struct gzll_message);
+
+    while (offset < len) {
+        struct gzll_message_node_update *update;
+        update = (struct gzll_message_node_update*) &msg->data[offset];
+
+        struct gzll_app *app;
+        app = gzll_app_get(update->app_id);
+        assert(app);
+
+        if (update->namelen > 0) {
+            // A new node
+            char name[GZLL_MESSAGE_MAX_SIZE];
+            memcpy(name, update->app_nodename, update->namelen);
+            name[update->namelen] = 0;
+
+            taskdir_task_register(app->task_dir, update->app_nodeid,
+                                  name, msg->source_rank,
+                                  update->rank_nodeid);
+        } else {
+            // A node migrated to the source rank
+            uint32_t rank, nodeid;
+            if (taskdir_mapping_lookup(app->task_dir, update->app_nodeid,
+                                       &rank, &nodeid) == 0) {
+                taskdir_task_remap(app->task_dir, update->app_nodeid,
+                                   rank, msg->source_rank,
+                                   nodeid, update->rank_nodeid);
+            } else {
+                // The move overtook the registration of the node, keep
+                // its location in a placeholder the registration names
+                taskdir_task_register(app->task_dir, update->app_nodeid,
+                                      NULL, msg->source_rank,
+                                      update->rank_nodeid);
+            }
+        }
 
-    taskdir_task_register(app->task_dir, msg_node->app_nodeid,
-                          msg_node->app_nodename, msg->source_rank,
-                          msg_node->rank_nodeid);
+        offset += sizeof(struct gzll_message_node_update)
+                + (((update->namelen + 3) >> 2) << 2);
+    }
 }
 
 void message_send_node_migrate(uint32_t appid, uint32_t taskid,
@@ -130,13 +373,7 @@ void message_send_node_migrate(uint32_t appid, uint32_t taskid,
     uint32_t msg_length = sizeof(struct gzll_message)
         + sizeof(struct gzll_message_node_migrate);
 
-    struct gzll_message *msg = malloc(msg_length);
-
-    assert(msg != NULL);
-
-    msg->type = GZLL_NODE_MIGRATE;
-    msg->source_rank = gzll_rank;
-    msg->len = msg_length;
+    struct gzll_message *msg = message_alloc(GZLL_NODE_MIGRATE, msg_length);
 
     struct gzll_message_node_migrate *msg_node_migrate =
         (struct gzll_message_node_migrate*) msg->data;
@@ -149,7 +386,7 @@ void message_send_node_migrate(uint32_t appid, uint32_t taskid,
                          _gzll_mp_ep_system_remote[curr_rank], (uint8_t*) msg,
                          msg_length);
 
-    free(msg);
+    message_free(msg);
 }
 
 void gzll_message_node_migrate_handler(struct gzll_message *msg)
@@ -163,29 +400,25 @@ void gzll_message_node_migrate_handler(struct gzll_message *msg)
                       msg_node_migrate->dest);
 }
 
-void message_send_node_fetch(uint32_t dest_rank, void *node_addr)
+void message_send_node_fetch(uint32_t dest_rank, void *node_addr,
+                             uint32_t mode)
 {
     uint32_t msg_length = sizeof(struct gzll_message)
         + sizeof(struct gzll_message_node_fetch);
 
-    struct gzll_message *msg = malloc(msg_length);
-
-    assert(msg != NULL);
-
-    msg->type = GZLL_NODE_FETCH;
-    msg->source_rank = gzll_rank;
-    msg->len = msg_length;
+    struct gzll_message *msg = message_alloc(GZLL_NODE_FETCH, msg_length);
 
     struct gzll_message_node_fetch *msg_node_fetch =
         (struct gzll_message_node_fetch*) msg->data;
 
     msg_node_fetch->node_addr = node_addr;
+    msg_node_fetch->mode = mode;
 
     optimsoc_mp_msg_send(_gzll_mp_ep_system,
                          _gzll_mp_ep_system_remote[dest_rank], (uint8_t*) msg,
                          msg_length);
 
-    free(msg);
+    message_free(msg);
 }
 
 void gzll_message_node_fetch_handler(struct gzll_message *msg)
@@ -196,13 +429,28 @@ void gzll_message_node_fetch_handler(struct gzll_message *msg)
 
 
     struct gzll_node *node = gzll_node_fetch(msg->source_rank,
-                                             msg_node_fetch->node_addr);
+                                             msg_node_fetch->node_addr,
+                                             msg_node_fetch->mode);
 
     gzll_node_add(node);
 
     gzll_node_resume(node);
+    OPTIMSOC_TRACE(GZLL_TRACE_MIGRATE_RESUME, node->id);
+
+    if (optimsoc_vmm_dir_pending(node->pagedir) > 0) {
+        // Post-copy, the remaining pages follow in the background
+        gzll_node_migrate_prefetch(node);
+    } else {
+        OPTIMSOC_TRACE(GZLL_TRACE_MIGRATE_DONE, node->id);
+    }
+
+    // Update the task directory here and on the other ranks
+    struct gzll_app *app = node->app;
+    taskdir_task_remap(app->task_dir, node->taskid, msg->source_rank,
+                       gzll_rank, node->id, node->id);
+    message_send_node_moved(app->id, node->taskid, node->id);
+    message_flush_node_updates();
 
     // TODO
-    // update app->taskdir (local and global)
     // notify task origin to destroy the task there and free memory
 }
@@ -42,7 +42,12 @@ void gzll_paging_init();
 void gzll_paging_dpage_fault(uint32_t vaddr);
 void gzll_paging_ipage_fault(uint32_t vaddr);
 
+/* Page frames are identified by their page number, 0 is returned if no
+ * frame is available */
 unsigned int gzll_page_alloc();
+unsigned int gzll_page_alloc_range(unsigned int num);
+void gzll_page_free(unsigned int page);
+void gzll_page_free_range(unsigned int page, unsigned int num);
 
 void gzll_apps_bootstrap();
 
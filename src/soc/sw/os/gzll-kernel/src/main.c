@@ -3,6 +3,7 @@
 #include <optimsoc-mp.h>
 
 #include "gzll.h"
+#include "node_migrate.h"
 
 #include "../include/gzll-apps.h"
 
@@ -71,6 +72,8 @@ void init() {
     attr->flags |= OPTIMSOC_THREAD_FLAG_KERNEL;
     optimsoc_thread_create(&_gzll_comm_thread, &communication_thread, attr);
 
+    gzll_node_migrate_init();
+
     gzll_apps_bootstrap();
 
 }
@@ -1,27 +1,93 @@
 
 #include <optimsoc-runtime.h>
+#include "gzll.h"
 
 #include <assert.h>
+#include <string.h>
 
-void gzll_memcpy_from_userspace(void* dest, void* src, size_t size) {
-    void *psrc;
-    optimsoc_page_dir_t dir = optimsoc_thread_get_pagedir(optimsoc_thread_current());
+/* Number of pages that are translated at once */
+#define USERCOPY_PAGES 8
+
+/*
+ * Map zeroed pages for all unmapped pages of [vaddr, vaddr+size). This is
+ * the demand allocation a user access to these pages would trigger. Pages
+ * of a lazy copy that are not fetched yet are fetched instead.
+ */
+static void usercopy_fault_in(optimsoc_page_dir_t dir, uint32_t vaddr,
+                              size_t size) {
+    uint32_t page = vaddr & ~0x1fff;
+    uint32_t end = vaddr + size;
+    uint32_t paddr;
 
-    int rv = optimsoc_vmm_virt2phys(dir, (uint32_t) src, (uint32_t* )&psrc);
+    for (; page < end; page += 0x2000) {
+        if (optimsoc_vmm_virt2phys(dir, page, &paddr)) {
+            continue;
+        }
 
-    assert(rv); // TODO: allocate page if this fails
+        // The page of a migrated node may still be on the origin tile
+        if (optimsoc_vmm_dir_fetch(dir, page)) {
+            continue;
+        }
 
-    memcpy(dest, psrc, size);
+        uint32_t alloced = gzll_page_alloc();
+        assert(alloced);
+
+        memset((void*) (alloced << 13), 0, 0x2000);
+        optimsoc_vmm_map(dir, page, alloced << 13);
+    }
 }
 
-void gzll_memcpy_to_userspace(void* dest, void* src, size_t size) {
-    void *pdest;
-    optimsoc_page_dir_t dir = optimsoc_thread_get_pagedir(optimsoc_thread_current());
+/*
+ * Copy between a kernel buffer and a user buffer. The user buffer is
+ * translated in windows of a few pages, each physically contiguous segment
+ * of a window is copied with a single memcpy.
+ */
+static void usercopy(void *kernel, uint32_t user, size_t size, int to_user) {
+    optimsoc_page_dir_t dir;
+    dir = optimsoc_thread_get_pagedir(optimsoc_thread_current());
+    assert(dir);
+
+    while (size > 0) {
+        // Window up to the end of the last page, starting at an unaligned
+        // address it can have one segment per page at most
+        size_t window = USERCOPY_PAGES * 0x2000 - (user & 0x1fff);
+        if (window > size) {
+            window = size;
+        }
+
+        struct optimsoc_vmm_segment segments[USERCOPY_PAGES];
+        int num = optimsoc_vmm_virt2phys_range(dir, user, window, segments,
+                                               USERCOPY_PAGES);
+
+        if (num == 0) {
+            // A page of the window is not mapped yet
+            usercopy_fault_in(dir, user, window);
+            num = optimsoc_vmm_virt2phys_range(dir, user, window, segments,
+                                               USERCOPY_PAGES);
+        }
+        assert(num > 0);
 
-    int rv = optimsoc_vmm_virt2phys(dir, (uint32_t) dest, (uint32_t* )&pdest);
+        for (int s = 0; s < num; s++) {
+            void *phys = (void*) segments[s].paddr;
 
-    assert(rv); // TODO: allocate page if this fails
+            if (to_user) {
+                memcpy(phys, kernel, segments[s].size);
+            } else {
+                memcpy(kernel, phys, segments[s].size);
+            }
 
-    memcpy(pdest, src, size);
+            kernel += segments[s].size;
+        }
 
+        user += window;
+        size -= window;
+    }
+}
+
+void gzll_memcpy_from_userspace(void* dest, void* src, size_t size) {
+    usercopy(dest, (uint32_t) src, size, 0);
+}
+
+void gzll_memcpy_to_userspace(void* dest, void* src, size_t size) {
+    usercopy(src, (uint32_t) dest, size, 1);
 }
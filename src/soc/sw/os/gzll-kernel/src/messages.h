@@ -1,17 +1,26 @@
 #ifndef SRC_MESSAGES_H_
 #define SRC_MESSAGES_H_
 
+/* Depth of the message work queue when a message is queued */
+#define GZLL_TRACE_MESSAGE_QUEUE   0x403
+/* Cycles a queued message waited for a worker */
+#define GZLL_TRACE_MESSAGE_LATENCY 0x404
+
 void message_send_node_new(uint32_t appid, uint32_t app_nodeid, uint32_t nodeid,
                            const char *nodename);
 void message_send_node_migrate(uint32_t appid, uint32_t taskid,
                                  uint32_t curr_rank, uint32_t new_rank);
-void message_send_node_fetch(uint32_t dest_rank, void *node_addr);
+void message_send_node_fetch(uint32_t dest_rank, void *node_addr,
+                             uint32_t mode);
+void message_send_node_moved(uint32_t appid, uint32_t app_nodeid,
+                             uint32_t nodeid);
+void message_flush_node_updates();
 
 
 #define GZLL_NUM_MESSAGE_TYPES 3
 
 enum gzll_message_types {
-    GZLL_NODE_NEW,
+    GZLL_NODE_UPDATE,
     GZLL_NODE_MIGRATE,
     GZLL_NODE_FETCH
 };
@@ -24,11 +33,19 @@ struct gzll_message {
     uint8_t data[0];
 };
 
-struct gzll_message_node_new {
+/* Maximum size of a message */
+#define GZLL_MESSAGE_MAX_SIZE 256
+
+/*
+ * Task directory update of a node on the source rank. Updates are batched,
+ * a GZLL_NODE_UPDATE message carries as many as fit.
+ */
+struct gzll_message_node_update {
     uint32_t app_id;
     uint32_t app_nodeid;
     uint32_t rank_nodeid;
-    char     app_nodename[0];
+    uint32_t namelen; /* 0 if an existing node moved */
+    char     app_nodename[0]; /* padded to a multiple of 4 */
 };
 
 struct gzll_message_node_migrate {
@@ -39,9 +56,10 @@ struct gzll_message_node_migrate {
 
 struct gzll_message_node_fetch {
     void* node_addr;
+    uint32_t mode; /* GZLL_MIGRATE_* */
 };
 
-void gzll_message_node_new_handler(struct gzll_message *msg);
+void gzll_message_node_update_handler(struct gzll_message *msg);
 void gzll_message_node_migrate_handler(struct gzll_message *msg);
 void gzll_message_node_fetch_handler(struct gzll_message *msg);
 
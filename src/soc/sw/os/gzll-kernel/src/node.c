@@ -2,6 +2,7 @@
 #include "gzll-apps.h"
 #include "messages.h"
 #include "node.h"
+#include "node_migrate.h"
 
 #include "gzll-syscall.h"
 
@@ -31,44 +32,61 @@ gzll_node_id gzll_get_nodeid() {
 }
 
 struct optimsoc_list_t *gzll_node_list;
+/* Nodes are added and removed by the message workers concurrently */
+static optimsoc_mutex_t gzll_node_list_lock;
 
 void gzll_node_add(struct gzll_node *node) {
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_node_list_lock);
     if (!gzll_node_list) {
         gzll_node_list = optimsoc_list_init(node);
     } else {
         optimsoc_list_add_tail(gzll_node_list, node);
     }
+    optimsoc_mutex_unlock(&gzll_node_list_lock);
+    or1k_critical_end(restore);
 }
 
 int gzll_node_remove(struct gzll_node *node)
 {
+    int rv = -1; /* failed */
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_node_list_lock);
     if (gzll_node_list != NULL) {
         if (optimsoc_list_remove(gzll_node_list, node) == 1) {
             /* success */
-            return 0;
+            rv = 0;
         }
     }
+    optimsoc_mutex_unlock(&gzll_node_list_lock);
+    or1k_critical_end(restore);
 
-    /* failed */
-    return -1;
+    return rv;
 }
 
 struct gzll_node *gzll_node_find(uint32_t id)
 {
     optimsoc_list_iterator_t iter;
 
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_node_list_lock);
+
     struct gzll_node *node = (struct gzll_node*) optimsoc_list_first_element(
         gzll_node_list, &iter);
 
     while (node != NULL) {
         if (node->id == id) {
-            return node;
+            break;
         }
 
         node = optimsoc_list_next_element(gzll_node_list, &iter);
     }
 
-    return NULL;
+    optimsoc_mutex_unlock(&gzll_node_list_lock);
+    or1k_critical_end(restore);
+
+    return node;
 }
 
 
@@ -87,28 +105,42 @@ void gzll_node_start(uint32_t app_id, char* app_name, uint32_t app_nodeid,
     optimsoc_page_dir_t pdir = optimsoc_vmm_create_page_dir();
 
     unsigned int num_pages = (size + 8191) >> 13;
-    for (unsigned int p = 0; p < num_pages; p++) {
-        unsigned int alloced = gzll_page_alloc();
-        assert(alloced);
 
-        void *from = taskdesc->obj_start + p * 8192;
+    // Load the image into one contiguous run of pages if possible, so that
+    // it is copied and mapped in one go
+    unsigned int alloced = gzll_page_alloc_range(num_pages);
+    if (alloced) {
         void *to = (void*) (alloced * 8192);
 
-        unsigned int len = 8192;
-        if ((unsigned int) from + len > (unsigned int) taskdesc->obj_end) {
-            len = (unsigned int) taskdesc->obj_end - (unsigned int) from;
-        }
+        printf(" load %d bytes to %p\n", size, to);
+        memcpy(to, taskdesc->obj_start, size);
+
+        rv = optimsoc_vmm_map_range(pdir, 0x2000, (uint32_t) to, num_pages);
+        assert(rv == num_pages);
+    } else {
+        // Memory is fragmented, fall back to single pages
+        for (unsigned int p = 0; p < num_pages; p++) {
+            alloced = gzll_page_alloc();
+            assert(alloced);
 
-        printf(" - load %d bytes from %p to %p\n", len, from, to);
-        memcpy(to, from, len);
+            void *from = taskdesc->obj_start + p * 8192;
+            void *to = (void*) (alloced * 8192);
 
-        rv = optimsoc_vmm_map(pdir, (uint32_t) (p << 13) + 0x2000,
-                              (uint32_t) to);
-        assert(rv == 1);
+            unsigned int len = 8192;
+            if ((unsigned int) from + len > (unsigned int) taskdesc->obj_end) {
+                len = (unsigned int) taskdesc->obj_end - (unsigned int) from;
+            }
+
+            memcpy(to, from, len);
+
+            rv = optimsoc_vmm_map(pdir, (uint32_t) (p << 13) + 0x2000,
+                                  (uint32_t) to);
+            assert(rv == 1);
+        }
     }
 
     // Create a stack
-    unsigned int alloced = gzll_page_alloc();
+    alloced = gzll_page_alloc();
     assert(alloced);
     optimsoc_vmm_map(pdir, 0xfffffffc, alloced << 13);
 
@@ -144,6 +176,33 @@ void gzll_node_start(uint32_t app_id, char* app_name, uint32_t app_nodeid,
     message_send_node_new(app_id, app_nodeid, nodeid, nodename);
 }
 
+static void node_page_free(uint32_t vaddr, uint32_t paddr, void *arg) {
+    gzll_page_free(paddr >> 13);
+}
+
+void gzll_syscall_thread_exit(struct gzll_syscall *syscall) {
+    optimsoc_thread_t thread;
+    struct gzll_node* node;
+    thread = optimsoc_thread_current();
+    node = (struct gzll_node*) optimsoc_thread_get_extra_data(thread);
+
+    if (node != NULL) {
+        gzll_node_remove(node);
+        gzll_node_migrate_cancel(node);
+
+        // Return the page frames of the node to the pool. The node does not
+        // touch its memory anymore, we are in the kernel on its behalf.
+        optimsoc_thread_set_pagedir(thread, NULL);
+        optimsoc_vmm_dir_walk(node->pagedir, &node_page_free, NULL);
+        optimsoc_vmm_destroy_page_dir(node->pagedir);
+
+        optimsoc_thread_set_extra_data(thread, NULL);
+        free(node);
+    }
+
+    optimsoc_thread_exit();
+}
+
 void gzll_syscall_self(struct gzll_syscall *syscall) {
     optimsoc_thread_t thread;
     struct gzll_node* task;
@@ -227,7 +286,7 @@ void gzll_node_resume(struct gzll_node *node) {
 }
 
 struct gzll_node * gzll_node_fetch
-(uint32_t remote_tile, void *remote_addr) {
+(uint32_t remote_tile, void *remote_addr, uint32_t mode) {
 
     dma_transfer_handle_t dma_handle;
     struct gzll_node remote_node;
@@ -244,20 +303,31 @@ struct gzll_node * gzll_node_fetch
     strncpy(local_node->identifier, remote_node.identifier,
             GZLL_NODE_IDENTIFIER_LENGTH);
 
-    /* app */
-    local_node->app = malloc(sizeof(struct gzll_app));
-    assert(local_node->app != NULL);
-    optimsoc_dma_transfer(local_node->app, remote_tile, remote_node.app,
+    /* app, every rank has its own instance */
+    struct gzll_app remote_app;
+    optimsoc_dma_transfer(&remote_app, remote_tile, remote_node.app,
                           sizeof(struct gzll_app), REMOTE2LOCAL);
+    local_node->app = gzll_app_get(remote_app.id);
+    assert(local_node->app != NULL);
+
+    /* task id in the app */
+    local_node->taskid = remote_node.taskid;
 
     /* state */
     assert(remote_node.state == GZLL_NODE_SUSPENDED);
     local_node->state = GZLL_NODE_SUSPENDED;
 
     /* pagedir */
-    local_node->pagedir = optimsoc_vmm_dir_copy(remote_tile,
-                                                remote_node.pagedir,
-                                                &gzll_page_alloc);
+    /* with post-copy only the page tables are copied, the pages are fetched
+     * on first access */
+    uint32_t copy_flags = 0;
+    if (mode == GZLL_MIGRATE_POSTCOPY) {
+        copy_flags |= OPTIMSOC_VMM_COPY_LAZY;
+    }
+    local_node->pagedir = optimsoc_vmm_dir_copy_flags(remote_tile,
+                                                      remote_node.pagedir,
+                                                      &gzll_page_alloc,
+                                                      copy_flags);
 
     /* thread */
     local_node->thread = optimsoc_thread_dma_copy(remote_tile,
@@ -30,6 +30,7 @@ struct gzll_node *gzll_node_find(uint32_t id);
 
 void gzll_node_suspend(struct gzll_node *node);
 void gzll_node_resume(struct gzll_node *node);
-struct gzll_node *gzll_node_fetch(uint32_t remote_tile, void *remote_addr);
+struct gzll_node *gzll_node_fetch(uint32_t remote_tile, void *remote_addr,
+                                  uint32_t mode);
 
 #endif
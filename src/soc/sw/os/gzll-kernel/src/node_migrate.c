@@ -2,8 +2,24 @@
 
 #include "app.h"
 #include "messages.h"
+#include "node.h"
+#include "node_migrate.h"
 #include "taskdir.h"
 
+#include <optimsoc-baremetal.h>
+
+uint32_t gzll_node_migrate_mode = GZLL_MIGRATE_POSTCOPY;
+
+void gzll_node_migrate_set_mode(uint32_t mode)
+{
+    gzll_node_migrate_mode = mode;
+}
+
+uint32_t gzll_node_migrate_get_mode()
+{
+    return gzll_node_migrate_mode;
+}
+
 int gzll_node_migrate(uint32_t appid, uint32_t nodeid, uint32_t dest_rank)
 {
 
@@ -24,9 +40,17 @@ int gzll_node_migrate(uint32_t appid, uint32_t nodeid, uint32_t dest_rank)
                 struct gzll_node *node = gzll_node_find(node_id);
                 assert(node != NULL);
 
+                // A node that came here with post-copy may still have pages
+                // on its previous tile. The copy only takes present pages,
+                // fetch the others first.
+                gzll_node_migrate_cancel(node);
+                while (optimsoc_vmm_dir_fetch_next(node->pagedir)) { }
+
                 gzll_node_suspend(node);
+                OPTIMSOC_TRACE(GZLL_TRACE_MIGRATE_SUSPEND, node->id);
 
-                message_send_node_fetch(dest_rank, node);
+                message_send_node_fetch(dest_rank, node,
+                                        gzll_node_migrate_mode);
                 return 0;
             }
         }
@@ -34,3 +58,108 @@ int gzll_node_migrate(uint32_t appid, uint32_t nodeid, uint32_t dest_rank)
 
     return -1;
 }
+
+/*
+ * Background prefetch of post-copy migrated nodes
+ *
+ * A kernel thread fetches the pages that were not accessed yet, one at a
+ * time, and yields in between so that the migrated nodes run meanwhile. A
+ * page is fetched with interrupts disabled, so that a node exiting on the
+ * same core never waits for a preempted fetch.
+ */
+
+static struct optimsoc_list_t *gzll_prefetch_nodes;
+static optimsoc_mutex_t gzll_prefetch_lock;
+static optimsoc_thread_t gzll_prefetch_thread;
+/* Set while the prefetch thread is suspended on the empty list */
+static int gzll_prefetch_idle;
+/* Node the prefetch thread currently fetches a page for */
+static struct gzll_node * volatile gzll_prefetch_current;
+/* Set if the current node was cancelled during its fetch */
+static int gzll_prefetch_cancelled;
+
+void gzll_node_migrate_prefetch(struct gzll_node *node)
+{
+    int wakeup;
+
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_prefetch_lock);
+    optimsoc_list_add_tail(gzll_prefetch_nodes, node);
+    wakeup = gzll_prefetch_idle;
+    gzll_prefetch_idle = 0;
+    optimsoc_mutex_unlock(&gzll_prefetch_lock);
+    or1k_critical_end(restore);
+
+    if (wakeup) {
+        optimsoc_thread_wakeup(gzll_prefetch_thread);
+    }
+}
+
+void gzll_node_migrate_cancel(struct gzll_node *node)
+{
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_prefetch_lock);
+    optimsoc_list_remove(gzll_prefetch_nodes, node);
+    if (gzll_prefetch_current == node) {
+        gzll_prefetch_cancelled = 1;
+    }
+    optimsoc_mutex_unlock(&gzll_prefetch_lock);
+    or1k_critical_end(restore);
+
+    /* A fetch for the node may be running on another core. It cannot be
+       on this core, as the fetch runs with interrupts disabled. */
+    while (gzll_prefetch_current == node) { }
+}
+
+static void prefetch_thread()
+{
+    while (1) {
+        struct gzll_node *node;
+        int more;
+
+        uint32_t restore = or1k_critical_begin();
+        optimsoc_mutex_lock(&gzll_prefetch_lock);
+        /* The thread is suspended while there is no node */
+        while ((node = optimsoc_list_remove_head(gzll_prefetch_nodes))
+                == NULL) {
+            gzll_prefetch_idle = 1;
+            optimsoc_mutex_unlock(&gzll_prefetch_lock);
+            optimsoc_thread_suspend(gzll_prefetch_thread);
+            optimsoc_mutex_lock(&gzll_prefetch_lock);
+        }
+        gzll_prefetch_current = node;
+        optimsoc_mutex_unlock(&gzll_prefetch_lock);
+
+        more = optimsoc_vmm_dir_fetch_next(node->pagedir);
+
+        optimsoc_mutex_lock(&gzll_prefetch_lock);
+        if (more && !gzll_prefetch_cancelled) {
+            // More to come, continue round robin with the other nodes
+            optimsoc_list_add_tail(gzll_prefetch_nodes, node);
+        } else if (!more) {
+            OPTIMSOC_TRACE(GZLL_TRACE_MIGRATE_DONE, node->id);
+        }
+        gzll_prefetch_cancelled = 0;
+        gzll_prefetch_current = NULL;
+        optimsoc_mutex_unlock(&gzll_prefetch_lock);
+        or1k_critical_end(restore);
+
+        if (more) {
+            optimsoc_thread_yield(optimsoc_thread_current());
+        }
+    }
+}
+
+void gzll_node_migrate_init()
+{
+    optimsoc_mutex_init(&gzll_prefetch_lock);
+    gzll_prefetch_nodes = optimsoc_list_init(0);
+
+    struct optimsoc_thread_attr *attr;
+    attr = malloc(sizeof(struct optimsoc_thread_attr));
+    optimsoc_thread_attr_init(attr);
+    attr->identifier = "prefetch";
+    attr->flags |= OPTIMSOC_THREAD_FLAG_KERNEL;
+    attr->priority = OPTIMSOC_THREAD_PRIORITY_LOWEST;
+    optimsoc_thread_create(&gzll_prefetch_thread, &prefetch_thread, attr);
+}
@@ -1,6 +1,33 @@
 #ifndef __NODE_MIGRATE_H__
 #define __NODE_MIGRATE_H__
 
+#include <stdint.h>
+
+struct gzll_node;
+
+/* Trace events of a migration, the node id is the value */
+#define GZLL_TRACE_MIGRATE_SUSPEND 0x400
+#define GZLL_TRACE_MIGRATE_RESUME  0x401
+#define GZLL_TRACE_MIGRATE_DONE    0x402
+
+/*
+ * Migration modes
+ *
+ * With stop-and-copy the destination copies the whole address space before
+ * the node resumes. With post-copy the node resumes as soon as its thread
+ * and page tables arrived, pages follow on the first access and from a
+ * background prefetch.
+ */
+#define GZLL_MIGRATE_STOPCOPY 0
+#define GZLL_MIGRATE_POSTCOPY 1
+
 int gzll_node_migrate(uint32_t appid, uint32_t taskid, uint32_t dest_rank);
 
+void gzll_node_migrate_set_mode(uint32_t mode);
+uint32_t gzll_node_migrate_get_mode();
+
+void gzll_node_migrate_init();
+void gzll_node_migrate_prefetch(struct gzll_node *node);
+void gzll_node_migrate_cancel(struct gzll_node *node);
+
 #endif //__NODE_MIGRATE_H__
@@ -22,12 +22,15 @@
  *   Max Koenen <koenenwmn@googlemail.com>
  */
 
+#include <optimsoc-baremetal.h>
 #include <optimsoc-runtime.h>
 #include "gzll.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <or1k-support.h>
 #include <or1k-sprs.h>
@@ -35,7 +38,16 @@
 extern void* _end;
 extern void* _or1k_stack_bottom;
 
-struct optimsoc_list_t *gzll_pagepool_local;
+// The local page pool is a bitmap with one bit per page frame, set if the
+// frame is free. Allocation starts searching at the word of the last
+// allocation, so single pages are found in constant time on average.
+static uint32_t *gzll_pagepool_bitmap;
+static uint32_t gzll_pagepool_first;
+static uint32_t gzll_pagepool_num;
+static uint32_t gzll_pagepool_words;
+static uint32_t gzll_pagepool_hint;
+static uint32_t gzll_pagepool_free;
+static optimsoc_mutex_t gzll_pagepool_lock;
 
 uint32_t gzll_swapping() {
         // TODO: Check if global memory is there
@@ -61,25 +73,164 @@ void gzll_paging_init() {
     printf("Initialize local page pool\n");
     printf(" - add %p to %p (%d pages)\n", s, e, n);
 
-    gzll_pagepool_local = optimsoc_list_init(0);
+    optimsoc_mutex_init(&gzll_pagepool_lock);
 
-    for (int p = start_page; p <= end_page; p++) {
-        optimsoc_list_add_tail(gzll_pagepool_local, (void*) p);
+    gzll_pagepool_first = start_page;
+    gzll_pagepool_num = n;
+    gzll_pagepool_words = (n + 31) / 32;
+    gzll_pagepool_hint = 0;
+    gzll_pagepool_free = n;
+
+    gzll_pagepool_bitmap = malloc(gzll_pagepool_words * 4);
+    assert(gzll_pagepool_bitmap);
+
+    // All pages are free, the bits beyond the last page stay cleared
+    memset(gzll_pagepool_bitmap, 0xff, (n / 32) * 4);
+    if (n % 32) {
+        gzll_pagepool_bitmap[n / 32] = (1 << (n % 32)) - 1;
+    }
+}
+
+// Pages of a node migrated with post-copy may still be on the origin tile
+static int gzll_paging_fetch_migrated(uint32_t vaddr) {
+    optimsoc_page_dir_t dir;
+    dir = optimsoc_thread_get_pagedir(optimsoc_thread_current());
+
+    if ((dir == NULL) || (optimsoc_vmm_dir_pending(dir) == 0)) {
+        return 0;
     }
+
+    return optimsoc_vmm_dir_fetch(dir, vaddr);
 }
 
 void gzll_paging_dpage_fault(uint32_t vaddr) {
+    if (gzll_paging_fetch_migrated(vaddr)) {
+        return;
+    }
+
     printf("Data page fault for %p @PC=%p\n", (void*) vaddr,
            or1k_mfspr(OR1K_SPR_SYS_EPCR_ADDR(0)));
     exit(1);
 }
 
 void gzll_paging_ipage_fault(uint32_t vaddr) {
+    if (gzll_paging_fetch_migrated(vaddr)) {
+        return;
+    }
+
     printf("Instruction page fault for %p\n", (void*) vaddr);
     exit(1);
 }
 
-// TODO: Add page_t handling
+static inline int pagepool_isfree(uint32_t i) {
+    return (gzll_pagepool_bitmap[i / 32] >> (i % 32)) & 1;
+}
+
+static void pagepool_mark(uint32_t i, uint32_t num, int free) {
+    for (uint32_t p = i; p < i + num; p++) {
+        if (free) {
+            gzll_pagepool_bitmap[p / 32] |= 1 << (p % 32);
+        } else {
+            gzll_pagepool_bitmap[p / 32] &= ~(1 << (p % 32));
+        }
+    }
+}
+
+static inline void pagepool_lock(uint32_t *restore) {
+    *restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&gzll_pagepool_lock);
+}
+
+static inline void pagepool_unlock(uint32_t restore) {
+    optimsoc_mutex_unlock(&gzll_pagepool_lock);
+    or1k_critical_end(restore);
+}
+
 unsigned int gzll_page_alloc() {
-    return (int) optimsoc_list_remove_head(gzll_pagepool_local);
+    uint32_t restore;
+    unsigned int page = 0;
+
+    pagepool_lock(&restore);
+
+    for (uint32_t w = 0; w < gzll_pagepool_words; w++) {
+        uint32_t idx = (gzll_pagepool_hint + w) % gzll_pagepool_words;
+        uint32_t bits = gzll_pagepool_bitmap[idx];
+
+        if (bits != 0) {
+            uint32_t bit = __builtin_ctz(bits);
+            gzll_pagepool_bitmap[idx] = bits & ~(1 << bit);
+            gzll_pagepool_hint = idx;
+            gzll_pagepool_free--;
+            page = gzll_pagepool_first + idx * 32 + bit;
+            break;
+        }
+    }
+
+    pagepool_unlock(restore);
+
+    return page;
+}
+
+unsigned int gzll_page_alloc_range(unsigned int num) {
+    uint32_t restore;
+    unsigned int page = 0;
+
+    if (num == 1) {
+        return gzll_page_alloc();
+    }
+
+    pagepool_lock(&restore);
+
+    if (num <= gzll_pagepool_free) {
+        uint32_t run = 0;
+        uint32_t i = 0;
+
+        while (i < gzll_pagepool_num) {
+            // Skip fully allocated words at once
+            if ((i % 32 == 0) && (gzll_pagepool_bitmap[i / 32] == 0)) {
+                run = 0;
+                i += 32;
+                continue;
+            }
+
+            if (pagepool_isfree(i)) {
+                run++;
+                if (run == num) {
+                    uint32_t first = i + 1 - num;
+                    pagepool_mark(first, num, 0);
+                    gzll_pagepool_free -= num;
+                    page = gzll_pagepool_first + first;
+                    break;
+                }
+            } else {
+                run = 0;
+            }
+            i++;
+        }
+    }
+
+    pagepool_unlock(restore);
+
+    return page;
+}
+
+void gzll_page_free_range(unsigned int page, unsigned int num) {
+    uint32_t restore;
+
+    assert(page >= gzll_pagepool_first);
+    assert(page + num <= gzll_pagepool_first + gzll_pagepool_num);
+
+    uint32_t i = page - gzll_pagepool_first;
+
+    pagepool_lock(&restore);
+    for (uint32_t p = i; p < i + num; p++) {
+        assert(!pagepool_isfree(p));
+    }
+    pagepool_mark(i, num, 1);
+    gzll_pagepool_free += num;
+    pagepool_unlock(restore);
+}
+
+void gzll_page_free(unsigned int page) {
+    gzll_page_free_range(page, 1);
 }
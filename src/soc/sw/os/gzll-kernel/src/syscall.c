@@ -27,6 +27,7 @@
 #include <optimsoc-runtime.h>
 #include "gzll-syscall.h"
 
+void gzll_syscall_thread_exit(struct gzll_syscall *syscall);
 void gzll_syscall_get_kernelinfo(struct gzll_syscall *syscall);
 void gzll_syscall_self(struct gzll_syscall *syscall);
 void gzll_syscall_get_taskid(struct gzll_syscall *syscall);
@@ -42,7 +43,7 @@ void gzll_syscall_handler(struct optimsoc_syscall *optimsoc_syscall) {
 
     switch (syscall->id) {
     case GZLL_SYSCALL_THREAD_EXIT:
-        optimsoc_thread_exit();
+        gzll_syscall_thread_exit(syscall);
         break;
     case GZLL_SYSCALL_KERNEL_INFO:
         gzll_syscall_get_kernelinfo(syscall);
@@ -1,19 +1,154 @@
 #include "taskdir.h"
+#include "mp.h"
+
+#include <or1k-support.h>
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* Initial number of task entries */
+#define TASKDIR_MIN_CAPACITY 8
+
+/* Keep the compiler from moving memory accesses across the seqlock */
+#define taskdir_barrier() __asm__ __volatile__("" ::: "memory")
+
+static inline uint32_t taskdir_hash(const char *identifier) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+
+    while (*identifier) {
+        hash ^= (uint8_t) *identifier++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t taskdir_write_begin(struct gzll_app_taskdir *dir) {
+    uint32_t restore = or1k_critical_begin();
+    optimsoc_mutex_lock(&dir->lock);
+    dir->seq++;
+    taskdir_barrier();
+    return restore;
+}
+
+static void taskdir_write_end(struct gzll_app_taskdir *dir, uint32_t restore) {
+    taskdir_barrier();
+    dir->seq++;
+    optimsoc_mutex_unlock(&dir->lock);
+    or1k_critical_end(restore);
+}
+
+static inline uint32_t taskdir_read_begin(struct gzll_app_taskdir *dir) {
+    uint32_t seq;
+
+    while ((seq = dir->seq) & 1) { }
+    taskdir_barrier();
+
+    return seq;
+}
+
+static inline int taskdir_read_retry(struct gzll_app_taskdir *dir,
+                                     uint32_t seq) {
+    taskdir_barrier();
+    return dir->seq != seq;
+}
+
+/* Grow the table geometrically so that taskid fits. Called by writers. */
+static void taskdir_grow(struct gzll_app_taskdir *dir, uint32_t taskid) {
+    unsigned int capacity = dir->capacity ? dir->capacity :
+            TASKDIR_MIN_CAPACITY;
+
+    while (capacity <= taskid) {
+        capacity *= 2;
+    }
+
+    if (capacity != dir->capacity) {
+        struct gzll_app_node *tasks;
+        tasks = malloc(capacity * sizeof(struct gzll_app_node));
+        assert(tasks != NULL);
+
+        memcpy(tasks, dir->tasks, dir->size * sizeof(struct gzll_app_node));
+
+        /* The old table may still be read by a lookup */
+        dir->tasks = tasks;
+        dir->capacity = capacity;
+    }
+
+    /* invalidate unused spare entries between the current last entry
+       and the new end*/
+    struct gzll_app_node *entry;
+    for (entry = dir->tasks + dir->size;
+         entry < dir->tasks + taskid + 1;
+         ++entry) {
+        entry->identifier = NULL;
+        entry->endpoints = NULL;
+        entry->rank = TASKDIR_INVALID_RANK;
+        entry->nodeid = TASKDIR_INVALID_NODEID;
+    }
+
+    taskdir_barrier();
+    dir->size = taskid + 1;
+}
+
+static void taskdir_index_insert(uint32_t *index, unsigned int size,
+                                 uint32_t hash, uint32_t taskid) {
+    unsigned int i = hash & (size - 1);
+
+    while (index[i] != TASKDIR_INVALID_NODEID) {
+        i = (i + 1) & (size - 1);
+    }
+
+    index[i] = taskid;
+}
+
+/* Add a task to the identifier index. Called by writers. */
+static void taskdir_index_add(struct gzll_app_taskdir *dir, uint32_t taskid) {
+    if (2 * (dir->index_used + 1) > dir->index_size) {
+        /* Keep the index at most half full, rebuild it at twice the size */
+        unsigned int size = dir->index_size ? 2 * dir->index_size :
+                2 * TASKDIR_MIN_CAPACITY;
+
+        uint32_t *index = malloc(size * sizeof(uint32_t));
+        assert(index != NULL);
+        memset(index, 0xff, size * sizeof(uint32_t));
+
+        for (unsigned int i = 0; i < dir->index_size; i++) {
+            uint32_t t = dir->index[i];
+            if (t != TASKDIR_INVALID_NODEID) {
+                taskdir_index_insert(index, size, dir->tasks[t].hash, t);
+            }
+        }
+
+        /* Publish the index before its size, the old one is kept */
+        dir->index = index;
+        taskdir_barrier();
+        dir->index_size = size;
+    }
+
+    taskdir_index_insert(dir->index, dir->index_size, dir->tasks[taskid].hash,
+                         taskid);
+    dir->index_used++;
+}
+
 void taskdir_initialize(struct gzll_app_taskdir *dir) {
 
     optimsoc_mutex_init(&dir->lock);
 
+    dir->seq = 0;
     dir->size = 0;
+    dir->capacity = 0;
     dir->tasks = NULL;
+    dir->index_size = 0;
+    dir->index_used = 0;
+    dir->index = NULL;
 }
 
 int taskdir_task_delete(struct gzll_app_taskdir *dir, uint32_t taskid) {
+    int rv = -1; /*failed*/
 
-    optimsoc_mutex_lock(&dir->lock);
+    uint32_t restore = taskdir_write_begin(dir);
 
     if (taskid < dir->size) {
 
@@ -27,73 +162,80 @@ int taskdir_task_delete(struct gzll_app_taskdir *dir, uint32_t taskid) {
             entry->rank = TASKDIR_INVALID_RANK;
             entry->nodeid = TASKDIR_INVALID_NODEID;
 
-            optimsoc_mutex_unlock(&dir->lock);
-            return 0; /*success*/
+            rv = 0; /*success*/
         }
 
     }
 
-    optimsoc_mutex_unlock(&dir->lock);
-    return -1; /*failed*/
+    taskdir_write_end(dir, restore);
+    return rv;
 }
 
 int taskdir_task_register(struct gzll_app_taskdir *dir, uint32_t taskid,
                           const char* identifier, uint32_t rank,
                           uint32_t nodeid) {
-
-    optimsoc_mutex_lock(&dir->lock);
     struct gzll_app_node *entry;
+    int rv = -1; /*failed*/
 
-    if (taskid >= dir->size) {
-        /* table must be expanded */
-
-        uint32_t new_size = taskid + 1;
-
-        dir->tasks = realloc(dir->tasks,
-                             new_size * sizeof(struct gzll_app_node));
-        assert(dir->tasks != NULL);
+    /* allocate outside of the directory update */
+    char *name = identifier ? strdup(identifier) : NULL;
+    struct gzll_endpoint_table *endpoints;
+    endpoint_table_init(&endpoints);
 
-        /* invalidate unused spare entries between the current last entry
-           and the new end*/
+    uint32_t restore = taskdir_write_begin(dir);
 
-        for (entry = dir->tasks + dir->size;
-             entry < dir->tasks + new_size;
-             ++entry) {
-            entry->rank = TASKDIR_INVALID_RANK;
-            entry->nodeid = TASKDIR_INVALID_NODEID;
-        }
-
-        dir->size = new_size;
+    if (taskid >= dir->size) {
+        /* table must be expanded */
+        taskdir_grow(dir, taskid);
     }
 
     entry = dir->tasks + taskid;
 
-    /* entry must be unused */
     if (entry->rank == TASKDIR_INVALID_RANK
         && entry->nodeid == TASKDIR_INVALID_NODEID) {
-
+        /* unused entry */
         entry->rank = rank;
         entry->nodeid = nodeid;
-        entry->identifier = strdup(identifier);
-        endpoint_table_init(&entry->endpoints);
+        rv = 0; /*success*/
+    } else if (entry->identifier == NULL && name != NULL) {
+        /* placeholder of a task that moved before its registration
+           arrived, keep the newer location and only name it */
+        rv = 0; /*success*/
+    }
 
-        optimsoc_mutex_unlock(&dir->lock);
+    if (rv == 0) {
+        if (entry->endpoints == NULL) {
+            entry->endpoints = endpoints;
+            endpoints = NULL;
+        }
 
-        return 0; /*success*/
-    } else {
+        if (entry->identifier == NULL && name != NULL) {
+            /* first registration of this task */
+            entry->identifier = name;
+            entry->hash = taskdir_hash(name);
+            taskdir_index_add(dir, taskid);
+            name = NULL;
+        }
+    }
 
-        optimsoc_mutex_unlock(&dir->lock);
+    taskdir_write_end(dir, restore);
 
-        return -1; /*failed*/
+    if (name) {
+        free(name);
+    }
+    if (endpoints) {
+        free(endpoints);
     }
 
+    return rv;
 }
 
 int taskdir_task_remap(struct gzll_app_taskdir *dir, uint32_t taskid,
                        uint32_t old_rank, uint32_t new_rank,
                        uint32_t old_nodeid, uint32_t new_nodeid) {
+    int rv = -1; /*failed*/
 
-    optimsoc_mutex_lock(&dir->lock);
+    uint32_t restore = taskdir_write_begin(dir);
 
     if (taskid < dir->size) {
 
@@ -102,66 +244,101 @@ int taskdir_task_remap(struct gzll_app_taskdir *dir, uint32_t taskid,
         if (entry->rank == old_rank
             && entry->nodeid == old_nodeid) {
 
-            /* there is a valid entry for this task id - delete it */
+            /* the task is where it was expected - move it */
 
             entry->rank = new_rank;
             entry->nodeid = new_nodeid;
 
-            optimsoc_mutex_unlock(&dir->lock);
-            return 0; /*success*/
+            rv = 0; /*success*/
         }
 
     }
 
-    optimsoc_mutex_unlock(&dir->lock);
-    return -1; /*failed*/
+    taskdir_write_end(dir, restore);
+    return rv;
 
 }
 
 
 int taskdir_mapping_lookup(struct gzll_app_taskdir *dir, uint32_t taskid,
                            uint32_t *rankid, uint32_t *nodeid) {
+    uint32_t seq, rank, node;
 
     assert(dir && rankid && nodeid);
 
-    optimsoc_mutex_lock(&dir->lock);
+    do {
+        seq = taskdir_read_begin(dir);
 
-    if (taskid < dir->size) {
-
-        struct gzll_app_node *entry = dir->tasks + taskid;
+        rank = TASKDIR_INVALID_RANK;
+        node = TASKDIR_INVALID_NODEID;
 
-        if (entry->rank != TASKDIR_INVALID_RANK
-            && entry->nodeid != TASKDIR_INVALID_NODEID) {
-
-            /* there is a valid entry for this task id - delete it */
-
-            *rankid = entry->rank;
-            *nodeid = entry->nodeid;
-            optimsoc_mutex_unlock(&dir->lock);
-            return 0; /*success*/
+        if (taskid < dir->size) {
+            taskdir_barrier();
+            struct gzll_app_node *entry = dir->tasks + taskid;
+            rank = entry->rank;
+            node = entry->nodeid;
         }
+    } while (taskdir_read_retry(dir, seq));
 
+    if (rank != TASKDIR_INVALID_RANK
+        && node != TASKDIR_INVALID_NODEID) {
+        *rankid = rank;
+        *nodeid = node;
+        return 0; /*success*/
     }
 
-    optimsoc_mutex_unlock(&dir->lock);
     return -1; /*failed*/
 
 }
 
 int taskdir_taskid_lookup(struct gzll_app_taskdir *dir, const char* identifier,
                           uint32_t *taskid) {
-    assert(taskid != NULL);
+    uint32_t seq, found;
 
-    optimsoc_mutex_lock(&dir->lock);
+    assert(taskid != NULL);
 
-    for (int i = 0; i < dir->size; i++) {
-        if (strcmp(dir->tasks[i].identifier, identifier) == 0) {
-            *taskid = i;
-            optimsoc_mutex_unlock(&dir->lock);
-            return 0;
+    uint32_t hash = taskdir_hash(identifier);
+
+    do {
+        seq = taskdir_read_begin(dir);
+
+        found = TASKDIR_INVALID_NODEID;
+
+        /* Read the sizes before the tables, a table is published before
+           its size grows */
+        unsigned int size = dir->index_size;
+        unsigned int tasks_size = dir->size;
+        taskdir_barrier();
+        uint32_t *index = dir->index;
+        struct gzll_app_node *tasks = dir->tasks;
+
+        /* probe at most the entire index, a concurrent update may leave
+           us without a free slot to stop at */
+        unsigned int i = hash & (size - 1);
+        for (unsigned int n = 0; n < size; n++) {
+            uint32_t t = index[i];
+            if (t == TASKDIR_INVALID_NODEID) {
+                break;
+            }
+            /* a concurrent update may hand us a task beyond our snapshot
+               or one not filled in yet, the retry discards the result */
+            if (t >= tasks_size) {
+                break;
+            }
+            const char *ident = tasks[t].identifier;
+            if ((tasks[t].hash == hash) && (ident != NULL) &&
+                    (strcmp(ident, identifier) == 0)) {
+                found = t;
+                break;
+            }
+            i = (i + 1) & (size - 1);
         }
+    } while (taskdir_read_retry(dir, seq));
+
+    if (found != TASKDIR_INVALID_NODEID) {
+        *taskid = found;
+        return 0;
     }
 
-    optimsoc_mutex_unlock(&dir->lock);
     return -1; /*failed*/
 }
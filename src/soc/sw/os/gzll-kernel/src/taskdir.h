@@ -8,15 +8,30 @@
 
 struct gzll_app_node {
     char *identifier;
+    uint32_t hash; /* hash of the identifier */
     uint32_t rank;
     uint32_t nodeid;
     struct gzll_endpoint_table *endpoints;
 };
 
+/*
+ * The task directory is read far more often than it changes. Writers
+ * serialize on the lock and make the sequence counter odd while they change
+ * the directory. Lookups take no lock, they retry if the counter changed
+ * during the lookup. Tables replaced on growth are not freed, as a lookup
+ * may still read them, with geometric growth they are smaller than the
+ * current table altogether.
+ */
 struct gzll_app_taskdir {
     optimsoc_mutex_t lock;
+    volatile uint32_t seq;
     unsigned int size;
+    unsigned int capacity;
     struct gzll_app_node *tasks;
+    /* Hash index of task ids by identifier, open addressing */
+    unsigned int index_size;
+    unsigned int index_used;
+    uint32_t *index;
 };
 
 #define TASKDIR_INVALID_NODEID 0xffffffff
@@ -35,6 +50,11 @@ int taskdir_task_delete(struct gzll_app_taskdir *dir, uint32_t taskid);
 
 /**
  * Register a new remote task
+ *
+ * A NULL identifier registers a placeholder for a task that is only known
+ * by its id yet. A later registration with the identifier names the
+ * placeholder and keeps its location.
+ *
  * @param taskid the ID of the task
  * @return error code
  */